@@ -0,0 +1,36 @@
+// Copyright 2017 Kakao Corp. <http://www.kakaocorp.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Hand-written cgo entry points for the search functions writing into caller-owned Go slices.
+// They are kept out of n2gomodule.i so that n2.go and n2gomodule_wrap.cxx stay plain SWIG output.
+
+#include <stdint.h>
+
+#include "n2gomodule.h"
+
+extern "C" {
+
+long long n2_search_by_vector_into(uintptr_t index, const float* vec, long long vec_len, int k, int ef_search,
+                                   int* ids, long long num_ids, float* distances, long long num_distances) {
+    return reinterpret_cast<n2::HnswIndex*>(index)->SearchByVectorInto(vec, vec_len, k, ef_search, ids, num_ids,
+                                                                        distances, num_distances);
+}
+
+long long n2_search_by_id_into(uintptr_t index, int id, int k, int ef_search,
+                               int* ids, long long num_ids, float* distances, long long num_distances) {
+    return reinterpret_cast<n2::HnswIndex*>(index)->SearchByIdInto(id, k, ef_search, ids, num_ids,
+                                                                    distances, num_distances);
+}
+
+}
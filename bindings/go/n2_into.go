@@ -0,0 +1,59 @@
+// Copyright 2017 Kakao Corp. <http://www.kakaocorp.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Search functions writing into caller-owned slices. They are written by hand rather than generated
+// from n2gomodule.i, so regenerating the SWIG files leaves them untouched.
+
+package n2
+
+/*
+#include <stdint.h>
+
+extern long long n2_search_by_vector_into(uintptr_t index, const float* vec, long long vec_len, int k,
+                                          int ef_search, int* ids, long long num_ids, float* distances,
+                                          long long num_distances);
+extern long long n2_search_by_id_into(uintptr_t index, int id, int k, int ef_search, int* ids, long long num_ids,
+                                      float* distances, long long num_distances);
+*/
+import "C"
+
+import "unsafe"
+
+func floatSlicePtr(s []float32) *C.float {
+	if len(s) == 0 {
+		return nil
+	}
+	return (*C.float)(unsafe.Pointer(&s[0]))
+}
+
+func intSlicePtr(s []int32) *C.int {
+	if len(s) == 0 {
+		return nil
+	}
+	return (*C.int)(unsafe.Pointer(&s[0]))
+}
+
+// SearchByVectorInto writes up to len(ids) results (and distances, unless distances is empty) into the
+// given slices without allocating, and returns the number written, or -1 if len(v) is not the index dimension.
+func SearchByVectorInto(index HnswIndex, v []float32, k int, efSearch int, ids []int32, distances []float32) int {
+	return int(C.n2_search_by_vector_into(C.uintptr_t(index.Swigcptr()), floatSlicePtr(v), C.longlong(len(v)),
+		C.int(k), C.int(efSearch), intSlicePtr(ids), C.longlong(len(ids)), floatSlicePtr(distances),
+		C.longlong(len(distances))))
+}
+
+// SearchByIdInto is SearchByVectorInto for the item with the given id.
+func SearchByIdInto(index HnswIndex, id int, k int, efSearch int, ids []int32, distances []float32) int {
+	return int(C.n2_search_by_id_into(C.uintptr_t(index.Swigcptr()), C.int(id), C.int(k), C.int(efSearch),
+		intSlicePtr(ids), C.longlong(len(ids)), floatSlicePtr(distances), C.longlong(len(distances))))
+}
@@ -12,6 +12,8 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+
 #include "n2/hnsw.h"
 
 // IMPORTANT: Please write #cgo CXXFLAGS: -std=c++11 -lgomp -I./third_party/spdlog/include 
@@ -20,11 +22,11 @@
 namespace n2 {
     class HnswIndex {
     public:
-        HnswIndex(int dimension) {
+        HnswIndex(int dimension) : dim(dimension) {
             ptr = std::unique_ptr<Hnsw>(new Hnsw(dimension));
         };
 
-        HnswIndex(int dimension, const char* metric) {
+        HnswIndex(int dimension, const char* metric) : dim(dimension) {
             ptr = std::unique_ptr<Hnsw>(new Hnsw(dimension, metric));
         };
 
@@ -106,6 +108,26 @@ namespace n2 {
               }
         };
 
+#ifndef SWIG
+        // Wrapped by hand in n2_into.go / n2_into.cxx, so that the SWIG output stays as generated.
+        // Writes up to num_ids results (and distances, unless num_distances is 0) into the caller's slices
+        // and returns the number written, or -1 if vec_len is not the index dimension.
+        int SearchByVectorInto(const float* vec, long long vec_len, int k, int ef_search,
+                               int* ids, long long num_ids, float* distances, long long num_distances) {
+            if (vec_len != dim) {
+                return -1;
+            }
+            size_t capacity = num_distances > 0 ? std::min(num_ids, num_distances) : num_ids;
+            return ptr->SearchByVector(vec, k, ef_search, ids, num_distances > 0 ? distances : nullptr, capacity);
+        };
+
+        int SearchByIdInto(int id, int k, int ef_search,
+                           int* ids, long long num_ids, float* distances, long long num_distances) {
+            size_t capacity = num_distances > 0 ? std::min(num_ids, num_distances) : num_ids;
+            return ptr->SearchById(id, k, ef_search, ids, num_distances > 0 ? distances : nullptr, capacity);
+        };
+#endif
+
         void PrintDegreeDist() {
             ptr->PrintDegreeDist();
         };
@@ -116,5 +138,6 @@ namespace n2 {
 
     private:
         std::unique_ptr<Hnsw> ptr;
+        long long dim;
     };
 }
@@ -21,6 +21,20 @@ from libcpp cimport bool as bool_t
 from libcpp.pair cimport pair
 from libcpp.vector cimport vector
 from libcpp.string cimport string
+from libc.stdint cimport uint8_t, uint64_t
+
+cdef extern from "n2/search_filter.h" namespace "n2":
+    cdef cppclass SearchFilter:
+        SearchFilter(const uint64_t*, size_t)
+
+cdef extern from "n2/hnsw_search.h" namespace "n2":
+    cdef cppclass SearchStats:
+        size_t num_queries
+        size_t num_distances
+        size_t num_visited
+        size_t num_heap_pushes
+        size_t ef_used
+        size_t hops[16]
 
 cdef extern from "n2/hnsw.h" namespace "n2":
     cdef cppclass Hnsw:
@@ -28,31 +42,85 @@ cdef extern from "n2/hnsw.h" namespace "n2":
         void SetConfigs(const vector[pair[string, string]]& configs) nogil except +
         bool_t SaveModel(const string&) nogil except +
         bool_t LoadModel(const string&, const bool_t) nogil except +
+        bool_t LoadModel(const string&, const vector[pair[string, string]]&) nogil except +
+        size_t GetModelHugePageBytes() nogil except +
         void UnloadModel() nogil except +
         void AddData(const vector[float]&) nogil except +
+        void AddBinaryData(const vector[uint8_t]&) nogil except +
         void Fit() nogil except +
         void SearchByVector(const vector[float]&, size_t, size_t, vector[int]&) nogil except +
         void SearchByVector(const vector[float]&, size_t, size_t, vector[pair[int, float]]&) nogil except +
         void SearchById(int, size_t, size_t, vector[int]&) nogil except +
         void SearchById(int, size_t, size_t, vector[pair[int, float]]&) nogil except +
+        size_t SearchByVector(const float*, size_t, size_t, int*, float*, size_t) nogil except +
+        size_t SearchById(int, size_t, size_t, int*, float*, size_t) nogil except +
+        void SearchByVector(const vector[float]&, size_t, size_t, const SearchFilter&, vector[int]&) nogil except +
+        void SearchByVector(const vector[float]&, size_t, size_t, const SearchFilter&,
+                            vector[pair[int, float]]&) nogil except +
+        void SearchById(int, size_t, size_t, const SearchFilter&, vector[int]&) nogil except +
+        void SearchById(int, size_t, size_t, const SearchFilter&, vector[pair[int, float]]&) nogil except +
+        void SearchByVectorRange(const vector[float]&, float, size_t, size_t, vector[pair[int, float]]&) nogil except +
         void BatchSearchByVectors(const vector[vector[float]]&, size_t, size_t, size_t,
                                   vector[vector[int]]&) nogil except +
         void BatchSearchByVectors(const vector[vector[float]]&, size_t, size_t, size_t,
                                   vector[vector[pair[int, float]]]&) nogil except +
+        void BatchSearchByVectors(const vector[vector[float]]&, size_t, size_t, size_t, const SearchFilter&,
+                                  vector[vector[int]]&) nogil except +
+        void BatchSearchByVectors(const vector[vector[float]]&, size_t, size_t, size_t, const SearchFilter&,
+                                  vector[vector[pair[int, float]]]&) nogil except +
+        void GroupedBatchSearchByVectors(const vector[vector[float]]&, size_t, size_t, size_t,
+                                         vector[vector[int]]&) nogil except +
+        void GroupedBatchSearchByVectors(const vector[vector[float]]&, size_t, size_t, size_t,
+                                         vector[vector[pair[int, float]]]&) nogil except +
         void BatchSearchByIds(const vector[int]&, size_t, size_t, size_t,
                               vector[vector[int]]&) nogil except +
         void BatchSearchByIds(const vector[int]&, size_t, size_t, size_t,
                               vector[vector[pair[int, float]]]&) nogil except +
+        void BatchSearchByIds(const vector[int]&, size_t, size_t, size_t, const SearchFilter&,
+                              vector[vector[int]]&) nogil except +
+        void BatchSearchByIds(const vector[int]&, size_t, size_t, size_t, const SearchFilter&,
+                              vector[vector[pair[int, float]]]&) nogil except +
+        void BatchSearchByVectors(const float*, size_t, size_t, size_t, size_t, int*, float*) nogil except +
+        void BatchSearchByIds(const int*, size_t, size_t, size_t, size_t, int*, float*) nogil except +
+        const SearchStats& GetLastSearchStats() nogil except +
+        SearchStats GetSearchStats() nogil except +
+        void ResetSearchStats() nogil except +
         void PrintDegreeDist() nogil except +
         void PrintConfigs() nogil except +
 
+cdef vector[uint64_t] _make_allowlist(allowed_ids) except *:
+    cdef vector[uint64_t] bits
+    cdef long long item_id
+    for _item_id in allowed_ids:
+        item_id = _item_id
+        if item_id < 0:
+            raise ValueError('Invalid item id: %d' % item_id)
+        if <size_t>(item_id // 64) >= bits.size():
+            bits.resize(item_id // 64 + 1, 0)
+        bits[item_id // 64] |= (<uint64_t>1) << (item_id % 64)
+    if bits.empty():
+        bits.push_back(0)
+    return bits
+
+
+cdef dict _search_stats_to_dict(const SearchStats& stats):
+    hops = [stats.hops[i] for i in range(16)]
+    while len(hops) > 1 and hops[-1] == 0:
+        hops.pop()
+    return {'num_queries': stats.num_queries, 'num_distances': stats.num_distances,
+            'num_visited': stats.num_visited, 'num_heap_pushes': stats.num_heap_pushes,
+            'ef_used': stats.ef_used, 'hops': hops}
+
+
 cdef class _HnswIndex:
     cdef Hnsw* obj
+    cdef size_t dim
 
     def __cinit__(self, _dim, _metric):
         cdef int dim = _dim
         cdef string metric = _metric.encode('ascii')
         self.obj = new Hnsw(dim, metric)
+        self.dim = dim
 
     def __dealloc__(self):
         del self.obj
@@ -62,16 +130,24 @@ cdef class _HnswIndex:
         with nogil:
             self.obj.AddData(v)
 
+    def add_binary_data(self, _v):
+        cdef vector[uint8_t] v = _v
+        with nogil:
+            self.obj.AddBinaryData(v)
+
     def save(self, _fname):
         cdef string fname = _fname.encode('ascii')
         with nogil:
             self.obj.SaveModel(fname)
 
-    def load(self, _fname, _use_mmap):
+    def load(self, _fname, _options):
         cdef string fname = _fname.encode('ascii')
-        cdef bool_t use_mmap = _use_mmap
+        cdef vector[pair[string, string]] options = _options
         with nogil:
-            self.obj.LoadModel(fname, use_mmap)
+            self.obj.LoadModel(fname, options)
+
+    def get_model_huge_page_bytes(self):
+        return self.obj.GetModelHugePageBytes()
 
     def unload(self):
         with nogil:
@@ -101,6 +177,93 @@ cdef class _HnswIndex:
             self.obj.SearchByVector(v, k, ef_search, ret)
         return ret
 
+    def search_by_vector_range(self, _v, _radius, _max_results, _ef_search):
+        cdef vector[float] v = _v
+        cdef float radius = _radius
+        cdef size_t max_results = _max_results
+        cdef size_t ef_search = _ef_search
+        cdef vector[pair[int, float]] ret
+        with nogil:
+            self.obj.SearchByVectorRange(v, radius, max_results, ef_search, ret)
+        return ret
+
+    def search_by_vector_into(self, const float[::1] v, _k, _ef_search, int[::1] ids, float[::1] distances):
+        cdef size_t k = _k
+        cdef size_t ef_search = _ef_search
+        cdef size_t capacity = ids.shape[0]
+        cdef float* distances_ptr = NULL
+        cdef size_t ret = 0
+        if v.shape[0] != self.dim:
+            raise ValueError('Invalid dimension query: %d, Predefined dimension: %d' % (v.shape[0], self.dim))
+        if distances is not None:
+            capacity = min(capacity, <size_t>distances.shape[0])
+            if capacity > 0:
+                distances_ptr = &distances[0]
+        if capacity == 0:
+            return 0
+        with nogil:
+            ret = self.obj.SearchByVector(&v[0], k, ef_search, &ids[0], distances_ptr, capacity)
+        return ret
+
+    def search_by_id_into(self, _item_id, _k, _ef_search, int[::1] ids, float[::1] distances):
+        cdef int item_id = _item_id
+        cdef size_t k = _k
+        cdef size_t ef_search = _ef_search
+        cdef size_t capacity = ids.shape[0]
+        cdef float* distances_ptr = NULL
+        cdef size_t ret = 0
+        if distances is not None:
+            capacity = min(capacity, <size_t>distances.shape[0])
+            if capacity > 0:
+                distances_ptr = &distances[0]
+        if capacity == 0:
+            return 0
+        with nogil:
+            ret = self.obj.SearchById(item_id, k, ef_search, &ids[0], distances_ptr, capacity)
+        return ret
+
+    def batch_search_by_vectors_into(self, const float[:, ::1] vs, _ef_search, _num_threads,
+                                     int[:, ::1] ids, float[:, ::1] distances):
+        cdef size_t num_queries = vs.shape[0]
+        cdef size_t k = ids.shape[1]
+        cdef size_t ef_search = _ef_search
+        cdef size_t num_threads = _num_threads
+        cdef float* distances_ptr = NULL
+        if vs.shape[1] != self.dim:
+            raise ValueError('Invalid dimension query: %d, Predefined dimension: %d' % (vs.shape[1], self.dim))
+        if <size_t>ids.shape[0] != num_queries:
+            raise ValueError('ids has %d rows for %d queries' % (ids.shape[0], num_queries))
+        if distances is not None:
+            if distances.shape[0] != ids.shape[0] or distances.shape[1] != ids.shape[1]:
+                raise ValueError('distances and ids must have the same shape')
+        if num_queries == 0 or k == 0:
+            return
+        if distances is not None:
+            distances_ptr = &distances[0, 0]
+        with nogil:
+            self.obj.BatchSearchByVectors(&vs[0, 0], num_queries, k, ef_search, num_threads, &ids[0, 0],
+                                          distances_ptr)
+
+    def batch_search_by_ids_into(self, const int[::1] item_ids, _ef_search, _num_threads,
+                                 int[:, ::1] ids, float[:, ::1] distances):
+        cdef size_t num_queries = item_ids.shape[0]
+        cdef size_t k = ids.shape[1]
+        cdef size_t ef_search = _ef_search
+        cdef size_t num_threads = _num_threads
+        cdef float* distances_ptr = NULL
+        if <size_t>ids.shape[0] != num_queries:
+            raise ValueError('ids has %d rows for %d queries' % (ids.shape[0], num_queries))
+        if distances is not None:
+            if distances.shape[0] != ids.shape[0] or distances.shape[1] != ids.shape[1]:
+                raise ValueError('distances and ids must have the same shape')
+        if num_queries == 0 or k == 0:
+            return
+        if distances is not None:
+            distances_ptr = &distances[0, 0]
+        with nogil:
+            self.obj.BatchSearchByIds(&item_ids[0], num_queries, k, ef_search, num_threads, &ids[0, 0],
+                                      distances_ptr)
+
     def search_by_id_incl_dist(self, _item_id, _k, _ef_search):
         cdef int item_id = _item_id
         cdef size_t k = _k
@@ -139,6 +302,26 @@ cdef class _HnswIndex:
             self.obj.BatchSearchByVectors(vs, k, ef_search, num_threads, rets)
         return rets
 
+    def grouped_batch_search_by_vectors_incl_dist(self, _vs, _k, _ef_search, _num_threads):
+        cdef vector[vector[float]] vs = _vs
+        cdef size_t k = _k
+        cdef size_t ef_search = _ef_search
+        cdef int num_threads = _num_threads
+        cdef vector[vector[pair[int, float]]] rets
+        with nogil:
+            self.obj.GroupedBatchSearchByVectors(vs, k, ef_search, num_threads, rets)
+        return rets
+
+    def grouped_batch_search_by_vectors(self, _vs, _k, _ef_search, _num_threads):
+        cdef vector[vector[float]] vs = _vs
+        cdef size_t k = _k
+        cdef size_t ef_search = _ef_search
+        cdef int num_threads = _num_threads
+        cdef vector[vector[int]] rets
+        with nogil:
+            self.obj.GroupedBatchSearchByVectors(vs, k, ef_search, num_threads, rets)
+        return rets
+
     def batch_search_by_ids_incl_dist(self, _item_ids, _k, _ef_search, _num_threads):
         cdef vector[int] item_ids = _item_ids
         cdef size_t k = _k
@@ -159,6 +342,100 @@ cdef class _HnswIndex:
             self.obj.BatchSearchByIds(item_ids, k, ef_search, num_threads, rets)
         return rets
 
+    def search_by_vector_filtered(self, _v, _k, _ef_search, _allowed_ids, _incl_dist):
+        cdef vector[float] v = _v
+        cdef size_t k = _k
+        cdef size_t ef_search = _ef_search
+        cdef bool_t incl_dist = _incl_dist
+        cdef vector[uint64_t] allowlist = _make_allowlist(_allowed_ids)
+        cdef SearchFilter* search_filter = new SearchFilter(allowlist.data(), allowlist.size() * 64)
+        cdef vector[int] ret
+        cdef vector[pair[int, float]] ret_incl_dist
+        try:
+            with nogil:
+                if incl_dist:
+                    self.obj.SearchByVector(v, k, ef_search, search_filter[0], ret_incl_dist)
+                else:
+                    self.obj.SearchByVector(v, k, ef_search, search_filter[0], ret)
+        finally:
+            del search_filter
+        if incl_dist:
+            return ret_incl_dist
+        return ret
+
+    def search_by_id_filtered(self, _item_id, _k, _ef_search, _allowed_ids, _incl_dist):
+        cdef int item_id = _item_id
+        cdef size_t k = _k
+        cdef size_t ef_search = _ef_search
+        cdef bool_t incl_dist = _incl_dist
+        cdef vector[uint64_t] allowlist = _make_allowlist(_allowed_ids)
+        cdef SearchFilter* search_filter = new SearchFilter(allowlist.data(), allowlist.size() * 64)
+        cdef vector[int] ret
+        cdef vector[pair[int, float]] ret_incl_dist
+        try:
+            with nogil:
+                if incl_dist:
+                    self.obj.SearchById(item_id, k, ef_search, search_filter[0], ret_incl_dist)
+                else:
+                    self.obj.SearchById(item_id, k, ef_search, search_filter[0], ret)
+        finally:
+            del search_filter
+        if incl_dist:
+            return ret_incl_dist
+        return ret
+
+    def batch_search_by_vectors_filtered(self, _vs, _k, _ef_search, _num_threads, _allowed_ids, _incl_dist):
+        cdef vector[vector[float]] vs = _vs
+        cdef size_t k = _k
+        cdef size_t ef_search = _ef_search
+        cdef int num_threads = _num_threads
+        cdef bool_t incl_dist = _incl_dist
+        cdef vector[uint64_t] allowlist = _make_allowlist(_allowed_ids)
+        cdef SearchFilter* search_filter = new SearchFilter(allowlist.data(), allowlist.size() * 64)
+        cdef vector[vector[int]] rets
+        cdef vector[vector[pair[int, float]]] rets_incl_dist
+        try:
+            with nogil:
+                if incl_dist:
+                    self.obj.BatchSearchByVectors(vs, k, ef_search, num_threads, search_filter[0], rets_incl_dist)
+                else:
+                    self.obj.BatchSearchByVectors(vs, k, ef_search, num_threads, search_filter[0], rets)
+        finally:
+            del search_filter
+        if incl_dist:
+            return rets_incl_dist
+        return rets
+
+    def batch_search_by_ids_filtered(self, _item_ids, _k, _ef_search, _num_threads, _allowed_ids, _incl_dist):
+        cdef vector[int] item_ids = _item_ids
+        cdef size_t k = _k
+        cdef size_t ef_search = _ef_search
+        cdef int num_threads = _num_threads
+        cdef bool_t incl_dist = _incl_dist
+        cdef vector[uint64_t] allowlist = _make_allowlist(_allowed_ids)
+        cdef SearchFilter* search_filter = new SearchFilter(allowlist.data(), allowlist.size() * 64)
+        cdef vector[vector[int]] rets
+        cdef vector[vector[pair[int, float]]] rets_incl_dist
+        try:
+            with nogil:
+                if incl_dist:
+                    self.obj.BatchSearchByIds(item_ids, k, ef_search, num_threads, search_filter[0], rets_incl_dist)
+                else:
+                    self.obj.BatchSearchByIds(item_ids, k, ef_search, num_threads, search_filter[0], rets)
+        finally:
+            del search_filter
+        if incl_dist:
+            return rets_incl_dist
+        return rets
+
+    def get_search_stats(self, _last):
+        if _last:
+            return _search_stats_to_dict(self.obj.GetLastSearchStats())
+        return _search_stats_to_dict(self.obj.GetSearchStats())
+
+    def reset_search_stats(self):
+        self.obj.ResetSearchStats()
+
     def print_degree_dist(self):
         with nogil:
             self.obj.PrintDegreeDist()
@@ -175,7 +452,8 @@ class HnswIndex(object):
         Args:
             dimension (int): Dimension of vectors.
             metric (string): An optional parameter to choose a distance metric.
-                            ('angular' | 'L2' | 'dot')
+                            ('angular' | 'L2' | 'dot' | 'hamming')
+                            With 'hamming', ``dimension`` is the number of bits.
 
         Returns:
             An instance of Hnsw index.
@@ -195,6 +473,15 @@ class HnswIndex(object):
         """
         return self.model.add_data(v)
 
+    def add_binary_data(self, v):
+        """Adds a bit-packed binary vector v to a 'hamming' index.
+
+        Args:
+            v (bytes): ``(dimension + 7) // 8`` bytes, LSB first.
+
+        """
+        return self.model.add_binary_data(v)
+
     def save(self, fname):
         """Saves the index to disk.
 
@@ -207,7 +494,8 @@ class HnswIndex(object):
         """
         return self.model.save(fname)
 
-    def load(self, fname, use_mmap=True):
+    def load(self, fname, use_mmap=True, huge_pages=None, load_threads=None, populate=False, advice=None,
+             lock=False, prefault_threads=None, warm_upper_layers=False):
         """Loads the index from disk.
 
         Args:
@@ -215,12 +503,51 @@ class HnswIndex(object):
             use_mmap (bool): An optional parameter indicating whether to use
                 mmap() or not (default: True).
                 If this parameter is set, N2 loads model through mmap.
+            huge_pages (string): Pages backing the model. Check what was obtained with
+                get_model_huge_page_bytes().
+
+                - Available values
+                    -  ``"none"`` (default): Regular pages.
+                    -  ``"thp"``: Transparent huge pages, as far as the kernel provides them.
+                    -  ``"2mb"``, ``"1gb"``: Reserved hugetlb pages (vm.nr_hugepages). The model is read into
+                       memory even with ``use_mmap``, on regular pages if the pool is too small.
+            load_threads (int): Threads reading the model with concurrent pread() calls when it is not
+                mapped (default: 1). Loads from fast storage need several to reach its bandwidth.
+            populate (bool): Maps the file with MAP_POPULATE, reading it in before load() returns
+                (default: False).
+            advice (string): ``"normal"`` (default), ``"random"``, ``"sequential"`` or ``"willneed"``,
+                passed to madvise() on the mapped file.
+            lock (bool): Keeps the model in memory with mlock(), bounded by RLIMIT_MEMLOCK (default: False).
+            prefault_threads (int): Touches every page of the model on this many threads before load()
+                returns (default: None, no prefault).
+            warm_upper_layers (bool): Touches the upper layers of the graph and the level-0 records of their
+                items, which every search goes through, before any other prefault (default: False).
 
         Returns:
             bool: Boolean value indicating whether model load succeeded or not.
 
         """
-        return self.model.load(fname, use_mmap)
+        options = [['UseMmap'.encode('ascii'), ('true' if use_mmap else 'false').encode('ascii')]]
+        if huge_pages is not None:
+            options.append(['HugePages'.encode('ascii'), huge_pages.encode('ascii')])
+        if load_threads is not None:
+            options.append(['LoadThreads'.encode('ascii'), str(load_threads).encode('ascii')])
+        if populate:
+            options.append(['Populate'.encode('ascii'), 'true'.encode('ascii')])
+        if advice is not None:
+            options.append(['Advice'.encode('ascii'), advice.encode('ascii')])
+        if lock:
+            options.append(['Lock'.encode('ascii'), 'true'.encode('ascii')])
+        if prefault_threads is not None:
+            options.append(['PrefaultThreads'.encode('ascii'), str(prefault_threads).encode('ascii')])
+        if warm_upper_layers:
+            options.append(['WarmUpperLayers'.encode('ascii'), 'true'.encode('ascii')])
+        return self.model.load(fname, options)
+
+    def get_model_huge_page_bytes(self):
+        """Returns the bytes of the loaded model backed by huge pages.
+        """
+        return self.model.get_model_huge_page_bytes()
 
     def unload(self):
         """Unloads (unmap) the index.
@@ -228,7 +555,8 @@ class HnswIndex(object):
         self.model.unload()
 
     def build(self, m=None, max_m0=None, ef_construction=None, n_threads=None,
-              mult=None, neighbor_selecting=None, graph_merging=None):
+              mult=None, neighbor_selecting=None, graph_merging=None, vector_storage=None,
+              pq_subspaces=None, reorder=None, model_layout=None):
         """Builds a hnsw graph with given configurations.
 
         Args:
@@ -252,6 +580,34 @@ class HnswIndex(object):
                        then merges edges at level 0. So, it takes twice the build time compared to
                        ``"skip"`` but shows slightly higher accuracy. (recommended for data under 10M scale).
 
+            vector_storage (string): Storage format of the vectors in the model.
+
+                - Available values
+                    -  ``"float32"`` (default): Raw float vectors.
+                    -  ``"sq8"``: Per-dimension uint8 scalar quantization. Graph traversal uses the codes
+                       and the final candidates are reranked against the original floats.
+                    -  ``"pq"``: Product quantization with one byte per subspace. Graph traversal uses
+                       per-query distance lookup tables and the final candidates are reranked against
+                       the original floats.
+                    -  ``"fp16"``: IEEE half precision. Halves the model size with no training step.
+                    -  ``"bf16"``: bfloat16. Halves the model size with no training step.
+
+            pq_subspaces (int): Number of PQ subspaces, which must divide the dimension
+                (default: dimension / 4 if divisible by 4, otherwise dimension).
+            reorder (string): Order of the nodes in the model. Item ids are unaffected.
+
+                - Available values
+                    -  ``"none"`` (default): The order items were added in.
+                    -  ``"bfs"``: Breadth-first order of the graph, so that neighbors mostly sit close together
+                       in memory, which saves cache and TLB misses on large models.
+                    -  ``"rcm"``: Reverse Cuthill-McKee order, breadth-first taking low-degree neighbors first.
+            model_layout (string): Placement of the graph links and vectors in the model.
+
+                - Available values
+                    -  ``"interleaved"`` (default): One record per item holding its links and its vector.
+                    -  ``"split"``: All links in one array and all vectors in another, each vector starting
+                       on a cache line, so that following links does not load vector bytes and vice versa.
+
         """
         configs = []
         if m is not None:
@@ -268,9 +624,17 @@ class HnswIndex(object):
             configs.append(['NeighborSelecting'.encode('ascii'), neighbor_selecting.encode('ascii')])
         if graph_merging is not None:
             configs.append(['GraphMerging'.encode('ascii'), graph_merging.encode('ascii')])
+        if vector_storage is not None:
+            configs.append(['VectorStorage'.encode('ascii'), vector_storage.encode('ascii')])
+        if pq_subspaces is not None:
+            configs.append(['PQSubspaces'.encode('ascii'), str(pq_subspaces).encode('ascii')])
+        if reorder is not None:
+            configs.append(['Reorder'.encode('ascii'), reorder.encode('ascii')])
+        if model_layout is not None:
+            configs.append(['ModelLayout'.encode('ascii'), model_layout.encode('ascii')])
         return self.model.build(configs)
 
-    def search_by_vector(self, v, k, ef_search=-1, include_distances=False):
+    def search_by_vector(self, v, k, ef_search=-1, include_distances=False, allowed_ids=None):
         """Returns k nearest items (as vectors) to a query item.
 
         Args:
@@ -280,6 +644,9 @@ class HnswIndex(object):
                 If you pass -1 to ef_search, ef_search will be set as the default value.
             include_distances (bool): If you set this argument to True,
                 it will return a list of tuples((item_id, distance)).
+            allowed_ids (iterable(int)): If given, only these items are returned. Other items are still
+                traversed, and the search goes on until ``ef_search`` allowed items are found, so it stays
+                accurate with selective filters.
 
         Returns:
             list(int) or list(tuple(int, float)): A list of k nearest items.
@@ -287,12 +654,72 @@ class HnswIndex(object):
         """
         if ef_search == -1:
             ef_search = k * 50
+        if allowed_ids is not None:
+            return self.model.search_by_vector_filtered(v, k, ef_search, allowed_ids, include_distances)
         if include_distances:
             return self.model.search_by_vector_incl_dist(v, k, ef_search)
         else:
             return self.model.search_by_vector(v, k, ef_search)
 
-    def search_by_id(self, item_id, k, ef_search=-1, include_distances=False):
+    def search_by_vector_range(self, v, radius, max_results=0, ef_search=-1):
+        """Returns all items within ``radius`` of a query item.
+
+        Args:
+            v (list(float)): A query vector.
+            radius (float): Distance threshold, in the unit of the distances returned by search_by_vector().
+                For ``"dot"`` indexes, items with inner product >= ``radius`` are returned.
+            max_results (int): Maximum number of items to return, nearest first (default: 0, no limit).
+            ef_search (int): Number of items beyond ``radius`` kept as search frontier (default: 50).
+                If you pass -1 to ef_search, ef_search will be set as the default value.
+
+        Returns:
+            list(tuple(int, float)): A list of (item_id, distance) within ``radius``, nearest first.
+
+        """
+        if ef_search == -1:
+            ef_search = 50
+        return self.model.search_by_vector_range(v, radius, max_results, ef_search)
+
+    def search_by_vector_into(self, v, k, ids, distances=None, ef_search=-1):
+        """Same as search_by_vector(), but reads the query from and writes the results to caller-owned buffers
+        (e.g. numpy arrays) without building Python lists.
+
+        Args:
+            v (buffer of float32): A contiguous query vector.
+            k (int): k value.
+            ids (writable buffer of int32): Receives the ids of up to ``min(k, len(ids))`` nearest items.
+            distances (writable buffer of float32): Receives their distances (optional).
+            ef_search (int): ef_search metric (default: 50 * k).
+                If you pass -1 to ef_search, ef_search will be set as the default value.
+
+        Returns:
+            int: Number of items written.
+
+        """
+        if ef_search == -1:
+            ef_search = k * 50
+        return self.model.search_by_vector_into(v, k, ef_search, ids, distances)
+
+    def search_by_id_into(self, item_id, k, ids, distances=None, ef_search=-1):
+        """Same as search_by_id(), but writes the results to caller-owned buffers (see search_by_vector_into()).
+
+        Args:
+            item_id (int): A query id.
+            k (int): k value.
+            ids (writable buffer of int32): Receives the ids of up to ``min(k, len(ids))`` nearest items.
+            distances (writable buffer of float32): Receives their distances (optional).
+            ef_search (int): ef_search metric (default: 50 * k).
+                If you pass -1 to ef_search, ef_search will be set as the default value.
+
+        Returns:
+            int: Number of items written.
+
+        """
+        if ef_search == -1:
+            ef_search = k * 50
+        return self.model.search_by_id_into(item_id, k, ef_search, ids, distances)
+
+    def search_by_id(self, item_id, k, ef_search=-1, include_distances=False, allowed_ids=None):
         """Returns k nearest items (as ids) to a query item.
 
         Args:
@@ -302,6 +729,7 @@ class HnswIndex(object):
                 If you pass -1 to ef_search, ef_search will be set as the default value.
             include_distances (bool): If you set this argument to True,
                 it will return a list of tuples((item_id, distance)).
+            allowed_ids (iterable(int)): If given, only these items are returned (see search_by_vector()).
 
         Returns:
             list(int) or list(tuple(int, float)): A list of k nearest items.
@@ -309,17 +737,20 @@ class HnswIndex(object):
         """
         if ef_search == -1:
             ef_search = k * 50
+        if allowed_ids is not None:
+            return self.model.search_by_id_filtered(item_id, k, ef_search, allowed_ids, include_distances)
         if include_distances:
             return self.model.search_by_id_incl_dist(item_id, k, ef_search)
         else:
             return self.model.search_by_id(item_id, k, ef_search)
 
-    def batch_search_by_vectors(self, vs, k, ef_search=-1, num_threads=4, include_distances=False):
+    def batch_search_by_vectors(self, vs, k, ef_search=-1, num_threads=4, include_distances=False,
+                                grouped=False, allowed_ids=None):
         """Returns k nearest items (as vectors) to each query item (batch search with multi-threads).
 
         Note:
-            With OMP_SCHEDULE environment variable, you can set how threads are scheduled.
-            Refer to `GNU libgomp <https://gcc.gnu.org/onlinedocs/libgomp/OMP_005fSCHEDULE.html#OMP_005fSCHEDULE>`_.
+            Batch searches run on worker threads kept alive across calls, and threads that finish their share
+            of the queries early take over queries from the others. It is safe to call from several threads.
 
         Args:
             vs (list(list(float))): Query vectors.
@@ -329,6 +760,11 @@ class HnswIndex(object):
             num_threads (int): Number of threads to use for search.
             include_distances (bool): If you set this argument to True,
                 it will return a list of tuples((item_id, distance)).
+            grouped (bool): If you set this argument to True, queries reaching the same level-0 entry node
+                are searched back to back so that item vectors stay in cache across them.
+                Recommended for large offline batches. Not supported with ``allowed_ids``.
+            allowed_ids (iterable(int)): If given, only these items are returned for every query
+                (see search_by_vector()).
 
         Returns:
             list(list(int) or list(list(tuple(int, float))): A list of list of
@@ -337,17 +773,28 @@ class HnswIndex(object):
         """
         if ef_search == -1:
             ef_search = k * 50
+        if allowed_ids is not None:
+            if grouped:
+                raise ValueError('allowed_ids is not supported with grouped batch search')
+            return self.model.batch_search_by_vectors_filtered(vs, k, ef_search, num_threads, allowed_ids,
+                                                               include_distances)
+        if grouped:
+            if include_distances:
+                return self.model.grouped_batch_search_by_vectors_incl_dist(vs, k, ef_search, num_threads)
+            else:
+                return self.model.grouped_batch_search_by_vectors(vs, k, ef_search, num_threads)
         if include_distances:
             return self.model.batch_search_by_vectors_incl_dist(vs, k, ef_search, num_threads)
         else:
             return self.model.batch_search_by_vectors(vs, k, ef_search, num_threads)
 
-    def batch_search_by_ids(self, item_ids, k, ef_search=-1, num_threads=4, include_distances=False):
+    def batch_search_by_ids(self, item_ids, k, ef_search=-1, num_threads=4, include_distances=False,
+                            allowed_ids=None):
         """Returns k nearest items (as ids) to each query item (batch search with multi-threads).
 
         Note:
-            With OMP_SCHEDULE environment variable, you can set how threads are scheduled.
-            Refer to `GNU libgomp <https://gcc.gnu.org/onlinedocs/libgomp/OMP_005fSCHEDULE.html#OMP_005fSCHEDULE>`_.
+            Batch searches run on worker threads kept alive across calls, and threads that finish their share
+            of the queries early take over queries from the others. It is safe to call from several threads.
 
         Args:
             item_ids (list(int)): Query ids.
@@ -357,6 +804,8 @@ class HnswIndex(object):
             num_threads (int): Number of threads to use for search.
             include_distances (bool): If you set this argument to True,
                 it will return a list of tuples((item_id, distance)).
+            allowed_ids (iterable(int)): If given, only these items are returned for every query
+                (see search_by_vector()).
 
         Returns:
             list(list(int) or list(list(tuple(int, float))): A list of list of
@@ -365,11 +814,71 @@ class HnswIndex(object):
         """
         if ef_search == -1:
             ef_search = k * 50
+        if allowed_ids is not None:
+            return self.model.batch_search_by_ids_filtered(item_ids, k, ef_search, num_threads, allowed_ids,
+                                                           include_distances)
         if include_distances:
             return self.model.batch_search_by_ids_incl_dist(item_ids, k, ef_search, num_threads)
         else:
             return self.model.batch_search_by_ids(item_ids, k, ef_search, num_threads)
 
+    def batch_search_by_vectors_into(self, vs, ids, distances=None, ef_search=-1, num_threads=4):
+        """Same as batch_search_by_vectors(), but reads the queries from and writes the results to caller-owned
+        2-d buffers (e.g. numpy arrays) without building Python lists.
+
+        Args:
+            vs (2-d buffer of float32): Query vectors, one C-contiguous row per query.
+            ids (writable 2-d buffer of int32): One row of ``k`` ids per query, ``k`` being its number of
+                columns. Rows with fewer than ``k`` results found are padded with -1.
+            distances (writable 2-d buffer of float32): Distances of ``ids``, padded with -1, with the same
+                shape as ``ids`` (optional).
+            ef_search (int): ef_search metric (default: 50 * k).
+                If you pass -1 to ef_search, ef_search will be set as the default value.
+            num_threads (int): Number of threads to use for search.
+
+        """
+        if ef_search == -1:
+            ef_search = memoryview(ids).shape[1] * 50
+        self.model.batch_search_by_vectors_into(vs, ef_search, num_threads, ids, distances)
+
+    def batch_search_by_ids_into(self, item_ids, ids, distances=None, ef_search=-1, num_threads=4):
+        """Same as batch_search_by_ids(), but writes the results to caller-owned 2-d buffers
+        (see batch_search_by_vectors_into()).
+
+        Args:
+            item_ids (buffer of int32): Query ids.
+            ids (writable 2-d buffer of int32): One row of ``k`` ids per query, padded with -1.
+            distances (writable 2-d buffer of float32): Distances of ``ids``, padded with -1 (optional).
+            ef_search (int): ef_search metric (default: 50 * k).
+                If you pass -1 to ef_search, ef_search will be set as the default value.
+            num_threads (int): Number of threads to use for search.
+
+        """
+        if ef_search == -1:
+            ef_search = memoryview(ids).shape[1] * 50
+        self.model.batch_search_by_ids_into(item_ids, ef_search, num_threads, ids, distances)
+
+    def get_search_stats(self, last=False):
+        """Returns search counters summed over all searches since the index was built or loaded
+        (or reset_search_stats() was called), or those of the last single search.
+
+        Args:
+            last (bool): If you set this argument to True, returns the counters of the last
+                search_by_vector() / search_by_id() call made on the calling thread.
+
+        Returns:
+            dict: ``num_queries``, ``num_distances`` (distance computations), ``num_visited``,
+            ``num_heap_pushes``, ``ef_used`` (level-0 result slots filled) and ``hops``
+            (nodes expanded per level, from level 0).
+
+        """
+        return self.model.get_search_stats(last)
+
+    def reset_search_stats(self):
+        """Resets the counters returned by get_search_stats().
+        """
+        self.model.reset_search_stats()
+
     def print_degree_dist(self):
         """Prints degree distributions.
         """
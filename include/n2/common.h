@@ -35,11 +35,72 @@ enum class NeighborSelectingPolicy {
     HEURISTIC_SAVE_REMAINS = 2, /**< Experimental. */
 };
 
+/**
+ * Order of the level-0 records of a model. Reordered models renumber their nodes so that graph neighbors
+ * mostly sit in nearby records, and keep a table mapping node ids back to the AddData() order, in which all
+ * ids are given and returned.
+ */
+enum class GraphReordering {
+    NONE = 0, /**< AddData() order (default). */
+    BFS = 1, /**< Breadth-first order of the level-0 graph from the enterpoint. */
+    RCM = 2 /**< Reverse Cuthill-McKee: breadth-first with the neighbors of each node taken by increasing
+    degree, then reversed. */
+};
+
+/**
+ * Storage format of the vectors in level-0 records of a model.
+ */
+enum class VectorStorage {
+    FLOAT32 = 0, /**< Raw float vectors (default). */
+    SQ8 = 1, /**< Per-dimension uint8 scalar quantization. Graph traversal uses asymmetric
+    query-to-code distances, and the final candidates are reranked against the original floats,
+    which are kept in a separate section of the model. */
+    PQ = 2, /**< Product quantization: one byte per subspace (256 centroids each). Graph traversal uses
+    per-query distance lookup tables, and the final candidates are reranked against the original floats. */
+    FP16 = 3, /**< IEEE half precision. Needs no training and no rerank. */
+    BF16 = 4 /**< bfloat16: float's exponent range with an 8-bit mantissa. Needs no training and no rerank. */
+};
+
+/**
+ * Placement of the level-0 links and vectors in a model.
+ */
+enum class ModelLayout {
+    INTERLEAVED = 0, /**< One record per node: its links followed by its vector (default). */
+    SPLIT = 1 /**< A dense array of the links of all nodes, and a separate array of their vectors, each
+    vector starting on a 64-byte boundary. Expanding a node reads only link bytes, and a vector takes no
+    more cache lines than its size requires. */
+};
+
+/**
+ * Pages backing a loaded model. Graph walks over a large model touch a new page on most steps, and huge pages
+ * cover the model with far fewer TLB entries.
+ */
+enum class HugePages {
+    NONE = 0, /**< Regular pages (default). */
+    TRANSPARENT = 1, /**< Transparent huge pages, requested with madvise(MADV_HUGEPAGE); the kernel backs the
+    model with 2 MB pages as far as it can. A mapped file only gets them from file systems that support it. */
+    HUGETLB_2MB = 2, /**< The file is read, even with use_mmap, into anonymous memory from the reserved 2 MB
+    hugetlb pool (vm.nr_hugepages). Regular pages are used if the pool is too small. */
+    HUGETLB_1GB = 3 /**< Same as HUGETLB_2MB with 1 GB pages. */
+};
+
+/**
+ * How a searcher remembers the nodes visited by a query.
+ */
+enum class VisitedSetKind {
+    EPOCH32 = 0, /**< 4 bytes per model node, stamped with a query counter (default). */
+    EPOCH16 = 1, /**< 2 bytes per model node; cleared once every 65535 queries. */
+    EPOCH8 = 2, /**< 1 byte per model node; cleared once every 255 queries. */
+    HASH = 3 /**< Open addressing hash set of the visited node ids. Its size follows the number of nodes
+    a query visits rather than the model size, which suits large models searched with a low ef_search. */
+};
+
 enum class DistanceKind {
     UNKNOWN = -1,
     ANGULAR = 0,
     L2 = 1,
-    DOT = 2
+    DOT = 2,
+    HAMMING = 3 /**< Binary vectors, bit-packed into 64-bit words. */
 };
 
 } // namespace n2
@@ -14,43 +14,162 @@
 
 #pragma once
 
-#include <eigen3/Eigen/Dense>
+#include <limits>
 
+#include "distance_kernels.h"
 #include "hnsw_node.h"
 
 namespace n2 
 {
-class L2Distance {
+class HnswModel;
+
+/**
+ * Interface shared by the functors over raw float vectors. Functors over encoded vectors
+ * (see quantization.h) bind model-wide codec parameters in Bind() and transform the query once
+ * per search in PrepareQuery().
+ */
+class FloatVectorDistance {
+public:
+    using DataType = float;
+    inline void Bind(const HnswModel& model) {}
+    inline const float* PrepareQuery(const float* q, size_t qty) { return q; }
+};
+
+/**
+ * Distance functors are templated on the data dimension. Dim == 0 means the dimension is only known
+ * at runtime (qty); otherwise the functor binds kernels specialized for Dim and ignores qty.
+ */
+template<size_t Dim>
+class BasicL2Distance : public FloatVectorDistance {
+public:
+    BasicL2Distance()
+        : l2_(GetDistanceKernelsForDim(Dim).l2), l2_batch_(GetDistanceKernelsForDim(Dim).l2_batch),
+          l2_bounded_(GetDistanceKernelsForDim(Dim).l2_bounded) {}
+    inline float operator()(const float* v1, const float* v2, size_t qty) const {
+        return l2_(v1, v2, qty);
+    }
+    inline void Batch(const float* q, const float* const* vecs, size_t num, size_t qty, float* out) const {
+        l2_batch_(q, vecs, num, qty, out);
+    }
+    inline float operator()(const HnswNode* n1, const HnswNode* n2, size_t qty) const {
+        return (*this)(n1->GetData(), n2->GetData(), qty);
+    }
+    inline float Bounded(const float* v1, const float* v2, size_t qty, float bound) const {
+        return l2_bounded_(v1, v2, qty, bound);
+    }
+    inline void BatchBounded(const float* q, const float* const* vecs, size_t num, size_t qty, float bound,
+                             float* out) const {
+        for (size_t i = 0; i < num; ++i) {
+            out[i] = l2_bounded_(q, vecs[i], qty, bound);
+        }
+    }
+private:
+    float (*l2_)(const float* v1, const float* v2, size_t qty);
+    void (*l2_batch_)(const float* q, const float* const* vecs, size_t num, size_t qty, float* out);
+    float (*l2_bounded_)(const float* v1, const float* v2, size_t qty, float bound);
+};
+
+template<size_t Dim>
+class BasicAngularDistance : public FloatVectorDistance {
 public:
+    BasicAngularDistance()
+        : dot_(GetDistanceKernelsForDim(Dim).dot), dot_batch_(GetDistanceKernelsForDim(Dim).dot_batch) {}
     inline float operator()(const float* v1, const float* v2, size_t qty) const {
-        Eigen::Map<const Eigen::VectorXf, Eigen::Unaligned> p(v1, qty, 1), q(v2, qty, 1);
-        return (p - q).squaredNorm();
+        return 1.0 - dot_(v1, v2, qty);
+    }
+    inline void Batch(const float* q, const float* const* vecs, size_t num, size_t qty, float* out) const {
+        dot_batch_(q, vecs, num, qty, out);
+        for (size_t i = 0; i < num; ++i) {
+            out[i] = 1.0 - out[i];
+        }
     }
     inline float operator()(const HnswNode* n1, const HnswNode* n2, size_t qty) const {
         return (*this)(n1->GetData(), n2->GetData(), qty);
     }
+private:
+    float (*dot_)(const float* v1, const float* v2, size_t qty);
+    void (*dot_batch_)(const float* q, const float* const* vecs, size_t num, size_t qty, float* out);
 };
 
-class AngularDistance {
+template<size_t Dim>
+class BasicDotDistance : public FloatVectorDistance {
 public:
+    BasicDotDistance()
+        : dot_(GetDistanceKernelsForDim(Dim).dot), dot_batch_(GetDistanceKernelsForDim(Dim).dot_batch) {}
     inline float operator()(const float* v1, const float* v2, size_t qty) const {
-        Eigen::Map<const Eigen::VectorXf, Eigen::Unaligned> p(v1, qty, 1), q(v2, qty, 1);
-        return 1.0 - p.dot(q);
+        return -dot_(v1, v2, qty);
+    }
+    inline void Batch(const float* q, const float* const* vecs, size_t num, size_t qty, float* out) const {
+        dot_batch_(q, vecs, num, qty, out);
+        for (size_t i = 0; i < num; ++i) {
+            out[i] = -out[i];
+        }
     }
     inline float operator()(const HnswNode* n1, const HnswNode* n2, size_t qty) const {
         return (*this)(n1->GetData(), n2->GetData(), qty);
     }
+private:
+    float (*dot_)(const float* v1, const float* v2, size_t qty);
+    void (*dot_batch_)(const float* q, const float* const* vecs, size_t num, size_t qty, float* out);
 };
 
-class DotDistance {
+/**
+ * Hamming distance between binary vectors. Vectors are bit-packed into 64-bit words (see
+ * Utils::PackBinaryVector()) and carried as float arrays, and qty is the number of bits.
+ */
+class HammingDistance : public FloatVectorDistance {
 public:
+    HammingDistance() : hamming_(GetDistanceKernels().hamming) {}
     inline float operator()(const float* v1, const float* v2, size_t qty) const {
-        Eigen::Map<const Eigen::VectorXf, Eigen::Unaligned> p(v1, qty, 1), q(v2, qty, 1);
-        return -p.dot(q);
+        return hamming_((const uint64_t*)v1, (const uint64_t*)v2, (qty + 63) / 64);
+    }
+    inline void Batch(const float* q, const float* const* vecs, size_t num, size_t qty, float* out) const {
+        for (size_t i = 0; i < num; ++i) {
+            out[i] = hamming_((const uint64_t*)q, (const uint64_t*)vecs[i], (qty + 63) / 64);
+        }
     }
     inline float operator()(const HnswNode* n1, const HnswNode* n2, size_t qty) const {
         return (*this)(n1->GetData(), n2->GetData(), qty);
     }
+private:
+    float (*hamming_)(const uint64_t* v1, const uint64_t* v2, size_t num_words);
 };
 
+/**
+ * Distances that may be abandoned early: a result above ``bound`` only means the exact distance is above it
+ * too, so callers must reject such candidates. The L2 functors stop reading the vectors once the bound
+ * is exceeded; every other functor computes the exact distance.
+ */
+template<typename DistFuncType, typename DataType>
+inline float BoundedDistance(const DistFuncType& dist_func, const float* q, const DataType* v, size_t qty,
+                             float bound) {
+    return dist_func(q, v, qty);
+}
+
+template<size_t Dim>
+inline float BoundedDistance(const BasicL2Distance<Dim>& dist_func, const float* q, const float* v, size_t qty,
+                             float bound) {
+    return dist_func.Bounded(q, v, qty, bound);
+}
+
+template<typename DistFuncType, typename DataType>
+inline void BoundedBatchDistance(const DistFuncType& dist_func, const float* q, const DataType* const* vecs,
+                                 size_t num, size_t qty, float bound, float* out) {
+    dist_func.Batch(q, vecs, num, qty, out);
+}
+
+template<size_t Dim>
+inline void BoundedBatchDistance(const BasicL2Distance<Dim>& dist_func, const float* q, const float* const* vecs,
+                                 size_t num, size_t qty, float bound, float* out) {
+    if (bound == std::numeric_limits<float>::max()) {
+        dist_func.Batch(q, vecs, num, qty, out);
+    } else {
+        dist_func.BatchBounded(q, vecs, num, qty, bound, out);
+    }
+}
+
+using L2Distance = BasicL2Distance<0>;
+using AngularDistance = BasicAngularDistance<0>;
+using DotDistance = BasicDotDistance<0>;
+
 } // namespace n2
@@ -0,0 +1,181 @@
+// Copyright 2017 Kakao Corp. <http://www.kakaocorp.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+/**
+ * Calls FUNC(dim) for every dimension that gets compile-time specialized distance kernels,
+ * searchers and builders. Any other dimension falls back to the generic (runtime dimension) path.
+ */
+#define N2_FOR_EACH_SPECIALIZED_DIM(FUNC) \
+    FUNC(64) FUNC(96) FUNC(100) FUNC(128) FUNC(256) FUNC(384) FUNC(512) FUNC(768) FUNC(1024)
+
+namespace n2 {
+
+/**
+ * Instruction set used by the distance kernels.
+ */
+enum class SimdLevel {
+    SCALAR = 0,
+    SSE4 = 1,
+    AVX2 = 2,   /**< AVX2 + FMA + F16C + POPCNT */
+    AVX512 = 3  /**< AVX-512F + POPCNT (VPOPCNTDQ used when present) */
+};
+
+/**
+ * Number of dimensions DistanceKernels::l2_bounded accumulates between two checks of the bound.
+ */
+const size_t kL2BoundedChunk = 64;
+
+/**
+ * Table of distance kernels for one SimdLevel.
+ *
+ * Kernels are compiled for every supported instruction set regardless of the build flags
+ * (N2_BUILD_PORTABLE=1 included), and the best one for the running CPU is picked through CPUID.
+ */
+struct DistanceKernels {
+    SimdLevel level;
+    float (*l2)(const float* v1, const float* v2, size_t qty);
+    float (*dot)(const float* v1, const float* v2, size_t qty);
+    // one-to-many: out[i] = distance(q, vecs[i]) for i < num. Reduces four vectors per pass
+    // while the query stays in registers.
+    void (*l2_batch)(const float* q, const float* const* vecs, size_t num, size_t qty, float* out);
+    void (*dot_batch)(const float* q, const float* const* vecs, size_t num, size_t qty, float* out);
+    // early-abandoning l2: once a partial sum exceeds bound, returns it without reading the rest of the
+    // vectors. The bound is checked every kL2BoundedChunk dimensions.
+    float (*l2_bounded)(const float* v1, const float* v2, size_t qty, float bound);
+    // uint8 scalar-quantized codes (see quantization.h):
+    // sq8_l2 = sum((q[i] - scales[i] * code[i])^2), sq8_dot = sum(q[i] * code[i])
+    float (*sq8_l2)(const float* q, const float* scales, const uint8_t* code, size_t qty);
+    float (*sq8_dot)(const float* q, const uint8_t* code, size_t qty);
+    // product-quantized codes: sum(lut[m * 256 + code[m]]) over num_subspaces one-byte codes
+    float (*pq_adc)(const float* lut, const uint8_t* code, size_t num_subspaces);
+    // half-precision vectors, converted to float on load
+    float (*fp16_l2)(const float* q, const uint16_t* v, size_t qty);
+    float (*fp16_dot)(const float* q, const uint16_t* v, size_t qty);
+    float (*bf16_l2)(const float* q, const uint16_t* v, size_t qty);
+    float (*bf16_dot)(const float* q, const uint16_t* v, size_t qty);
+    // bit-packed binary vectors: number of differing bits over num_words 64-bit words
+    float (*hamming)(const uint64_t* v1, const uint64_t* v2, size_t num_words);
+};
+
+/**
+ * Returns the best SimdLevel supported by the running CPU and OS.
+ */
+SimdLevel DetectSimdLevel();
+
+/**
+ * Returns the kernels of the best SimdLevel for the running CPU (resolved once on first call).
+ */
+const DistanceKernels& GetDistanceKernels();
+
+/**
+ * Returns the kernels of the given SimdLevel, capped to what the running CPU supports.
+ */
+const DistanceKernels& GetDistanceKernels(SimdLevel level);
+
+/**
+ * Same as GetDistanceKernels(), but the returned kernels are fully unrolled for ``dim``
+ * when it is one of N2_FOR_EACH_SPECIALIZED_DIM. The ``qty`` argument is then ignored.
+ */
+const DistanceKernels& GetDistanceKernelsForDim(size_t dim);
+const DistanceKernels& GetDistanceKernelsForDim(size_t dim, SimdLevel level);
+
+const char* GetSimdLevelName(SimdLevel level);
+
+/**
+ * Scalar conversions for IEEE half (FP16) and bfloat16 (BF16). Float to half conversions round to
+ * nearest even.
+ */
+inline float HalfToFloat(uint16_t h) {
+    uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+    uint32_t exp = (h >> 10) & 0x1f;
+    uint32_t mant = h & 0x3ff;
+    uint32_t bits;
+    if (exp == 0) {
+        if (mant == 0) {
+            bits = sign;
+        } else {  // subnormal
+            exp = 127 - 15 + 1;
+            while ((mant & 0x400) == 0) {
+                mant <<= 1;
+                --exp;
+            }
+            bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+        }
+    } else if (exp == 0x1f) {
+        bits = sign | 0x7f800000 | (mant << 13);
+    } else {
+        bits = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+    }
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline uint16_t FloatToHalf(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    int32_t exp = (int32_t)((bits >> 23) & 0xff) - 127 + 15;
+    uint32_t mant = bits & 0x7fffff;
+    if (((bits >> 23) & 0xff) == 0xff) {
+        return sign | 0x7c00 | (mant ? 0x200 : 0);
+    }
+    if (exp >= 0x1f) {
+        return sign | 0x7c00;
+    }
+    if (exp <= 0) {
+        if (exp < -10) {
+            return sign;
+        }
+        mant |= 0x800000;
+        uint32_t shift = 14 - exp;
+        uint32_t half = mant >> shift;
+        uint32_t rem = mant & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rem > halfway || (rem == halfway && (half & 1))) {
+            ++half;
+        }
+        return sign | half;
+    }
+    uint32_t half = sign | (exp << 10) | (mant >> 13);
+    uint32_t rem = mant & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (half & 1))) {
+        ++half;  // a carry into the exponent rounds up to the next binade (or to infinity) as intended
+    }
+    return half;
+}
+
+inline float BFloat16ToFloat(uint16_t h) {
+    uint32_t bits = (uint32_t)h << 16;
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline uint16_t FloatToBFloat16(float f) {
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    if ((bits & 0x7fffffff) > 0x7f800000) {
+        return (bits >> 16) | 0x40;  // quiet NaN
+    }
+    return (bits + 0x7fff + ((bits >> 16) & 1)) >> 16;
+}
+
+} // namespace n2
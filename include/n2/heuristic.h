@@ -53,6 +53,8 @@ public:
      */
     void Select(size_t m, size_t dim, bool select_nn, std::priority_queue<FurtherFirst>& result) override;
 private:
+    static const size_t kBatchSize = 4;
+
     bool save_remains_;
     DistFuncType dist_func_;
 };
@@ -14,9 +14,11 @@
 
 #pragma once
 /** @file */
-#include <omp.h>
-
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <mutex>
+#include <numeric>
 #include <string>
 #include <utility>
 #include <vector>
@@ -24,9 +26,15 @@
 #include "hnsw_build.h"
 #include "hnsw_model.h"
 #include "hnsw_search.h"
+#include "search_filter.h"
+#include "thread_pool.h"
 
 namespace n2 {
 
+/**
+ * HNSW index. Search functions may be called from many threads at once, without locking. Building, loading
+ * and unloading a model must not overlap with any other call.
+ */
 class Hnsw {
 public:
     Hnsw();
@@ -35,7 +43,8 @@ public:
      * @brief Makes an instance of Hnsw Index.
      * @param dim: Dimension of vectors.
      * @param metric: An optional parameter to choose a distance metric.
-     *        ('angular' | 'L2' | 'dot') (default: 'angular').
+     *        ('angular' | 'L2' | 'dot' | 'hamming') (default: 'angular').
+     *        With 'hamming', ``dim`` is the number of bits and vectors are binary: nonzero elements are 1 bits.
      * @return A new Hnsw index.
      */
     Hnsw(int dim,std::string metric="angular");
@@ -55,10 +64,22 @@ public:
      */
     void AddData(const std::vector<float>& data);
 
+    /**
+     * @brief Adds a bit-packed binary vector to a 'hamming' index.
+     * @param data: ``(dim + 7) / 8`` bytes, LSB first (bit i of the vector is ``data[i / 8] >> (i % 8) & 1``).
+     */
+    void AddBinaryData(const std::vector<uint8_t>& data);
+
     /**
      * @brief Set configurations by key/value pairs.
      *
      * To set configurations as default values, pass negative values to configuration parameters.
+     * ``VisitedSet`` (``epoch32`` | ``epoch16`` | ``epoch8`` | ``hash``) selects how searches track visited
+     * nodes (see VisitedSetKind) and may also be set after the model is built or loaded; searches running
+     * at that time finish with the previous kind.
+     * ``InterleavedQueries`` (default: 1) is the number of queries each thread of BatchSearchByVectors()
+     * keeps in flight (see HnswSearch::SearchByVectors()); it applies without ensure_k or a filter, and may
+     * be set at any time.
      */
     void SetConfigs(const std::vector<std::pair<std::string, std::string>>& configs);
     
@@ -103,6 +124,31 @@ public:
      */
     bool LoadModel(const std::string& fname, const bool use_mmap=true);
 
+    /**
+     * @brief Loads an index from disk with load options.
+     * @param fname: An index file name.
+     * @param options: (key, value) pairs:
+     *        "UseMmap": "true" (default) or "false", as ``use_mmap`` above.
+     *        "HugePages": "none" (default), "thp", "2mb" or "1gb" (see HugePages).
+     *        Whether huge pages were obtained can be checked with GetModelHugePageBytes().
+     *        "LoadThreads": threads reading a model that is not mapped, with concurrent pread() calls
+     *        (default: 1). Loads from fast storage need several to reach its bandwidth.
+     *        Page residency, to avoid page faults in the first searches after a load:
+     *        "Populate": "true" maps the file with MAP_POPULATE, reading it in before LoadModel() returns.
+     *        "Advice": "normal" (default), "random", "sequential" or "willneed", madvise()d on the mapped file.
+     *        "Lock": "true" keeps the model in memory with mlock() (bounded by RLIMIT_MEMLOCK).
+     *        "PrefaultThreads": touches every page of the model on this many threads (default: 0, none).
+     *        "WarmUpperLayers": "true" touches the upper layers and the level-0 records of their nodes,
+     *        which every search goes through, before any other prefault.
+     *        All of it is done before LoadModel() returns and searches start.
+     */
+    bool LoadModel(const std::string& fname, const std::vector<std::pair<std::string, std::string>>& options);
+
+    /**
+     * @brief Returns the bytes of the loaded model backed by huge pages, 0 if there are none.
+     */
+    size_t GetModelHugePageBytes() const;
+
     /**
      * @brief Unloads the loaded index file.
      */
@@ -112,7 +158,7 @@ public:
     // Search 
     inline void SearchByVector(const std::vector<float>& qvec, size_t k, size_t ef_search,
                                std::vector<int>& result) {
-        searcher_->SearchByVector(qvec, k, ef_search, ensure_k_, result);
+        AcquireSearcher_()->SearchByVector(qvec, k, ef_search, ensure_k_, result);
     }
 
     /**
@@ -126,10 +172,10 @@ public:
     inline void SearchByVector(const std::vector<float>& qvec, size_t k, 
                                size_t ef_search,
                                std::vector<std::pair<int, float>>& result) {
-        searcher_->SearchByVector(qvec, k, ef_search, ensure_k_, result);
+        AcquireSearcher_()->SearchByVector(qvec, k, ef_search, ensure_k_, result);
     }
     inline void SearchById(int id, size_t k, size_t ef_search, std::vector<int>& result) {
-        searcher_->SearchById(id, k, ef_search, ensure_k_, result);
+        AcquireSearcher_()->SearchById(id, k, ef_search, ensure_k_, result);
     }
 
     /**
@@ -142,16 +188,98 @@ public:
      */
     inline void SearchById(int id, size_t k, size_t ef_search,
         std::vector<std::pair<int, float>>& result) {
-        searcher_->SearchById(id, k, ef_search, ensure_k_, result);
+        AcquireSearcher_()->SearchById(id, k, ef_search, ensure_k_, result);
+    }
+
+    /**
+     * @brief Same as SearchByVector(), reading the query from and writing the results to caller-owned buffers.
+     *        Search buffers are reused across calls, so once warmed up with similar queries it makes no heap
+     *        allocation.
+     * @param qvec: A query vector of ``dim`` floats.
+     * @param k: k value.
+     * @param ef_search: (default: 50 * k). If you pass a negative value to ef_search,
+     *        ef_search will be set as the default value.
+     * @param[out] ids: Up to ``min(k, capacity)`` nearest items.
+     * @param[out] distances: Distances of the items in ``ids`` (pass nullptr to skip).
+     * @param capacity: Number of elements ``ids`` and ``distances`` can hold.
+     * @return Number of items written.
+     */
+    inline size_t SearchByVector(const float* qvec, size_t k, size_t ef_search, int* ids, float* distances,
+                                 size_t capacity) {
+        return AcquireSearcher_()->SearchByVector(qvec, k, ef_search, ensure_k_, ids, distances, capacity);
+    }
+
+    /**
+     * @brief Same as SearchById(), writing the results to caller-owned buffers.
+     * @see SearchByVector(const float*, size_t, size_t, int*, float*, size_t)
+     */
+    inline size_t SearchById(int id, size_t k, size_t ef_search, int* ids, float* distances, size_t capacity) {
+        return AcquireSearcher_()->SearchById(id, k, ef_search, ids, distances, capacity);
+    }
+
+    inline void SearchByVector(const std::vector<float>& qvec, size_t k, size_t ef_search,
+                               const SearchFilter& filter, std::vector<int>& result) {
+        AcquireSearcher_()->SearchByVector(qvec, k, ef_search, filter, result);
+    }
+
+    /**
+     * @brief Same as SearchByVector(), returning only items allowed by ``filter``.
+     *        Filtered-out items are still traversed but never returned, and the search goes on until
+     *        ``ef_search`` allowed items are found, so recall holds up with selective filters.
+     *        An allowlist with at most ``ef_search`` items is searched exhaustively.
+     *        The ensure_k option is ignored.
+     * @param qvec: A query vector.
+     * @param k: k value.
+     * @param ef_search: (default: 50 * k). If you pass a negative value to ef_search,
+     *        ef_search will be set as the default value.
+     * @param filter: An allowlist bitset or a predicate over item ids (see SearchFilter).
+     * @param[out] result: ``k`` nearest allowed items.
+     */
+    inline void SearchByVector(const std::vector<float>& qvec, size_t k, size_t ef_search,
+                               const SearchFilter& filter, std::vector<std::pair<int, float>>& result) {
+        AcquireSearcher_()->SearchByVector(qvec, k, ef_search, filter, result);
+    }
+    inline void SearchById(int id, size_t k, size_t ef_search, const SearchFilter& filter,
+                           std::vector<int>& result) {
+        AcquireSearcher_()->SearchById(id, k, ef_search, filter, result);
+    }
+
+    /**
+     * @brief Same as SearchById(), returning only items allowed by ``filter``.
+     * @see SearchByVector(const std::vector<float>&, size_t, size_t, const SearchFilter&,
+     *      std::vector<std::pair<int, float>>&)
+     */
+    inline void SearchById(int id, size_t k, size_t ef_search, const SearchFilter& filter,
+                           std::vector<std::pair<int, float>>& result) {
+        AcquireSearcher_()->SearchById(id, k, ef_search, filter, result);
+    }
+
+    /**
+     * @brief Search all items within ``radius`` of a query item.
+     *        The search does not stop at ``ef_search`` items: it expands through every item found within
+     *        ``radius``, keeping ``ef_search`` more beyond it as a frontier. The ensure_k option is ignored.
+     * @param qvec: A query vector.
+     * @param radius: Distance threshold, in the unit of search result distances.
+     *        For 'dot', items with inner product >= ``radius`` are returned.
+     * @param max_results: Maximum number of items to return, nearest first (0 for no limit).
+     * @param ef_search: Number of items beyond ``radius`` kept as search frontier (default: 50).
+     *        If you pass a negative value to ef_search, ef_search will be set as the default value.
+     * @param[out] result: Items within ``radius``, nearest first.
+     */
+    inline void SearchByVectorRange(const std::vector<float>& qvec, float radius, size_t max_results,
+                                    size_t ef_search, std::vector<std::pair<int, float>>& result) {
+        AcquireSearcher_()->SearchByVectorRange(qvec, radius, max_results, ef_search, result);
     }
 
     inline void BatchSearchByVectors(const std::vector<std::vector<float>>& qvecs, size_t k, 
                                      size_t ef_search, size_t n_threads, std::vector<std::vector<int>>& results) {
-        BatchSearchByVectors_(qvecs, k, ef_search, n_threads, results);
+        BatchSearchByVectors_(qvecs, k, ef_search, n_threads, nullptr, results);
     }
 
     /**
      * @brief Search k nearest items (as vectors) to each query item (batch search with multi-threads).
+     *        With the ``InterleavedQueries`` config above 1, each thread interleaves that many queries,
+     *        running one while the memory another one reads next is loading (see SetConfigs()).
      * @param qvecs: Query vectors.
      * @param k: k value.
      * @param ef_search: (default: 50 * k). If you pass a negative value to ef_search,
@@ -163,11 +291,52 @@ public:
     inline void BatchSearchByVectors(const std::vector<std::vector<float>>& qvecs, size_t k, 
                                      size_t ef_search, size_t n_threads, 
                                      std::vector<std::vector<std::pair<int, float>>>& results) {
-        BatchSearchByVectors_(qvecs, k, ef_search, n_threads, results);
+        BatchSearchByVectors_(qvecs, k, ef_search, n_threads, nullptr, results);
+    }
+    inline void BatchSearchByVectors(const std::vector<std::vector<float>>& qvecs, size_t k, size_t ef_search,
+                                     size_t n_threads, const SearchFilter& filter,
+                                     std::vector<std::vector<int>>& results) {
+        BatchSearchByVectors_(qvecs, k, ef_search, n_threads, &filter, results);
+    }
+
+    /**
+     * @brief Same as BatchSearchByVectors(), returning only items allowed by ``filter`` for every query.
+     *        A predicate filter is called from all search threads.
+     * @see SearchByVector(const std::vector<float>&, size_t, size_t, const SearchFilter&,
+     *      std::vector<std::pair<int, float>>&)
+     */
+    inline void BatchSearchByVectors(const std::vector<std::vector<float>>& qvecs, size_t k, size_t ef_search,
+                                     size_t n_threads, const SearchFilter& filter,
+                                     std::vector<std::vector<std::pair<int, float>>>& results) {
+        BatchSearchByVectors_(qvecs, k, ef_search, n_threads, &filter, results);
+    }
+    inline void GroupedBatchSearchByVectors(const std::vector<std::vector<float>>& qvecs, size_t k,
+                                            size_t ef_search, size_t n_threads,
+                                            std::vector<std::vector<int>>& results) {
+        GroupedBatchSearchByVectors_(qvecs, k, ef_search, n_threads, results);
+    }
+
+    /**
+     * @brief Same as BatchSearchByVectors(), tuned for large offline batches.
+     *        All queries first go through the upper layers. Queries reaching the same level-0 entry node
+     *        are then searched back to back on one thread, so the item vectors loaded for a query are
+     *        still in cache for its neighbors. The ensure_k option is ignored.
+     * @param qvecs: Query vectors.
+     * @param k: k value.
+     * @param ef_search: (default: 50 * k). If you pass a negative value to ef_search,
+     *        ef_search will be set as the default value.
+     * @param n_threads: Number of threads to use for search.
+     * @param[out] result: vector of ``k`` nearest items for each input query item
+     *             in the order passed to parameter ``qvecs``.
+     */
+    inline void GroupedBatchSearchByVectors(const std::vector<std::vector<float>>& qvecs, size_t k,
+                                            size_t ef_search, size_t n_threads,
+                                            std::vector<std::vector<std::pair<int, float>>>& results) {
+        GroupedBatchSearchByVectors_(qvecs, k, ef_search, n_threads, results);
     }
     inline void BatchSearchByIds(const std::vector<int> ids, size_t k, size_t ef_search, size_t n_threads,
                                  std::vector<std::vector<int>>& results) {
-        BatchSearchByIds_(ids, k, ef_search, n_threads, results);
+        BatchSearchByIds_(ids, k, ef_search, n_threads, nullptr, results);
     }
 
     /**
@@ -182,9 +351,93 @@ public:
      */
     inline void BatchSearchByIds(const std::vector<int> ids, size_t k, size_t ef_search, size_t n_threads,
                                  std::vector<std::vector<std::pair<int, float>>>& results) {
-        BatchSearchByIds_(ids, k, ef_search, n_threads, results);
+        BatchSearchByIds_(ids, k, ef_search, n_threads, nullptr, results);
+    }
+    inline void BatchSearchByIds(const std::vector<int> ids, size_t k, size_t ef_search, size_t n_threads,
+                                 const SearchFilter& filter, std::vector<std::vector<int>>& results) {
+        BatchSearchByIds_(ids, k, ef_search, n_threads, &filter, results);
+    }
+
+    /**
+     * @brief Same as BatchSearchByIds(), returning only items allowed by ``filter`` for every query.
+     *        A predicate filter is called from all search threads.
+     */
+    inline void BatchSearchByIds(const std::vector<int> ids, size_t k, size_t ef_search, size_t n_threads,
+                                 const SearchFilter& filter,
+                                 std::vector<std::vector<std::pair<int, float>>>& results) {
+        BatchSearchByIds_(ids, k, ef_search, n_threads, &filter, results);
+    }
+
+    /**
+     * @brief Same as BatchSearchByVectors(), reading the queries from a flat matrix and writing the results to
+     *        flat caller-owned matrices, so that no per-query vector is allocated.
+     * @param qvecs: ``num_queries x dim`` query vectors, row-major.
+     * @param num_queries: Number of query vectors.
+     * @param k: k value.
+     * @param ef_search: (default: 50 * k). If you pass a negative value to ef_search,
+     *        ef_search will be set as the default value.
+     * @param n_threads: Number of threads to use for search.
+     * @param[out] ids: ``num_queries x k`` matrix, row-major. Row ``i`` receives the nearest items of query
+     *             ``i``, padded with -1 when fewer than ``k`` items are found.
+     * @param[out] distances: ``num_queries x k`` matrix of the distances of ``ids``, padded with -1
+     *             (pass nullptr to skip).
+     */
+    inline void BatchSearchByVectors(const float* qvecs, size_t num_queries, size_t k, size_t ef_search,
+                                     size_t n_threads, int* ids, float* distances) {
+        size_t interleaved_queries = interleaved_queries_;
+        ThreadPool::GetInstance().ParallelFor(num_queries, n_threads, [&](size_t begin, size_t end) {
+            auto s = AcquireSearcher_();
+            if (interleaved_queries > 1 && !ensure_k_) {
+                std::vector<const float*> chunk(end - begin);
+                for (size_t i = begin; i < end; ++i) {
+                    chunk[i - begin] = qvecs + i * data_dim_;
+                }
+                s->SearchByVectors(chunk.data(), chunk.size(), k, ef_search, interleaved_queries, ids + begin * k,
+                                   distances != nullptr ? distances + begin * k : nullptr);
+                return;
+            }
+            for (size_t i = begin; i < end; ++i) {
+                float* row_distances = distances != nullptr ? distances + i * k : nullptr;
+                size_t num = s->SearchByVector(qvecs + i * data_dim_, k, ef_search, ensure_k_, ids + i * k,
+                                               row_distances, k);
+                PadBatchRow_(num, k, ids + i * k, row_distances);
+            }
+        });
+    }
+
+    /**
+     * @brief Same as BatchSearchByIds(), writing the results to flat caller-owned matrices.
+     * @param qids: ``num_queries`` query ids.
+     * @see BatchSearchByVectors(const float*, size_t, size_t, size_t, size_t, int*, float*)
+     */
+    inline void BatchSearchByIds(const int* qids, size_t num_queries, size_t k, size_t ef_search, size_t n_threads,
+                                 int* ids, float* distances) {
+        ThreadPool::GetInstance().ParallelFor(num_queries, n_threads, [&](size_t begin, size_t end) {
+            auto s = AcquireSearcher_();
+            for (size_t i = begin; i < end; ++i) {
+                float* row_distances = distances != nullptr ? distances + i * k : nullptr;
+                size_t num = s->SearchById(qids[i], k, ef_search, ids + i * k, row_distances, k);
+                PadBatchRow_(num, k, ids + i * k, row_distances);
+            }
+        });
     }
 
+    ////////////////////////////////////////////
+    // Search statistics
+    /**
+     * @brief Returns the counters (distance computations, hops per level, ...) of the last search made
+     *        on the calling thread, on this or any other index.
+     */
+    const SearchStats& GetLastSearchStats() const;
+
+    /**
+     * @brief Returns the counters summed over all searches, batch searches included, since the index was
+     *        built or loaded or ResetSearchStats() was called. Searches running meanwhile may be left out.
+     */
+    SearchStats GetSearchStats() const;
+
+    void ResetSearchStats();
+
     ////////////////////////////////////////////
     // Build(Misc)
     /**
@@ -198,53 +451,155 @@ public:
     void PrintConfigs() const;
 
 private:
-    void InitSearcherAndSearcherPool_();
+    struct SearcherReleaser {
+        Hnsw* hnsw;
+        inline void operator()(HnswSearch* searcher) const { hnsw->ReleaseSearcher_(searcher); }
+    };
+    using SearcherLease = std::unique_ptr<HnswSearch, SearcherReleaser>;
+
+    // padded so that threads taking and returning searchers in neighboring slots do not share a cache line
+    struct IdleSearcherSlot {
+        std::atomic<HnswSearch*> searcher{nullptr};
+        char padding[64 - sizeof(std::atomic<HnswSearch*>)];
+    };
+
+    bool LoadModel_(const std::string& fname, const ModelLoadOptions& options);
+    void InitSearchers_();
+    void ClearSearchers_();
+    SearcherLease AcquireSearcher_();
+    std::unique_ptr<HnswSearch> NewSearcher_() const;
+    // takes every idle searcher out of its slot, so that it can be changed or read while searches run
+    std::vector<HnswSearch*> TakeIdleSearchers_() const;
+    void ReturnSearcher_(HnswSearch* searcher) const;
+
+    static inline void PadBatchRow_(size_t num, size_t k, int* ids, float* distances) {
+        std::fill(ids + num, ids + k, -1);
+        if (distances != nullptr) {
+            std::fill(distances + num, distances + k, -1.0f);
+        }
+    }
+    // SearchByVectors() over chunk, appending row i of the results to results[begin + i]
+    static inline void SearchByVectorsInto_(HnswSearch* searcher, const std::vector<const float*>& chunk, size_t k,
+                                            size_t ef_search, size_t num_in_flight, size_t begin,
+                                            std::vector<std::vector<int>>& results) {
+        std::vector<int> ids(chunk.size() * k);
+        searcher->SearchByVectors(chunk.data(), chunk.size(), k, ef_search, num_in_flight, ids.data(), nullptr);
+        for (size_t i = 0; i < chunk.size(); ++i) {
+            for (size_t j = 0; j < k && ids[i * k + j] != -1; ++j) {
+                results[begin + i].push_back(ids[i * k + j]);
+            }
+        }
+    }
+    static inline void SearchByVectorsInto_(HnswSearch* searcher, const std::vector<const float*>& chunk, size_t k,
+                                            size_t ef_search, size_t num_in_flight, size_t begin,
+                                            std::vector<std::vector<std::pair<int, float>>>& results) {
+        std::vector<int> ids(chunk.size() * k);
+        std::vector<float> distances(chunk.size() * k);
+        searcher->SearchByVectors(chunk.data(), chunk.size(), k, ef_search, num_in_flight, ids.data(),
+                                  distances.data());
+        for (size_t i = 0; i < chunk.size(); ++i) {
+            for (size_t j = 0; j < k && ids[i * k + j] != -1; ++j) {
+                results[begin + i].emplace_back(ids[i * k + j], distances[i * k + j]);
+            }
+        }
+    }
+    void ReleaseSearcher_(HnswSearch* searcher);
 
     template<typename ResultType>
     void BatchSearchByVectors_(const std::vector<std::vector<float>>& qvecs, size_t k, 
-                               size_t ef_search, size_t n_threads, ResultType& results) {
+                               size_t ef_search, size_t n_threads, const SearchFilter* filter,
+                               ResultType& results) {
         results.resize(qvecs.size());
-        while (searcher_pool_.size() < n_threads) {
-            searcher_pool_.push_back(HnswSearch::GenerateSearcher(model_, data_dim_, metric_));
-        }
 
-        #pragma omp parallel num_threads(n_threads)
-        {
-            #pragma omp for schedule(runtime)
-            for (size_t i = 0; i < qvecs.size(); ++i) {
-                auto& s = searcher_pool_[omp_get_thread_num()];
-                s->SearchByVector(qvecs[i], k, ef_search, ensure_k_, results[i]);
+        size_t interleaved_queries = interleaved_queries_;
+        ThreadPool::GetInstance().ParallelFor(qvecs.size(), n_threads, [&](size_t begin, size_t end) {
+            auto s = AcquireSearcher_();
+            if (interleaved_queries > 1 && filter == nullptr && !ensure_k_) {
+                std::vector<const float*> chunk(end - begin);
+                for (size_t i = begin; i < end; ++i) {
+                    chunk[i - begin] = qvecs[i].data();
+                }
+                SearchByVectorsInto_(s.get(), chunk, k, ef_search, interleaved_queries, begin, results);
+                return;
             }
-        }
+            for (size_t i = begin; i < end; ++i) {
+                if (filter != nullptr) {
+                    s->SearchByVector(qvecs[i], k, ef_search, *filter, results[i]);
+                } else {
+                    s->SearchByVector(qvecs[i], k, ef_search, ensure_k_, results[i]);
+                }
+            }
+        });
+    }
+
+    template<typename ResultType>
+    void GroupedBatchSearchByVectors_(const std::vector<std::vector<float>>& qvecs, size_t k,
+                                      size_t ef_search, size_t n_threads, ResultType& results) {
+        results.resize(qvecs.size());
+
+        std::vector<std::pair<int, float>> enterpoints(qvecs.size());
+        ThreadPool::GetInstance().ParallelFor(qvecs.size(), n_threads, [&](size_t begin, size_t end) {
+            auto s = AcquireSearcher_();
+            for (size_t i = begin; i < end; ++i) {
+                enterpoints[i] = s->SearchEnterpoint(qvecs[i]);
+            }
+        });
+
+        std::vector<size_t> order(qvecs.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&enterpoints](size_t a, size_t b) {
+            return enterpoints[a].first < enterpoints[b].first;
+        });
+
+        // a task is a group of kQueryGroupChunk queries, so that a chunk of tasks stays on one thread
+        size_t num_groups = (order.size() + kQueryGroupChunk - 1) / kQueryGroupChunk;
+        ThreadPool::GetInstance().ParallelFor(num_groups, n_threads, [&](size_t begin, size_t end) {
+            auto s = AcquireSearcher_();
+            for (size_t j = begin * kQueryGroupChunk; j < std::min(end * kQueryGroupChunk, order.size()); ++j) {
+                size_t i = order[j];
+                s->SearchByVectorFromEnterpoint(qvecs[i], enterpoints[i], k, ef_search, results[i]);
+            }
+        });
     }
 
     template<typename ResultType>
     void BatchSearchByIds_(const std::vector<int> ids, size_t k, size_t ef_search, size_t n_threads,
-                           ResultType& results) {
+                           const SearchFilter* filter, ResultType& results) {
         results.resize(ids.size());
-        while (searcher_pool_.size() < n_threads) {
-            searcher_pool_.push_back(HnswSearch::GenerateSearcher(model_, data_dim_, metric_));
-        }
 
-        #pragma omp parallel num_threads(n_threads)
-        {
-            #pragma omp for schedule(runtime)
-            for (size_t i = 0; i < ids.size(); ++i) {
-                auto& s = searcher_pool_[omp_get_thread_num()];
-                s->SearchById(ids[i], k, ef_search, ensure_k_, results[i]);
+        ThreadPool::GetInstance().ParallelFor(ids.size(), n_threads, [&](size_t begin, size_t end) {
+            auto s = AcquireSearcher_();
+            for (size_t i = begin; i < end; ++i) {
+                if (filter != nullptr) {
+                    s->SearchById(ids[i], k, ef_search, *filter, results[i]);
+                } else {
+                    s->SearchById(ids[i], k, ef_search, ensure_k_, results[i]);
+                }
             }
-        }
+        });
     }
 
 private:
     std::unique_ptr<HnswBuild> builder_;
     std::shared_ptr<const HnswModel> model_;
-    std::shared_ptr<HnswSearch> searcher_;                      // for single-thread search
-    std::vector<std::shared_ptr<HnswSearch>> searcher_pool_;    // for multi-threads batch search
+    // searchers not in use, owned by the index. Every search (and every batch search thread) takes one
+    // for its duration, or makes a new one when all are taken, so searches may run on many threads at once.
+    std::unique_ptr<IdleSearcherSlot[]> idle_searchers_;
+    size_t num_idle_searcher_slots_ = 0;
+    // counters of searchers deleted because every slot was taken when they were returned
+    mutable SearchStats retired_stats_;
+    mutable std::mutex retired_stats_mutex_;
 
     size_t data_dim_;
     DistanceKind metric_;
     bool ensure_k_ = false;
+    std::atomic<VisitedSetKind> visited_set_kind_{VisitedSetKind::EPOCH32};
+    std::atomic<size_t> interleaved_queries_{1};
+
+    // consecutive queries (in entry node order) a thread takes at once in GroupedBatchSearchByVectors()
+    static const size_t kQueryGroupChunk = 64;
+    // idle searcher slots kept at least, and otherwise 4 per hardware thread
+    static const size_t kMinIdleSearcherSlots = 64;
 };
 
 } // namespace n2
@@ -13,6 +13,7 @@
 
 #pragma once
 
+#include <cmath>
 #include <memory>
 #include <queue>
 
@@ -36,6 +37,7 @@ public:
     void operator=(const HnswBuild&) = delete;
 
     void AddData(const std::vector<float>& data);
+    void AddBinaryData(const std::vector<uint8_t>& data);
     void SetConfigs(const std::vector<std::pair<std::string, std::string>>& configs);
     std::shared_ptr<const HnswModel> Build(int m, int max_m0, int ef_construction, int n_threads, float mult, 
                                            NeighborSelectingPolicy neighbor_selecting, 
@@ -52,6 +54,7 @@ protected:
 
     int GetRandomNodeLevel();
     int GetRandomSeedPerThread();
+    void BuildGraphs();
     void BuildGraph(bool reverse);
    
     virtual void InitPolicies() = 0;
@@ -74,6 +77,10 @@ protected:
     NeighborSelectingPolicy neighbor_selecting_ = NeighborSelectingPolicy::HEURISTIC;
     NeighborSelectingPolicy post_neighbor_selecting_ = NeighborSelectingPolicy::HEURISTIC_SAVE_REMAINS;
     GraphPostProcessing post_graph_process_ = GraphPostProcessing::SKIP;
+    VectorStorage vector_storage_ = VectorStorage::FLOAT32;
+    size_t pq_subspaces_ = 0;  // 0: ProductQuantizer::GetDefaultNumSubspaces()
+    GraphReordering reordering_ = GraphReordering::NONE;
+    ModelLayout layout_ = ModelLayout::INTERLEAVED;
     
     int max_level_ = 0;
     HnswNode* enterpoint_ = nullptr;
@@ -14,8 +14,10 @@
 
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "common.h"
 
@@ -24,12 +26,28 @@
 
 namespace n2 {
 
+struct ModelLoadOptions {
+    bool use_mmap = true;
+    HugePages huge_pages = HugePages::NONE;
+    size_t load_threads = 1;         // threads reading a model into memory (not mapped)
+    bool populate = false;           // map with MAP_POPULATE, reading the whole file in
+    int advice = 0;                  // madvise() advice for the mapped file; 0 is MADV_NORMAL
+    bool lock = false;               // mlock() the model
+    size_t prefault_threads = 0;     // touch every page of the model on this many threads; 0 skips it
+    bool warm_upper_layers = false;  // touch the upper layers and the level-0 records of their nodes
+};
+
 class HnswModel {
 public:
     static std::shared_ptr<const HnswModel> GenerateModel(const std::vector<HnswNode*> nodes, int enterpoint_id, 
                                                           int max_m, int max_m0, DistanceKind metric, int max_level,
-                                                          size_t data_dim);
-    static std::shared_ptr<const HnswModel> LoadModelFromFile(const std::string& fname, const bool use_mmap=true);
+                                                          size_t data_dim,
+                                                          VectorStorage vector_storage=VectorStorage::FLOAT32,
+                                                          size_t pq_subspaces=0,
+                                                          GraphReordering reordering=GraphReordering::NONE,
+                                                          ModelLayout layout=ModelLayout::INTERLEAVED);
+    static std::shared_ptr<const HnswModel> LoadModelFromFile(const std::string& fname,
+                                                              const ModelLoadOptions& options=ModelLoadOptions());
     ~HnswModel();
 
     bool SaveModelToFile(const std::string& fname) const;
@@ -42,10 +60,37 @@ public:
     inline int GetMaxLevel() const { return max_level_; }
     inline int GetDataDim() const { return data_dim_; }
     inline DistanceKind GetMetric() const { return metric_; }
-
+    inline VectorStorage GetVectorStorage() const { return vector_storage_; }
+    inline size_t GetPQSubspaces() const { return pq_subspaces_; }
+    inline ModelLayout GetLayout() const { return layout_; }
+    /**
+     * Bytes of the memory holding the model that the kernel currently backs with huge pages (transparent
+     * or hugetlb), as reported by /proc/self/smaps.
+     */
+    size_t GetHugePageBytes() const;
+
+    /**
+     * Node ids of a reordered model (see GraphReordering) differ from the item ids of the API, which follow
+     * the AddData() order. Searchers translate ids at their boundary with these; both are the identity
+     * for models that are not reordered.
+     */
+    inline bool IsReordered() const { return external_ids_ != nullptr; }
+    inline int GetNodeId(int item_id) const { return external_ids_ == nullptr ? item_id : node_ids_[item_id]; }
+    inline int GetItemId(int node_id) const { return external_ids_ == nullptr ? node_id : external_ids_[node_id]; }
+
+    /**
+     * Returns the original float vector of a node. For FLOAT32 storage this is the stored vector itself;
+     * for SQ8 / PQ it points into the raw data section kept for reranking. Half-precision storage keeps
+     * no float copy and returns nullptr (see DecodeData()).
+     */
     inline const float* GetData(int node_id) const { 
-        return (const float*)(model_level0_node_base_offset_ + node_id * memory_per_node_level0_); 
+        return (const float*)(model_raw_data_ + node_id * raw_data_stride_); 
     }
+    /**
+     * Writes the float vector of a node (decoded for half-precision storage, unpacked to 0/1 for hamming)
+     * to out.
+     */
+    void DecodeData(int node_id, float* out) const;
     inline const int* GetHigherLevelFriendsWithSize(int node_id, int level) const {
         int offset = *((int*)(model_level0_ + node_id * memory_per_node_level0_));
         return (const int*)(model_higher_level_ + (offset+level-1) * memory_per_node_higher_level_);
@@ -53,16 +98,38 @@ public:
     inline const int* GetLevel0FriendsWithSize(int node_id) const {
         return (const int*)(model_level0_ + node_id * memory_per_node_level0_ + sizeof(int));
     }
+    /**
+     * Returns the level-0 vector of a node as stored: encoded, bit-packed or augmented as the model needs.
+     */
+    inline const char* GetLevel0Data(int node_id) const {
+        return model_level0_node_base_offset_ + node_id * memory_per_vector_;
+    }
 
 private:
     HnswModel(const std::vector<HnswNode*> nodes, int enterpoint_id, int max_m, int max_m0, DistanceKind metric,
-              int max_level, size_t data_dim);
-    HnswModel(const std::string& fname, const bool use_mmap);
+              int max_level, size_t data_dim, VectorStorage vector_storage, size_t pq_subspaces,
+              GraphReordering reordering, ModelLayout layout);
+    HnswModel(const std::string& fname, const ModelLoadOptions& options);
 
     size_t GetConfigSize();
 
     void SaveConfigToModel();
     void LoadConfigFromModel();
+    void SaveExtendedConfigToModel(char* ptr);
+    void LoadExtendedConfigFromModel(char* ptr);
+    void SetRawDataPointer();
+    void AllocateLoadedModel(HugePages huge_pages);
+    void ReadModelFile(int fd, size_t num_threads);
+    void UnloadModel();
+    void Prefault(size_t num_threads) const;
+    void WarmUpperLayers() const;
+    void EncodeData(const float* vec, char* mem_data) const;
+    /**
+     * Returns the nodes in the order of their new ids.
+     */
+    static std::vector<int> GetReorderedNodes(const std::vector<HnswNode*>& nodes, int enterpoint_id,
+                                              GraphReordering reordering);
+    void SetIdMap();
 
     template <typename T>
     char* SetValueAndIncPtr(char* ptr, const T& val) {
@@ -76,25 +143,53 @@ private:
     }
 
 public:
+    // Models that are not byte-compatible with the original format store this value in the (unused)
+    // m_ slot of the config, followed by a fixed size extended config block.
+    static const uint64_t kExtendedConfigMagic = 0x474643545845324eULL;  // "N2EXTCFG"
+    static const size_t kExtendedConfigSize = 256;
+    // version 2 added the id map of reordered models and version 3 the split layout; models are written
+    // with the lowest version that holds their features
+    static const uint64_t kExtendedConfigVersion = 3;
+    // model buffers and the vector section of split models start on this boundary
+    static const size_t kSectionAlignment = 64;
+
     int enterpoint_id_;
     int num_nodes_;
     int max_level_;
     size_t data_dim_ = 0;
     
     DistanceKind metric_;
+    VectorStorage vector_storage_ = VectorStorage::FLOAT32;
+    size_t pq_subspaces_ = 0;
+    ModelLayout layout_ = ModelLayout::INTERLEAVED;
+    bool extended_config_ = false;
 
     char* model_ = nullptr;
     uint64_t model_byte_size_;
     char* model_higher_level_ = nullptr;
     char* model_level0_ = nullptr;
-    char* model_level0_node_base_offset_ = nullptr;
+    char* model_level0_node_base_offset_ = nullptr;  // vector of node 0
+    char* model_codec_params_ = nullptr;
+    char* model_raw_data_ = nullptr;
 
     uint64_t memory_per_data_;
     uint64_t memory_per_link_level0_;
-    uint64_t memory_per_node_level0_;
+    uint64_t memory_per_node_level0_;  // stride of the level-0 links, which are followed by the vector unless split
+    uint64_t memory_per_vector_;  // stride of the level-0 vectors
     uint64_t memory_per_node_higher_level_;
+    uint64_t memory_per_raw_data_;
+    uint64_t raw_data_stride_ = 0;  // stride of model_raw_data_
+    uint64_t codec_params_offset_ = 0;
+    uint64_t codec_params_size_ = 0;
+    uint64_t raw_data_offset_ = 0;
+    uint64_t id_map_offset_ = 0;  // 0 if the model is not reordered
+    uint64_t vectors_offset_ = 0;  // 0 unless the layout is split
+    const int* external_ids_ = nullptr;  // item id of each node, stored in the model
+    std::vector<int> node_ids_;  // node id of each item
     
     Mmap* model_mmap_ = nullptr;
+    uint64_t model_anonymous_map_size_ = 0;  // > 0 if model_ is an anonymous mapping rather than malloc'ed
+    bool locked_ = false;
 };
 
 } // namespace n2
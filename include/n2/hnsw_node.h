@@ -27,6 +27,7 @@ public:
     explicit HnswNode(int id, const Data* data, int level, size_t max_m, size_t max_m0);
     void CopyHigherLevelLinksToOptIndex(char* mem_offset, uint64_t memory_per_node_higher_level) const;
     void CopyDataAndLevel0LinksToOptIndex(char* mem_offset, int higher_level_offset) const;
+    void CopyLevel0LinksToOptIndex(char* mem_offset, int higher_level_offset) const;
 
     inline int GetId() const { return id_; }
     inline int GetLevel() const { return level_; }
@@ -19,9 +19,37 @@
 
 #include "common.h"
 #include "hnsw_model.h"
+#include "search_filter.h"
 
 namespace n2 {
 
+/**
+ * Search counters, per query (HnswSearch::GetLastQueryStats()) or summed over the queries of a searcher
+ * (HnswSearch::GetStats()). Counting is branch-free, and compiled out when the library is built with
+ * N2_SEARCH_STATS=0, in which case all counters stay zero.
+ */
+struct SearchStats {
+    static const size_t kMaxLevels = 16;
+
+    size_t num_queries = 0;
+    size_t num_distances = 0;      /**< distance computations, including reranking */
+    size_t num_visited = 0;        /**< nodes marked visited over all levels */
+    size_t num_heap_pushes = 0;    /**< pushes to the level-0 candidate heap */
+    size_t ef_used = 0;            /**< level-0 result slots (out of ef_search) filled when the search ended */
+    size_t hops[kMaxLevels] = {};  /**< nodes expanded per level; levels >= kMaxLevels count in the last slot */
+
+    inline void Add(const SearchStats& other) {
+        num_queries += other.num_queries;
+        num_distances += other.num_distances;
+        num_visited += other.num_visited;
+        num_heap_pushes += other.num_heap_pushes;
+        ef_used += other.ef_used;
+        for (size_t i = 0; i < kMaxLevels; ++i) {
+            hops[i] += other.hops[i];
+        }
+    }
+};
+
 class HnswSearch {
 public:
     static std::unique_ptr<HnswSearch> GenerateSearcher(std::shared_ptr<const HnswModel> model, size_t data_dim,
@@ -36,6 +64,78 @@ public:
                             std::vector<int>& result) = 0;
     virtual void SearchById(int id, size_t k, int ef_search, bool ensure_k, 
                             std::vector<std::pair<int, float>>& result) = 0;
+
+    /**
+     * Pointer based SearchByVector() / SearchById() writing into caller-owned buffers. qvec holds data_dim
+     * floats. Up to min(k, capacity) results are written nearest first to ids and distances (either may be
+     * nullptr); returns the number written. Search buffers are reused and only grow to fit the largest
+     * search served so far, so a warmed-up searcher does not allocate.
+     */
+    virtual size_t SearchByVector(const float* qvec, size_t k, int ef_search, bool ensure_k, int* ids,
+                                  float* distances, size_t capacity) = 0;
+    virtual size_t SearchById(int id, size_t k, int ef_search, int* ids, float* distances, size_t capacity) = 0;
+
+    /**
+     * SearchByVector() without ensure_k over num_queries vectors (qvecs[i] holds data_dim floats), running up
+     * to num_in_flight of them at once: a query advances one dependent memory access at a time, and once it
+     * has prefetched what it reads next, the other queries run while that memory loads. Row i of ids and
+     * distances (k entries each; distances may be nullptr) receives the results of qvecs[i], padded with -1.
+     */
+    virtual void SearchByVectors(const float* const* qvecs, size_t num_queries, size_t k, int ef_search,
+                                 size_t num_in_flight, int* ids, float* distances) = 0;
+
+    /**
+     * Filtered SearchByVector() / SearchById(): only items allowed by filter are returned. The search keeps
+     * expanding until ef_search allowed items are found, so ef grows by itself as the filter gets selective.
+     * An allowlist with no more than ef_search items is scanned exhaustively instead. ensure_k is not supported.
+     */
+    virtual void SearchByVector(const std::vector<float>& qvec, size_t k, int ef_search, const SearchFilter& filter,
+                                std::vector<int>& result) = 0;
+    virtual void SearchByVector(const std::vector<float>& qvec, size_t k, int ef_search, const SearchFilter& filter,
+                                std::vector<std::pair<int, float>>& result) = 0;
+    virtual void SearchById(int id, size_t k, int ef_search, const SearchFilter& filter,
+                            std::vector<int>& result) = 0;
+    virtual void SearchById(int id, size_t k, int ef_search, const SearchFilter& filter,
+                            std::vector<std::pair<int, float>>& result) = 0;
+
+    /**
+     * Returns every item within radius of qvec (at most max_results of them, nearest first; 0 for no limit).
+     * Level 0 is expanded through every item found within the radius plus the ef_search nearest ones beyond
+     * it. radius is in the unit of the search results: for DOT, items with inner product >= radius.
+     * Quantized models traverse and cut by approximate distances, then drop items beyond radius by exact
+     * distance.
+     */
+    virtual void SearchByVectorRange(const std::vector<float>& qvec, float radius, size_t max_results,
+                                     int ef_search, std::vector<std::pair<int, float>>& result) = 0;
+
+    /**
+     * Counters of the last query served, and their sum over all queries since the last ResetStats().
+     * The grouped batch search counts the upper layers of a query apart from its level-0 search.
+     */
+    virtual const SearchStats& GetLastQueryStats() const = 0;
+    virtual const SearchStats& GetStats() const = 0;
+    virtual void ResetStats() = 0;
+
+    /**
+     * Selects how visited nodes are tracked (see VisitedSetKind); the default is VisitedSetKind::EPOCH32.
+     */
+    virtual VisitedSetKind GetVisitedSetKind() const = 0;
+    virtual void SetVisitedSetKind(VisitedSetKind kind) = 0;
+
+    /**
+     * Upper-layer part of SearchByVector(): returns the level-0 entry node of qvec and its distance.
+     */
+    virtual std::pair<int, float> SearchEnterpoint(const std::vector<float>& qvec) = 0;
+
+    /**
+     * Level-0 part of SearchByVector(), starting from an entry point returned by SearchEnterpoint().
+     * ensure_k is not supported.
+     */
+    virtual void SearchByVectorFromEnterpoint(const std::vector<float>& qvec, const std::pair<int, float>& enterpoint,
+                                              size_t k, int ef_search, std::vector<int>& result) = 0;
+    virtual void SearchByVectorFromEnterpoint(const std::vector<float>& qvec, const std::pair<int, float>& enterpoint,
+                                              size_t k, int ef_search,
+                                              std::vector<std::pair<int, float>>& result) = 0;
 };
 
 } // namespace n2
@@ -15,20 +15,42 @@
 #pragma once
 
 #include <memory>
+#include <utility>
 #include <vector>
 
 #include "common.h"
 #include "distance.h"
+#include "distance_kernels.h"
 #include "hnsw_model.h"
 #include "hnsw_search.h"
+#include "max_heap.h"
 #include "min_heap.h"
+#include "search_filter.h"
 #include "visited_list.h"
 
 namespace n2 {
 
+/**
+ * Filter of unfiltered searches; lets SearchByIdV2_() compile without any filter check.
+ */
+struct NoSearchFilter {
+    inline bool IsAllowed(int id) const { return true; }
+};
+
+/**
+ * Checks node ids against a SearchFilter over item ids (see HnswModel::GetItemId()).
+ */
+struct NodeIdSearchFilter {
+    const SearchFilter& filter;
+    const HnswModel& model;
+    inline bool IsAllowed(int id) const { return filter.IsAllowed(model.GetItemId(id)); }
+};
+
 template<typename DistFuncType>
 class HnswSearchImpl : public HnswSearch {
 public:
+    using DataType = typename DistFuncType::DataType;
+
     HnswSearchImpl(std::shared_ptr<const HnswModel> model, size_t data_dim, DistanceKind metric);
 
     void SearchByVector(const std::vector<float>& qvec, size_t k, int ef_search, bool ensure_k,
@@ -39,12 +61,116 @@ public:
                     std::vector<int>& result) override;
     void SearchById(int id, size_t k, int ef_search, bool ensure_k,
                     std::vector<std::pair<int, float>>& result) override;
+    size_t SearchByVector(const float* qvec, size_t k, int ef_search, bool ensure_k, int* ids, float* distances,
+                          size_t capacity) override;
+    size_t SearchById(int id, size_t k, int ef_search, int* ids, float* distances, size_t capacity) override;
+    void SearchByVectors(const float* const* qvecs, size_t num_queries, size_t k, int ef_search,
+                         size_t num_in_flight, int* ids, float* distances) override;
+    void SearchByVector(const std::vector<float>& qvec, size_t k, int ef_search, const SearchFilter& filter,
+                        std::vector<int>& result) override;
+    void SearchByVector(const std::vector<float>& qvec, size_t k, int ef_search, const SearchFilter& filter,
+                        std::vector<std::pair<int, float>>& result) override;
+    void SearchById(int id, size_t k, int ef_search, const SearchFilter& filter, std::vector<int>& result) override;
+    void SearchById(int id, size_t k, int ef_search, const SearchFilter& filter,
+                    std::vector<std::pair<int, float>>& result) override;
+    void SearchByVectorRange(const std::vector<float>& qvec, float radius, size_t max_results, int ef_search,
+                             std::vector<std::pair<int, float>>& result) override;
+
+    const SearchStats& GetLastQueryStats() const override { return query_stats_; }
+    const SearchStats& GetStats() const override { return stats_; }
+    void ResetStats() override { stats_ = SearchStats(); }
+
+    VisitedSetKind GetVisitedSetKind() const override { return visited_set_.GetKind(); }
+    void SetVisitedSetKind(VisitedSetKind kind) override;
+
+    std::pair<int, float> SearchEnterpoint(const std::vector<float>& qvec) override;
+    void SearchByVectorFromEnterpoint(const std::vector<float>& qvec, const std::pair<int, float>& enterpoint,
+                                      size_t k, int ef_search, std::vector<int>& result) override;
+    void SearchByVectorFromEnterpoint(const std::vector<float>& qvec, const std::pair<int, float>& enterpoint,
+                                      size_t k, int ef_search, std::vector<std::pair<int, float>>& result) override;
 
 protected:
+    /**
+     * A query of SearchByVectors() in flight, with search state of its own. Each step ends by prefetching
+     * what the next one reads: NODE reads the level-0 record holding the upper-level link offset of cur_node_id,
+     * FRIENDS the links, GATHER the visited marks of the friends and DISTANCES their vectors.
+     */
+    struct InterleavedQuery {
+        enum class Step { NODE, FRIENDS, GATHER, DISTANCES };
+
+        InterleavedQuery(const DistFuncType& search_dist_func, size_t num_nodes, VisitedSetKind visited_set_kind,
+                         size_t max_degree, size_t query_buf_size)
+            : dist_func(search_dist_func), visited_set(num_nodes, visited_set_kind), batch_ids(max_degree),
+              batch_vecs(max_degree), batch_dists(max_degree), normalized_vec(query_buf_size) {}
+
+        DistFuncType dist_func;  // holds the query prepared by PrepareQuery()
+        VisitedSet visited_set;
+        std::vector<int> batch_ids;
+        std::vector<const DataType*> batch_vecs;
+        std::vector<float> batch_dists;
+        std::vector<float> normalized_vec;
+        IdDistancePairMinHeap candidates;
+        IdDistancePairMinHeap visited_nodes;
+        DistanceMaxHeap found_distances;
+        SearchStats stats;
+
+        size_t index = 0;  // position of the query in the batch
+        const float* qraw = nullptr;
+        const float* rerank_query = nullptr;
+        Step step = Step::NODE;
+        int level = 0;
+        int cur_node_id = 0;
+        float cur_dist = 0;
+        bool changed = false;
+        const int* friends_with_size = nullptr;
+        size_t num_gathered = 0;
+    };
+
+    inline void BeginQuery_() {
+        query_stats_ = SearchStats();
+    }
+    inline void EndQuery_(size_t num_queries = 1) {
+        query_stats_.num_queries = num_queries;
+        stats_.Add(query_stats_);
+    }
+
+    template<typename ResultType>
+    void SearchByVector_(const float* qvec, size_t k, int ef_search, bool ensure_k, ResultType& result);
     template<typename ResultType>
-    void SearchByVector_(const std::vector<float>& qvec, size_t k, int ef_search, bool ensure_k,
+    void SearchByVector_(const float* qvec, size_t k, int ef_search, const SearchFilter& filter,
                          ResultType& result);
 
+    /**
+     * Normalizes (angular) or bit-packs (hamming) the data_dim floats of qvec, then applies
+     * dist_func_.PrepareQuery().
+     */
+    inline const float* PrepareQuery_(const float* qvec) {
+        return PrepareQuery_(qvec, dist_func_, &normalized_vec_[0], rerank_query_);
+    }
+    const float* PrepareQuery_(const float* qvec, DistFuncType& dist_func, float* normalized_vec,
+                               const float*& rerank_query) const;
+
+    /**
+     * Steps of SearchByVectors(). StartInterleavedQuery_() and StepInterleavedQuery_() return false once the
+     * query needs no further step, FinishInterleavedQuery_() then writes its results to the rows of ids and
+     * distances.
+     */
+    bool StartInterleavedQuery_(InterleavedQuery& q, size_t index, const float* qvec, size_t ef_search);
+    inline bool StepInterleavedQuery_(InterleavedQuery& q, size_t ef_search);
+    void StartInterleavedLevel0_(InterleavedQuery& q, size_t ef_search);
+    inline bool ExpandNextCandidate_(InterleavedQuery& q, size_t ef_search);
+    void FinishInterleavedQuery_(InterleavedQuery& q, size_t k, int* ids, float* distances);
+
+    /**
+     * Copies up to capacity entries of result_buf_ to ids / distances; returns the number copied.
+     */
+    size_t CopyResultBuf_(int* ids, float* distances, size_t capacity) const;
+
+    /**
+     * Greedy search from the model enterpoint down to level 1; returns the level-0 entry node.
+     */
+    int SearchUpperLayers_(const float* qraw, bool ensure_k, float& cur_dist);
+
     inline void CallSearchById_(int cur_node_id, float cur_dist, const float* qraw, size_t k, size_t ef_search,
                                 bool ensure_k, std::vector<int>& result) {
         if (ensure_k) {
@@ -84,9 +210,66 @@ protected:
     void SearchByIdV1_(int cur_node_id, float cur_dist, const float* qraw, size_t k, size_t ef_search,
                        bool ensure_k, ResultType& result);
 
-    template<typename ResultType>
+    /**
+     * With a SearchFilter, candidates are still expanded through filtered-out nodes, but only allowed nodes
+     * count toward ef_search and enter the results.
+     */
+    template<typename ResultType, typename FilterType = NoSearchFilter>
     void SearchByIdV2_(int cur_node_id, float cur_dist, const float* qraw, size_t k, size_t ef_search,
-                       bool ensure_k, ResultType& result);
+                       bool ensure_k, ResultType& result, const FilterType& filter = FilterType());
+
+    template<typename ResultType>
+    void SearchById_(int cur_node_id, float cur_dist, const float* qraw, size_t k, size_t ef_search,
+                     const SearchFilter& filter, ResultType& result);
+
+    /**
+     * Exact search over the items of an allowlist filter, used when it holds no more than ef_search items.
+     */
+    template<typename ResultType>
+    void SearchAllowlist_(const float* qraw, size_t k, const SearchFilter& filter, ResultType& result);
+
+    /**
+     * Level-0 part of SearchByVectorRange(). result is kept as a max heap of at most max_results items.
+     */
+    void SearchRange_(int cur_node_id, float cur_dist, const float* qraw, float radius, size_t max_results,
+                      size_t ef_search, std::vector<std::pair<int, float>>& result);
+
+    /**
+     * Marks unvisited friends as visited and computes their distances to qraw in one batched call.
+     * Results are left in batch_ids_ / batch_dists_; returns the number of friends gathered.
+     * Distances above bound may be abandoned early (see BoundedDistance()), so callers must reject them.
+     */
+    inline size_t ComputeUnvisitedFriendDistances_(const int* friends_with_size, const float* qraw, float bound);
+
+    inline const DataType* GetLevel0Data_(int node_id) const {
+        return (const DataType*)(model_level0_node_base_offset_ + node_id * memory_per_vector_);
+    }
+
+    /**
+     * Float vector of a stored node; half-precision records are decoded into normalized_vec_.
+     */
+    inline const float* GetDataOf_(int id) {
+        const float* vec = model_->GetData(id);
+        if (vec == nullptr) {
+            model_->DecodeData(id, &normalized_vec_[0]);
+            vec = &normalized_vec_[0];
+        }
+        return vec;
+    }
+
+    /**
+     * Searches work on node ids; results are turned into item ids from position begin on as they are made.
+     */
+    inline void ToItemIds_(std::vector<int>& result, size_t begin) const {
+        if (model_->IsReordered()) {
+            for (size_t i = begin; i < result.size(); ++i) result[i] = model_->GetItemId(result[i]);
+        }
+    }
+    inline void ToItemIds_(std::vector<std::pair<int, float>>& result, size_t begin) const {
+        if (model_->IsReordered()) {
+            for (size_t i = begin; i < result.size(); ++i) result[i].first = model_->GetItemId(result[i].first);
+        }
+    }
 
     bool PrepareEnsureKSearch(int cur_node_id, std::vector<int>& result, IdDistancePairMinHeap& visited_nodes);
     bool PrepareEnsureKSearch(int cur_node_id, std::vector<std::pair<int, float>>& result,
@@ -97,18 +280,56 @@ protected:
     void MakeSearchResult(size_t k, IdDistancePairMinHeap& candidates, IdDistancePairMinHeap& visited_nodes,
                           std::vector<std::pair<int, float>>& result);
 
+    /**
+     * For quantized storage: takes up to k * kRerankMultiplier nearest candidates by approximate distance,
+     * recomputes their exact distances against the original floats and keeps the k nearest in rerank_buf_.
+     */
+    void RerankSearchResult_(size_t k, IdDistancePairMinHeap& candidates, IdDistancePairMinHeap& visited_nodes);
+
+    /**
+     * Exact distance between rerank_query_ and the original floats of a node.
+     */
+    inline float ExactDistance_(int id) const {
+        const float* vec = model_->GetData(id);
+        if (metric_ == DistanceKind::L2) {
+            return exact_kernels_.l2(rerank_query_, vec, data_dim_);
+        } else if (metric_ == DistanceKind::ANGULAR) {
+            return 1.0 - exact_kernels_.dot(rerank_query_, vec, data_dim_);
+        } else {
+            return -exact_kernels_.dot(rerank_query_, vec, data_dim_);
+        }
+    }
+
 protected:
     std::shared_ptr<const HnswModel> model_;
-    std::unique_ptr<VisitedList> visited_list_;
+    VisitedSet visited_set_;
 
     size_t data_dim_;
     DistanceKind metric_;
 
     DistFuncType dist_func_;
+
+    static const size_t kRerankMultiplier = 4;
+    std::vector<std::unique_ptr<InterleavedQuery>> interleaved_queries_;
+    bool needs_rerank_ = false;
+    const float* rerank_query_ = nullptr;
+    const DistanceKernels& exact_kernels_;
     
     // preallocated buffer
     std::vector<float> normalized_vec_;
     std::vector<std::pair<int, float>> ensure_k_path_;
+    std::vector<int> batch_ids_;
+    std::vector<const DataType*> batch_vecs_;
+    std::vector<float> batch_dists_;
+    std::vector<std::pair<int, float>> rerank_buf_;
+    std::vector<std::pair<int, float>> result_buf_;  // results of the pointer based searches
+    // search heaps are cleared, not freed, between queries so they stop allocating once grown to ef_search
+    IdDistancePairMinHeap candidates_;
+    IdDistancePairMinHeap visited_nodes_;
+    DistanceMaxHeap found_distances_;
+
+    SearchStats query_stats_;
+    SearchStats stats_;
 
 
     // raw pointer of model
@@ -116,6 +337,7 @@ protected:
     char* model_level0_ = nullptr;
     char* model_level0_node_base_offset_ = nullptr;
     uint64_t memory_per_node_level0_;
+    uint64_t memory_per_vector_;
     uint64_t memory_per_node_higher_level_;
 };
 
@@ -20,9 +20,12 @@ namespace n2 {
 
 class Mmap {
 public:
-    explicit Mmap(char const* fname);
+    /**
+     * extra_flags are added to the mmap() flags, e.g. MAP_POPULATE.
+     */
+    explicit Mmap(char const* fname, int extra_flags=0);
     ~Mmap();
-    void Map(char const* fname);
+    void Map(char const* fname, int extra_flags=0);
     void UnMap();
     size_t QueryFileSize() const;
     
@@ -0,0 +1,294 @@
+// Copyright 2017 Kakao Corp. <http://www.kakaocorp.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "distance_kernels.h"
+#include "hnsw_model.h"
+
+namespace n2 {
+
+/**
+ * Per-dimension uint8 scalar quantizer: vec[i] ~= mins[i] + scales[i] * code[i].
+ *
+ * Parameters are laid out as [mins(dim) | scales(dim)].
+ */
+class ScalarQuantizer {
+public:
+    static size_t GetParamsSize(size_t dim) { return sizeof(float) * 2 * dim; }
+    static void Train(const std::vector<const float*>& vecs, size_t dim, float* params);
+    static void Encode(const float* vec, const float* params, size_t dim, uint8_t* code);
+};
+
+/**
+ * Product quantizer with 256 centroids (one byte) per subspace. The dimension is split into
+ * num_subspaces contiguous subspaces of dim / num_subspaces each.
+ *
+ * Parameters are the codebooks laid out as [subspace][centroid][sub_dim].
+ */
+class ProductQuantizer {
+public:
+    static const size_t kNumCentroids = 256;
+
+    static size_t GetParamsSize(size_t dim) { return sizeof(float) * kNumCentroids * dim; }
+    static size_t GetDefaultNumSubspaces(size_t dim) { return dim % 4 == 0 ? dim / 4 : dim; }
+    static void Train(const std::vector<const float*>& vecs, size_t dim, size_t num_subspaces, float* params);
+    static void Encode(const float* vec, const float* params, size_t dim, size_t num_subspaces, uint8_t* code);
+};
+
+/**
+ * Asymmetric L2 distance between a float query and SQ8 codes.
+ * The query is shifted by mins once per search, so each code costs one fnmadd + one fmadd per dimension.
+ */
+class SQ8L2Distance {
+public:
+    using DataType = uint8_t;
+
+    SQ8L2Distance() : sq8_l2_(GetDistanceKernels().sq8_l2) {}
+    inline void Bind(const HnswModel& model) {
+        mins_ = (const float*)model.model_codec_params_;
+        scales_ = mins_ + model.GetDataDim();
+        query_.resize(model.GetDataDim());
+    }
+    inline const float* PrepareQuery(const float* q, size_t qty) {
+        for (size_t i = 0; i < qty; ++i) {
+            query_[i] = q[i] - mins_[i];
+        }
+        return &query_[0];
+    }
+    inline float operator()(const float* q, const uint8_t* code, size_t qty) const {
+        return sq8_l2_(q, scales_, code, qty);
+    }
+    inline void Batch(const float* q, const uint8_t* const* codes, size_t num, size_t qty, float* out) const {
+        for (size_t i = 0; i < num; ++i) {
+            out[i] = sq8_l2_(q, scales_, codes[i], qty);
+        }
+    }
+
+private:
+    float (*sq8_l2_)(const float* q, const float* scales, const uint8_t* code, size_t qty);
+    const float* mins_ = nullptr;
+    const float* scales_ = nullptr;
+    std::vector<float> query_;
+};
+
+/**
+ * Asymmetric inner product between a float query and SQ8 codes:
+ * q . (mins + scales * code) = q . mins + (q * scales) . code, where both terms of the right-hand side
+ * except the code are computed once per search.
+ */
+class SQ8InnerProduct {
+public:
+    using DataType = uint8_t;
+
+    SQ8InnerProduct() : sq8_dot_(GetDistanceKernels().sq8_dot) {}
+    inline void Bind(const HnswModel& model) {
+        mins_ = (const float*)model.model_codec_params_;
+        scales_ = mins_ + model.GetDataDim();
+        query_.resize(model.GetDataDim());
+    }
+    inline const float* PrepareQuery(const float* q, size_t qty) {
+        bias_ = 0;
+        for (size_t i = 0; i < qty; ++i) {
+            bias_ += q[i] * mins_[i];
+            query_[i] = q[i] * scales_[i];
+        }
+        return &query_[0];
+    }
+
+protected:
+    inline float InnerProduct(const float* q, const uint8_t* code, size_t qty) const {
+        return bias_ + sq8_dot_(q, code, qty);
+    }
+
+private:
+    float (*sq8_dot_)(const float* q, const uint8_t* code, size_t qty);
+    const float* mins_ = nullptr;
+    const float* scales_ = nullptr;
+    float bias_ = 0;
+    std::vector<float> query_;
+};
+
+class SQ8AngularDistance : public SQ8InnerProduct {
+public:
+    inline float operator()(const float* q, const uint8_t* code, size_t qty) const {
+        return 1.0 - InnerProduct(q, code, qty);
+    }
+    inline void Batch(const float* q, const uint8_t* const* codes, size_t num, size_t qty, float* out) const {
+        for (size_t i = 0; i < num; ++i) {
+            out[i] = 1.0 - InnerProduct(q, codes[i], qty);
+        }
+    }
+};
+
+class SQ8DotDistance : public SQ8InnerProduct {
+public:
+    inline float operator()(const float* q, const uint8_t* code, size_t qty) const {
+        return -InnerProduct(q, code, qty);
+    }
+    inline void Batch(const float* q, const uint8_t* const* codes, size_t num, size_t qty, float* out) const {
+        for (size_t i = 0; i < num; ++i) {
+            out[i] = -InnerProduct(q, codes[i], qty);
+        }
+    }
+};
+
+/**
+ * Asymmetric distance computation (ADC) over PQ codes. PrepareQuery() fills a [subspace][centroid]
+ * lookup table once per search and returns it in place of the query, so each code costs
+ * num_subspaces table lookups.
+ */
+class PQDistance {
+public:
+    using DataType = uint8_t;
+
+    PQDistance() : pq_adc_(GetDistanceKernels().pq_adc) {}
+    inline void Bind(const HnswModel& model) {
+        codebooks_ = (const float*)model.model_codec_params_;
+        num_subspaces_ = model.GetPQSubspaces();
+        sub_dim_ = model.GetDataDim() / num_subspaces_;
+        lut_.resize(num_subspaces_ * ProductQuantizer::kNumCentroids);
+    }
+
+protected:
+    template<typename SubDistance>
+    inline const float* FillLookupTable(const float* q, SubDistance sub_distance) {
+        const float* centroid = codebooks_;
+        float* lut = &lut_[0];
+        for (size_t m = 0; m < num_subspaces_; ++m, q += sub_dim_) {
+            for (size_t c = 0; c < ProductQuantizer::kNumCentroids; ++c, centroid += sub_dim_) {
+                *lut++ = sub_distance(q, centroid, sub_dim_);
+            }
+        }
+        return &lut_[0];
+    }
+    inline float Lookup(const float* lut, const uint8_t* code) const {
+        return pq_adc_(lut, code, num_subspaces_);
+    }
+
+private:
+    float (*pq_adc_)(const float* lut, const uint8_t* code, size_t num_subspaces);
+    const float* codebooks_ = nullptr;
+    size_t num_subspaces_ = 0;
+    size_t sub_dim_ = 0;
+    std::vector<float> lut_;
+};
+
+class PQL2Distance : public PQDistance {
+public:
+    inline const float* PrepareQuery(const float* q, size_t qty) {
+        return FillLookupTable(q, GetDistanceKernels().l2);
+    }
+    inline float operator()(const float* lut, const uint8_t* code, size_t qty) const {
+        return Lookup(lut, code);
+    }
+    inline void Batch(const float* lut, const uint8_t* const* codes, size_t num, size_t qty, float* out) const {
+        for (size_t i = 0; i < num; ++i) {
+            out[i] = Lookup(lut, codes[i]);
+        }
+    }
+};
+
+class PQAngularDistance : public PQDistance {
+public:
+    inline const float* PrepareQuery(const float* q, size_t qty) {
+        return FillLookupTable(q, GetDistanceKernels().dot);
+    }
+    inline float operator()(const float* lut, const uint8_t* code, size_t qty) const {
+        return 1.0 - Lookup(lut, code);
+    }
+    inline void Batch(const float* lut, const uint8_t* const* codes, size_t num, size_t qty, float* out) const {
+        for (size_t i = 0; i < num; ++i) {
+            out[i] = 1.0 - Lookup(lut, codes[i]);
+        }
+    }
+};
+
+class PQDotDistance : public PQDistance {
+public:
+    inline const float* PrepareQuery(const float* q, size_t qty) {
+        return FillLookupTable(q, GetDistanceKernels().dot);
+    }
+    inline float operator()(const float* lut, const uint8_t* code, size_t qty) const {
+        return -Lookup(lut, code);
+    }
+    inline void Batch(const float* lut, const uint8_t* const* codes, size_t num, size_t qty, float* out) const {
+        for (size_t i = 0; i < num; ++i) {
+            out[i] = -Lookup(lut, codes[i]);
+        }
+    }
+};
+
+/**
+ * Distances between a float query and half-precision (FP16 / BF16) vectors, converted on load.
+ */
+template<VectorStorage Storage>
+class HalfVectorDistance {
+public:
+    using DataType = uint16_t;
+
+    HalfVectorDistance()
+        : l2_(Storage == VectorStorage::BF16 ? GetDistanceKernels().bf16_l2 : GetDistanceKernels().fp16_l2),
+          dot_(Storage == VectorStorage::BF16 ? GetDistanceKernels().bf16_dot : GetDistanceKernels().fp16_dot) {}
+    inline void Bind(const HnswModel& model) {}
+    inline const float* PrepareQuery(const float* q, size_t qty) { return q; }
+
+protected:
+    float (*l2_)(const float* q, const uint16_t* v, size_t qty);
+    float (*dot_)(const float* q, const uint16_t* v, size_t qty);
+};
+
+template<VectorStorage Storage>
+class HalfL2Distance : public HalfVectorDistance<Storage> {
+public:
+    inline float operator()(const float* q, const uint16_t* v, size_t qty) const {
+        return this->l2_(q, v, qty);
+    }
+    inline void Batch(const float* q, const uint16_t* const* vecs, size_t num, size_t qty, float* out) const {
+        for (size_t i = 0; i < num; ++i) {
+            out[i] = this->l2_(q, vecs[i], qty);
+        }
+    }
+};
+
+template<VectorStorage Storage>
+class HalfAngularDistance : public HalfVectorDistance<Storage> {
+public:
+    inline float operator()(const float* q, const uint16_t* v, size_t qty) const {
+        return 1.0 - this->dot_(q, v, qty);
+    }
+    inline void Batch(const float* q, const uint16_t* const* vecs, size_t num, size_t qty, float* out) const {
+        for (size_t i = 0; i < num; ++i) {
+            out[i] = 1.0 - this->dot_(q, vecs[i], qty);
+        }
+    }
+};
+
+template<VectorStorage Storage>
+class HalfDotDistance : public HalfVectorDistance<Storage> {
+public:
+    inline float operator()(const float* q, const uint16_t* v, size_t qty) const {
+        return -this->dot_(q, v, qty);
+    }
+    inline void Batch(const float* q, const uint16_t* const* vecs, size_t num, size_t qty, float* out) const {
+        for (size_t i = 0; i < num; ++i) {
+            out[i] = -this->dot_(q, vecs[i], qty);
+        }
+    }
+};
+
+} // namespace n2
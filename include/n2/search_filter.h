@@ -0,0 +1,75 @@
+// Copyright 2017 Kakao Corp. <http://www.kakaocorp.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+/** @file */
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+namespace n2 {
+
+/**
+ * Restricts search results to a subset of the items, given either as an allowlist bitset or as a predicate.
+ *
+ * Filtered-out items are still traversed to keep the graph connected; they only never enter the results.
+ * The filter is not copied into the searcher, so the bitset or predicate must outlive the search call.
+ */
+class SearchFilter {
+public:
+    /**
+     * @param allowlist: Bitset over item ids: item ``id`` is allowed when bit ``id % 64`` of
+     *        ``allowlist[id / 64]`` is set. Items with ``id >= num_bits`` are not allowed.
+     * @param num_bits: Number of valid bits in ``allowlist``.
+     */
+    SearchFilter(const uint64_t* allowlist, size_t num_bits) : allowlist_(allowlist), num_bits_(num_bits) {
+        for (size_t i = 0; i < num_bits / 64; ++i) {
+            num_allowed_ += __builtin_popcountll(allowlist[i]);
+        }
+        if (num_bits % 64 != 0) {
+            num_allowed_ += __builtin_popcountll(allowlist[num_bits / 64] & ((1ULL << (num_bits % 64)) - 1));
+        }
+    }
+
+    /**
+     * @param predicate: Returns whether an item id is allowed. Batch searches call it from several threads.
+     */
+    explicit SearchFilter(std::function<bool(int)> predicate) : predicate_(std::move(predicate)) {}
+
+    inline bool IsAllowed(int id) const {
+        if (allowlist_ != nullptr) {
+            return (size_t)id < num_bits_ && ((allowlist_[id >> 6] >> (id & 63)) & 1);
+        }
+        return predicate_(id);
+    }
+
+    /**
+     * Allowlist bitset, or nullptr for a predicate filter.
+     */
+    inline const uint64_t* GetAllowlist() const { return allowlist_; }
+    inline size_t GetNumBits() const { return num_bits_; }
+    /**
+     * Number of allowed items of an allowlist filter (0 for a predicate filter).
+     */
+    inline size_t GetNumAllowed() const { return num_allowed_; }
+
+private:
+    const uint64_t* allowlist_ = nullptr;
+    size_t num_bits_ = 0;
+    size_t num_allowed_ = 0;
+    std::function<bool(int)> predicate_;
+};
+
+} // namespace n2
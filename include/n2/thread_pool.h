@@ -0,0 +1,98 @@
+// Copyright 2017 Kakao Corp. <http://www.kakaocorp.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace n2 {
+
+/**
+ * Worker threads kept alive across calls and shared by the batch searches of all indexes.
+ *
+ * ParallelFor() splits its tasks into one contiguous range per participating thread, the calling thread
+ * included. A thread takes chunks from the front of its own range and, once it runs dry, steals chunks from
+ * the other ranges, so uneven queries balance out without a central queue. Any number of threads may call
+ * ParallelFor() at once; their jobs share the workers.
+ */
+class ThreadPool {
+public:
+    static ThreadPool& GetInstance();
+
+    ThreadPool() = default;
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ~ThreadPool();
+
+    /**
+     * Calls func(begin, end) over chunks covering [0, num_tasks) on up to num_threads threads, and returns
+     * once all calls are done. Workers are added as needed to reach num_threads - 1. If func throws, the
+     * remaining chunks still run and the first exception is rethrown.
+     */
+    void ParallelFor(size_t num_tasks, size_t num_threads, const std::function<void(size_t, size_t)>& func);
+
+    size_t GetNumWorkers() const;
+
+private:
+    // padded so that threads taking chunks from neighboring ranges do not share a cache line
+    struct Range {
+        std::atomic<size_t> next{0};
+        size_t end = 0;
+        char padding[64 - sizeof(std::atomic<size_t>) - sizeof(size_t)];
+    };
+
+    struct Job {
+        explicit Job(size_t num_ranges) : ranges(num_ranges) {}
+
+        const std::function<void(size_t, size_t)>* func = nullptr;
+        std::vector<Range> ranges;   // ranges[0] belongs to the calling thread
+        size_t grain = 1;            // tasks taken at once
+        size_t max_workers = 0;      // workers that may join besides the calling thread
+        size_t num_joined = 0;       // guarded by mutex_
+        size_t num_running = 0;      // guarded by mutex_
+        std::atomic<bool> exhausted{false};
+        std::mutex error_mutex;
+        std::exception_ptr error;
+    };
+
+    static void Run_(Job& job, size_t participant);
+    void Grow_(size_t num_workers);
+    void WorkerLoop_();
+    Job* FindJob_();
+
+    // tasks per ParallelFor() thread are split in about this many chunks, and chunks hold at most kMaxGrain tasks
+    static const size_t kChunksPerThread = 16;
+    static const size_t kMaxGrain = 64;
+    // idle workers poll for new jobs this many times before sleeping, as batches often come back to back
+    static const int kSpinIterations = 2000;
+
+    mutable std::mutex mutex_;
+    std::condition_variable job_cv_;
+    std::condition_variable done_cv_;
+    std::list<Job*> jobs_;
+    std::atomic<uint64_t> num_submitted_{0};
+    std::vector<std::thread> workers_;
+    bool stop_ = false;
+};
+
+} // namespace n2
@@ -15,6 +15,9 @@
 #pragma once
 
 #include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
 #include <numeric>
 #include <vector>
 
@@ -23,10 +26,41 @@ namespace n2 {
 class Utils {
 public:
     static void NormalizeVector(const std::vector<float>& in, std::vector<float>& out) {
-        float sum = std::inner_product(in.begin(), in.end(), in.begin(), 0.0);
+        NormalizeVector(in.data(), in.size(), out.data());
+    }
+    static void NormalizeVector(const float* in, size_t dim, float* out) {
+        float sum = std::inner_product(in, in + dim, in, 0.0);
         if (sum != 0.0) {
             sum = 1 / std::sqrt(sum);
-            std::transform(in.begin(), in.end(), out.begin(), std::bind1st(std::multiplies<float>(), sum));
+            std::transform(in, in + dim, out, std::bind1st(std::multiplies<float>(), sum));
+        }
+    }
+
+    /**
+     * Number of floats holding a bit-packed binary vector of dim bits (padded to 64-bit words).
+     */
+    static size_t GetPackedBinarySize(size_t dim) {
+        return ((dim + 63) / 64) * sizeof(uint64_t) / sizeof(float);
+    }
+
+    /**
+     * Packs a binary vector (nonzero elements are 1 bits) into 64-bit words, LSB first.
+     */
+    static void PackBinaryVector(const std::vector<float>& in, std::vector<float>& out) {
+        out.assign(GetPackedBinarySize(in.size()), 0);
+        PackBinaryVector(in.data(), in.size(), out.data());
+    }
+
+    /**
+     * Same as above into a caller-owned buffer of GetPackedBinarySize(dim) floats.
+     */
+    static void PackBinaryVector(const float* in, size_t dim, float* out) {
+        uint64_t* words = (uint64_t*)out;
+        std::fill(words, words + (dim + 63) / 64, 0);
+        for (size_t i = 0; i < dim; ++i) {
+            if (in[i] != 0) {
+                words[i / 64] |= (uint64_t)1 << (i % 64);
+            }
         }
     }
 };
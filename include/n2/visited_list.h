@@ -14,6 +14,15 @@
 
 #pragma once
 
+#include <xmmintrin.h>
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "common.h"
+
 namespace n2 {
 
 class VisitedList { 
@@ -43,4 +52,164 @@ private:
     unsigned int mark_;
 };
 
+/**
+ * Visited nodes of a searcher, in one of the VisitedSetKind representations.
+ *
+ * Memory is allocated on the first Reset(), so the kind can be changed for free before the first query.
+ * Epoch arrays are allocated zeroed through calloc, which leaves the pages of a large model untouched
+ * until a query visits them.
+ */
+class VisitedSet {
+public:
+    explicit VisitedSet(size_t size, VisitedSetKind kind = VisitedSetKind::EPOCH32) : size_(size) {
+        SetKind(kind);
+    }
+    VisitedSet(const VisitedSet&) = delete;
+    VisitedSet& operator=(const VisitedSet&) = delete;
+    ~VisitedSet() { Free_(); }
+
+    inline VisitedSetKind GetKind() const { return kind_; }
+    inline void SetKind(VisitedSetKind kind) {
+        Free_();
+        kind_ = kind;
+        mark_shift_ = kind == VisitedSetKind::EPOCH16 ? 1 : kind == VisitedSetKind::EPOCH8 ? 0 : 2;
+        max_mark_ = kind == VisitedSetKind::EPOCH16 ? 0xffff : kind == VisitedSetKind::EPOCH8 ? 0xff : 0xffffffff;
+    }
+
+    /**
+     * Starts a new query: every node becomes unvisited.
+     */
+    inline void Reset() {
+        if (kind_ == VisitedSetKind::HASH) {
+            ResetHash_();
+            return;
+        }
+        if (marks_ == nullptr) {
+            marks_ = std::calloc(size_ > 0 ? size_ : 1, (size_t)1 << mark_shift_);
+            if (marks_ == nullptr) {
+                throw std::bad_alloc();
+            }
+            mark_ = 0;
+        }
+        if (++mark_ > max_mark_) {
+            mark_ = 1;
+            memset(marks_, 0, size_ << mark_shift_);
+        }
+    }
+
+    /**
+     * Marks a node as visited; returns false if it already was.
+     */
+    inline bool Insert(unsigned int id) {
+        if (kind_ == VisitedSetKind::EPOCH32) {
+            return InsertEpoch_<uint32_t>(id);
+        } else if (kind_ == VisitedSetKind::EPOCH16) {
+            return InsertEpoch_<uint16_t>(id);
+        } else if (kind_ == VisitedSetKind::EPOCH8) {
+            return InsertEpoch_<uint8_t>(id);
+        }
+        return InsertHash_(id);
+    }
+
+    inline void Prefetch(unsigned int id) const {
+        if (kind_ == VisitedSetKind::HASH) {
+            _mm_prefetch((const char*)(slots_ + Hash_(id)), _MM_HINT_T0);
+        } else {
+            _mm_prefetch((const char*)marks_ + ((size_t)id << mark_shift_), _MM_HINT_T0);
+        }
+    }
+
+private:
+    template<typename MarkType>
+    inline bool InsertEpoch_(unsigned int id) {
+        MarkType* marks = (MarkType*)marks_;
+        if (marks[id] == (MarkType)mark_) {
+            return false;
+        }
+        marks[id] = (MarkType)mark_;
+        return true;
+    }
+
+    inline size_t Hash_(unsigned int id) const {
+        return (uint32_t)(id * 2654435769u) >> hash_shift_;
+    }
+
+    inline bool InsertHash_(unsigned int id) {
+        size_t i = Hash_(id);
+        while (slots_[i] != kEmptySlot) {
+            if (slots_[i] == id) {
+                return false;
+            }
+            i = (i + 1) & (capacity_ - 1);
+        }
+        slots_[i] = id;
+        if (++count_ * 2 > capacity_) {
+            GrowHash_();
+        }
+        return true;
+    }
+
+    inline void ResetHash_() {
+        if (slots_ == nullptr) {
+            AllocateHash_(kInitialHashCapacity);
+        } else if (count_ > 0) {
+            memset(slots_, 0xff, sizeof(uint32_t) * capacity_);
+        }
+        count_ = 0;
+    }
+
+    void AllocateHash_(size_t capacity) {
+        uint32_t* slots = (uint32_t*)std::malloc(sizeof(uint32_t) * capacity);
+        if (slots == nullptr) {
+            throw std::bad_alloc();
+        }
+        slots_ = slots;
+        memset(slots_, 0xff, sizeof(uint32_t) * capacity);
+        capacity_ = capacity;
+        hash_shift_ = 32 - __builtin_ctzll(capacity);
+    }
+
+    void GrowHash_() {
+        uint32_t* old_slots = slots_;
+        size_t old_capacity = capacity_;
+        AllocateHash_(old_capacity * 2);
+        for (size_t i = 0; i < old_capacity; ++i) {
+            if (old_slots[i] != kEmptySlot) {
+                size_t j = Hash_(old_slots[i]);
+                while (slots_[j] != kEmptySlot) {
+                    j = (j + 1) & (capacity_ - 1);
+                }
+                slots_[j] = old_slots[i];
+            }
+        }
+        std::free(old_slots);
+    }
+
+    void Free_() {
+        std::free(marks_);
+        std::free(slots_);
+        marks_ = nullptr;
+        slots_ = nullptr;
+        capacity_ = count_ = 0;
+    }
+
+    static const uint32_t kEmptySlot = 0xffffffff;
+    static const size_t kInitialHashCapacity = 4096;
+
+    size_t size_;
+    VisitedSetKind kind_;
+
+    // epoch kinds: one mark per node
+    void* marks_ = nullptr;
+    int mark_shift_ = 2;     // log2 of the bytes per mark
+    uint64_t mark_ = 0;
+    uint64_t max_mark_ = 0;
+
+    // HASH: node ids, kEmptySlot for free slots; at most half full
+    uint32_t* slots_ = nullptr;
+    size_t capacity_ = 0;
+    size_t count_ = 0;
+    int hash_shift_ = 32;
+};
+
 } // namespace n2
@@ -91,11 +91,12 @@ def define_extensions(**kwargs):
 
     sources = ['./src/heuristic.cc', './src/hnsw.cc', './src/hnsw_node.cc',
                './src/hnsw_build.cc', './src/hnsw_model.cc', './src/hnsw_search.cc',
-               './src/mmap.cc', './bindings/python/n2.pyx']
+               './src/mmap.cc', './src/distance_kernels.cc',
+               './src/quantization.cc', './src/thread_pool.cc', './bindings/python/n2.pyx']
 
     boost_dirs = ['assert', 'bind', 'concept_check', 'config', 'core', 'detail', 'heap', 'iterator', 'mp11', 'mpl',
                   'parameter', 'preprocessor', 'static_assert', 'throw_exception', 'type_traits', 'utility']
-    include_dirs = ['./include/', './third_party/spdlog/include/', './third_party/eigen']
+    include_dirs = ['./include/', './third_party/spdlog/include/']
     include_dirs.extend(['third_party/boost/' + b + '/include/' for b in boost_dirs])
 
     return Extension(name='n2',
@@ -0,0 +1,880 @@
+// Copyright 2017 Kakao Corp. <http://www.kakaocorp.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "n2/distance_kernels.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define N2_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace n2 {
+
+namespace {
+
+template<size_t Dim>
+float L2Scalar(const float* v1, const float* v2, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    float sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        float d = v1[i] - v2[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+template<size_t Dim>
+float DotScalar(const float* v1, const float* v2, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    float sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += v1[i] * v2[i];
+    }
+    return sum;
+}
+
+template<size_t Dim>
+float L2BoundedScalar(const float* v1, const float* v2, size_t qty, float bound) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    float sum = 0;
+    size_t i = 0;
+    for (; i + kL2BoundedChunk <= n; i += kL2BoundedChunk) {
+        sum += L2Scalar<kL2BoundedChunk>(v1 + i, v2 + i, kL2BoundedChunk);
+        if (sum > bound) {
+            return sum;
+        }
+    }
+    return sum + L2Scalar<0>(v1 + i, v2 + i, n - i);
+}
+
+template<size_t Dim>
+void L2BatchScalar(const float* q, const float* const* vecs, size_t num, size_t qty, float* out) {
+    for (size_t v = 0; v < num; ++v) {
+        out[v] = L2Scalar<Dim>(q, vecs[v], qty);
+    }
+}
+
+template<size_t Dim>
+void DotBatchScalar(const float* q, const float* const* vecs, size_t num, size_t qty, float* out) {
+    for (size_t v = 0; v < num; ++v) {
+        out[v] = DotScalar<Dim>(q, vecs[v], qty);
+    }
+}
+
+template<size_t Dim>
+float SQ8L2Scalar(const float* q, const float* scales, const uint8_t* code, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    float sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        float d = q[i] - scales[i] * code[i];
+        sum += d * d;
+    }
+    return sum;
+}
+
+template<size_t Dim>
+float SQ8DotScalar(const float* q, const uint8_t* code, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    float sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += q[i] * code[i];
+    }
+    return sum;
+}
+
+template<size_t Dim, bool BF16>
+float HalfL2Scalar(const float* q, const uint16_t* v, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    float sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        float d = q[i] - (BF16 ? BFloat16ToFloat(v[i]) : HalfToFloat(v[i]));
+        sum += d * d;
+    }
+    return sum;
+}
+
+template<size_t Dim, bool BF16>
+float HalfDotScalar(const float* q, const uint16_t* v, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    float sum = 0;
+    for (size_t i = 0; i < n; ++i) {
+        sum += q[i] * (BF16 ? BFloat16ToFloat(v[i]) : HalfToFloat(v[i]));
+    }
+    return sum;
+}
+
+inline uint64_t LoadWord(const uint64_t* p) {
+    uint64_t word;
+    std::memcpy(&word, p, sizeof(word));  // level-0 records are only 4-byte aligned
+    return word;
+}
+
+float HammingScalar(const uint64_t* v1, const uint64_t* v2, size_t num_words) {
+    uint64_t count = 0;
+    for (size_t i = 0; i < num_words; ++i) {
+        count += __builtin_popcountll(LoadWord(v1 + i) ^ LoadWord(v2 + i));
+    }
+    return (float)count;
+}
+
+float PQAdcScalar(const float* lut, const uint8_t* code, size_t num_subspaces) {
+    float sum = 0;
+    for (size_t m = 0; m < num_subspaces; ++m) {
+        sum += lut[m * 256 + code[m]];
+    }
+    return sum;
+}
+
+#ifdef N2_X86_KERNELS
+
+__attribute__((target("sse4.1")))
+inline float HorizontalSum128(__m128 v) {
+    __m128 shuf = _mm_movehdup_ps(v);
+    __m128 sums = _mm_add_ps(v, shuf);
+    shuf = _mm_movehl_ps(shuf, sums);
+    sums = _mm_add_ss(sums, shuf);
+    return _mm_cvtss_f32(sums);
+}
+
+__attribute__((target("avx2,fma")))
+inline float HorizontalSum256(__m256 v) {
+    __m128 lo = _mm256_castps256_ps128(v);
+    __m128 hi = _mm256_extractf128_ps(v, 1);
+    return HorizontalSum128(_mm_add_ps(lo, hi));
+}
+
+template<size_t Dim>
+__attribute__((target("sse4.1")))
+float L2Sse4(const float* v1, const float* v2, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128 d0 = _mm_sub_ps(_mm_loadu_ps(v1 + i), _mm_loadu_ps(v2 + i));
+        __m128 d1 = _mm_sub_ps(_mm_loadu_ps(v1 + i + 4), _mm_loadu_ps(v2 + i + 4));
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(d0, d0));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(d1, d1));
+    }
+    for (; i + 4 <= n; i += 4) {
+        __m128 d = _mm_sub_ps(_mm_loadu_ps(v1 + i), _mm_loadu_ps(v2 + i));
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(d, d));
+    }
+    float sum = HorizontalSum128(_mm_add_ps(sum0, sum1));
+    return sum + L2Scalar<0>(v1 + i, v2 + i, n - i);
+}
+
+template<size_t Dim>
+__attribute__((target("sse4.1")))
+float DotSse4(const float* v1, const float* v2, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(v1 + i), _mm_loadu_ps(v2 + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(v1 + i + 4), _mm_loadu_ps(v2 + i + 4)));
+    }
+    for (; i + 4 <= n; i += 4) {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(v1 + i), _mm_loadu_ps(v2 + i)));
+    }
+    float sum = HorizontalSum128(_mm_add_ps(sum0, sum1));
+    return sum + DotScalar<0>(v1 + i, v2 + i, n - i);
+}
+
+template<size_t Dim>
+__attribute__((target("sse4.1")))
+float L2BoundedSse4(const float* v1, const float* v2, size_t qty, float bound) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    float sum = 0;
+    size_t i = 0;
+    for (; i + kL2BoundedChunk <= n; i += kL2BoundedChunk) {
+        sum += L2Sse4<kL2BoundedChunk>(v1 + i, v2 + i, kL2BoundedChunk);
+        if (sum > bound) {
+            return sum;
+        }
+    }
+    return sum + L2Sse4<0>(v1 + i, v2 + i, n - i);
+}
+
+template<size_t Dim>
+__attribute__((target("sse4.1")))
+void L2BatchSse4(const float* q, const float* const* vecs, size_t num, size_t qty, float* out) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    size_t v = 0;
+    for (; v + 4 <= num; v += 4) {
+        const float* p0 = vecs[v];
+        const float* p1 = vecs[v + 1];
+        const float* p2 = vecs[v + 2];
+        const float* p3 = vecs[v + 3];
+        __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+        __m128 sum2 = _mm_setzero_ps(), sum3 = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128 x = _mm_loadu_ps(q + i);
+            __m128 d0 = _mm_sub_ps(x, _mm_loadu_ps(p0 + i));
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(d0, d0));
+            __m128 d1 = _mm_sub_ps(x, _mm_loadu_ps(p1 + i));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(d1, d1));
+            __m128 d2 = _mm_sub_ps(x, _mm_loadu_ps(p2 + i));
+            sum2 = _mm_add_ps(sum2, _mm_mul_ps(d2, d2));
+            __m128 d3 = _mm_sub_ps(x, _mm_loadu_ps(p3 + i));
+            sum3 = _mm_add_ps(sum3, _mm_mul_ps(d3, d3));
+        }
+        out[v] = HorizontalSum128(sum0) + L2Scalar<0>(q + i, p0 + i, n - i);
+        out[v + 1] = HorizontalSum128(sum1) + L2Scalar<0>(q + i, p1 + i, n - i);
+        out[v + 2] = HorizontalSum128(sum2) + L2Scalar<0>(q + i, p2 + i, n - i);
+        out[v + 3] = HorizontalSum128(sum3) + L2Scalar<0>(q + i, p3 + i, n - i);
+    }
+    for (; v < num; ++v) {
+        out[v] = L2Sse4<Dim>(q, vecs[v], qty);
+    }
+}
+
+template<size_t Dim>
+__attribute__((target("sse4.1")))
+void DotBatchSse4(const float* q, const float* const* vecs, size_t num, size_t qty, float* out) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    size_t v = 0;
+    for (; v + 4 <= num; v += 4) {
+        const float* p0 = vecs[v];
+        const float* p1 = vecs[v + 1];
+        const float* p2 = vecs[v + 2];
+        const float* p3 = vecs[v + 3];
+        __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+        __m128 sum2 = _mm_setzero_ps(), sum3 = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            __m128 x = _mm_loadu_ps(q + i);
+            sum0 = _mm_add_ps(sum0, _mm_mul_ps(x, _mm_loadu_ps(p0 + i)));
+            sum1 = _mm_add_ps(sum1, _mm_mul_ps(x, _mm_loadu_ps(p1 + i)));
+            sum2 = _mm_add_ps(sum2, _mm_mul_ps(x, _mm_loadu_ps(p2 + i)));
+            sum3 = _mm_add_ps(sum3, _mm_mul_ps(x, _mm_loadu_ps(p3 + i)));
+        }
+        out[v] = HorizontalSum128(sum0) + DotScalar<0>(q + i, p0 + i, n - i);
+        out[v + 1] = HorizontalSum128(sum1) + DotScalar<0>(q + i, p1 + i, n - i);
+        out[v + 2] = HorizontalSum128(sum2) + DotScalar<0>(q + i, p2 + i, n - i);
+        out[v + 3] = HorizontalSum128(sum3) + DotScalar<0>(q + i, p3 + i, n - i);
+    }
+    for (; v < num; ++v) {
+        out[v] = DotSse4<Dim>(q, vecs[v], qty);
+    }
+}
+
+template<size_t Dim>
+__attribute__((target("avx2,fma")))
+float L2Avx2(const float* v1, const float* v2, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256 d0 = _mm256_sub_ps(_mm256_loadu_ps(v1 + i), _mm256_loadu_ps(v2 + i));
+        __m256 d1 = _mm256_sub_ps(_mm256_loadu_ps(v1 + i + 8), _mm256_loadu_ps(v2 + i + 8));
+        sum0 = _mm256_fmadd_ps(d0, d0, sum0);
+        sum1 = _mm256_fmadd_ps(d1, d1, sum1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(v1 + i), _mm256_loadu_ps(v2 + i));
+        sum0 = _mm256_fmadd_ps(d, d, sum0);
+    }
+    float sum = HorizontalSum256(_mm256_add_ps(sum0, sum1));
+    return sum + L2Scalar<0>(v1 + i, v2 + i, n - i);
+}
+
+template<size_t Dim>
+__attribute__((target("avx2,fma")))
+float DotAvx2(const float* v1, const float* v2, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(v1 + i), _mm256_loadu_ps(v2 + i), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(v1 + i + 8), _mm256_loadu_ps(v2 + i + 8), sum1);
+    }
+    for (; i + 8 <= n; i += 8) {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(v1 + i), _mm256_loadu_ps(v2 + i), sum0);
+    }
+    float sum = HorizontalSum256(_mm256_add_ps(sum0, sum1));
+    return sum + DotScalar<0>(v1 + i, v2 + i, n - i);
+}
+
+template<size_t Dim>
+__attribute__((target("avx2,fma")))
+float L2BoundedAvx2(const float* v1, const float* v2, size_t qty, float bound) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    float sum = 0;
+    size_t i = 0;
+    for (; i + kL2BoundedChunk <= n; i += kL2BoundedChunk) {
+        sum += L2Avx2<kL2BoundedChunk>(v1 + i, v2 + i, kL2BoundedChunk);
+        if (sum > bound) {
+            return sum;
+        }
+    }
+    return sum + L2Avx2<0>(v1 + i, v2 + i, n - i);
+}
+
+template<size_t Dim>
+__attribute__((target("avx2,fma")))
+void L2BatchAvx2(const float* q, const float* const* vecs, size_t num, size_t qty, float* out) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    size_t v = 0;
+    for (; v + 4 <= num; v += 4) {
+        const float* p0 = vecs[v];
+        const float* p1 = vecs[v + 1];
+        const float* p2 = vecs[v + 2];
+        const float* p3 = vecs[v + 3];
+        __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+        __m256 sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 x = _mm256_loadu_ps(q + i);
+            __m256 d0 = _mm256_sub_ps(x, _mm256_loadu_ps(p0 + i));
+            sum0 = _mm256_fmadd_ps(d0, d0, sum0);
+            __m256 d1 = _mm256_sub_ps(x, _mm256_loadu_ps(p1 + i));
+            sum1 = _mm256_fmadd_ps(d1, d1, sum1);
+            __m256 d2 = _mm256_sub_ps(x, _mm256_loadu_ps(p2 + i));
+            sum2 = _mm256_fmadd_ps(d2, d2, sum2);
+            __m256 d3 = _mm256_sub_ps(x, _mm256_loadu_ps(p3 + i));
+            sum3 = _mm256_fmadd_ps(d3, d3, sum3);
+        }
+        out[v] = HorizontalSum256(sum0) + L2Scalar<0>(q + i, p0 + i, n - i);
+        out[v + 1] = HorizontalSum256(sum1) + L2Scalar<0>(q + i, p1 + i, n - i);
+        out[v + 2] = HorizontalSum256(sum2) + L2Scalar<0>(q + i, p2 + i, n - i);
+        out[v + 3] = HorizontalSum256(sum3) + L2Scalar<0>(q + i, p3 + i, n - i);
+    }
+    for (; v < num; ++v) {
+        out[v] = L2Avx2<Dim>(q, vecs[v], qty);
+    }
+}
+
+template<size_t Dim>
+__attribute__((target("avx2,fma")))
+void DotBatchAvx2(const float* q, const float* const* vecs, size_t num, size_t qty, float* out) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    size_t v = 0;
+    for (; v + 4 <= num; v += 4) {
+        const float* p0 = vecs[v];
+        const float* p1 = vecs[v + 1];
+        const float* p2 = vecs[v + 2];
+        const float* p3 = vecs[v + 3];
+        __m256 sum0 = _mm256_setzero_ps(), sum1 = _mm256_setzero_ps();
+        __m256 sum2 = _mm256_setzero_ps(), sum3 = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m256 x = _mm256_loadu_ps(q + i);
+            sum0 = _mm256_fmadd_ps(x, _mm256_loadu_ps(p0 + i), sum0);
+            sum1 = _mm256_fmadd_ps(x, _mm256_loadu_ps(p1 + i), sum1);
+            sum2 = _mm256_fmadd_ps(x, _mm256_loadu_ps(p2 + i), sum2);
+            sum3 = _mm256_fmadd_ps(x, _mm256_loadu_ps(p3 + i), sum3);
+        }
+        out[v] = HorizontalSum256(sum0) + DotScalar<0>(q + i, p0 + i, n - i);
+        out[v + 1] = HorizontalSum256(sum1) + DotScalar<0>(q + i, p1 + i, n - i);
+        out[v + 2] = HorizontalSum256(sum2) + DotScalar<0>(q + i, p2 + i, n - i);
+        out[v + 3] = HorizontalSum256(sum3) + DotScalar<0>(q + i, p3 + i, n - i);
+    }
+    for (; v < num; ++v) {
+        out[v] = DotAvx2<Dim>(q, vecs[v], qty);
+    }
+}
+
+template<size_t Dim>
+__attribute__((target("avx512f")))
+float L2Avx512(const float* v1, const float* v2, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m512 sum0 = _mm512_setzero_ps();
+    __m512 sum1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m512 d0 = _mm512_sub_ps(_mm512_loadu_ps(v1 + i), _mm512_loadu_ps(v2 + i));
+        __m512 d1 = _mm512_sub_ps(_mm512_loadu_ps(v1 + i + 16), _mm512_loadu_ps(v2 + i + 16));
+        sum0 = _mm512_fmadd_ps(d0, d0, sum0);
+        sum1 = _mm512_fmadd_ps(d1, d1, sum1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(v1 + i), _mm512_loadu_ps(v2 + i));
+        sum0 = _mm512_fmadd_ps(d, d, sum0);
+    }
+    if (i < n) {
+        // masked loads never touch memory beyond n, so the tail needs no scalar loop
+        __mmask16 mask = (__mmask16)((1u << (n - i)) - 1);
+        __m512 d = _mm512_sub_ps(_mm512_maskz_loadu_ps(mask, v1 + i), _mm512_maskz_loadu_ps(mask, v2 + i));
+        sum1 = _mm512_fmadd_ps(d, d, sum1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1));
+}
+
+template<size_t Dim>
+__attribute__((target("avx512f")))
+float DotAvx512(const float* v1, const float* v2, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m512 sum0 = _mm512_setzero_ps();
+    __m512 sum1 = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(v1 + i), _mm512_loadu_ps(v2 + i), sum0);
+        sum1 = _mm512_fmadd_ps(_mm512_loadu_ps(v1 + i + 16), _mm512_loadu_ps(v2 + i + 16), sum1);
+    }
+    for (; i + 16 <= n; i += 16) {
+        sum0 = _mm512_fmadd_ps(_mm512_loadu_ps(v1 + i), _mm512_loadu_ps(v2 + i), sum0);
+    }
+    if (i < n) {
+        __mmask16 mask = (__mmask16)((1u << (n - i)) - 1);
+        sum1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, v1 + i), _mm512_maskz_loadu_ps(mask, v2 + i), sum1);
+    }
+    return _mm512_reduce_add_ps(_mm512_add_ps(sum0, sum1));
+}
+
+template<size_t Dim>
+__attribute__((target("avx512f")))
+float L2BoundedAvx512(const float* v1, const float* v2, size_t qty, float bound) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    float sum = 0;
+    size_t i = 0;
+    for (; i + kL2BoundedChunk <= n; i += kL2BoundedChunk) {
+        sum += L2Avx512<kL2BoundedChunk>(v1 + i, v2 + i, kL2BoundedChunk);
+        if (sum > bound) {
+            return sum;
+        }
+    }
+    return sum + L2Avx512<0>(v1 + i, v2 + i, n - i);
+}
+
+template<size_t Dim>
+__attribute__((target("avx512f")))
+void L2BatchAvx512(const float* q, const float* const* vecs, size_t num, size_t qty, float* out) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    size_t v = 0;
+    for (; v + 4 <= num; v += 4) {
+        const float* p0 = vecs[v];
+        const float* p1 = vecs[v + 1];
+        const float* p2 = vecs[v + 2];
+        const float* p3 = vecs[v + 3];
+        __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();
+        __m512 sum2 = _mm512_setzero_ps(), sum3 = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m512 x = _mm512_loadu_ps(q + i);
+            __m512 d0 = _mm512_sub_ps(x, _mm512_loadu_ps(p0 + i));
+            sum0 = _mm512_fmadd_ps(d0, d0, sum0);
+            __m512 d1 = _mm512_sub_ps(x, _mm512_loadu_ps(p1 + i));
+            sum1 = _mm512_fmadd_ps(d1, d1, sum1);
+            __m512 d2 = _mm512_sub_ps(x, _mm512_loadu_ps(p2 + i));
+            sum2 = _mm512_fmadd_ps(d2, d2, sum2);
+            __m512 d3 = _mm512_sub_ps(x, _mm512_loadu_ps(p3 + i));
+            sum3 = _mm512_fmadd_ps(d3, d3, sum3);
+        }
+        if (i < n) {
+            __mmask16 mask = (__mmask16)((1u << (n - i)) - 1);
+            __m512 x = _mm512_maskz_loadu_ps(mask, q + i);
+            __m512 d0 = _mm512_sub_ps(x, _mm512_maskz_loadu_ps(mask, p0 + i));
+            sum0 = _mm512_fmadd_ps(d0, d0, sum0);
+            __m512 d1 = _mm512_sub_ps(x, _mm512_maskz_loadu_ps(mask, p1 + i));
+            sum1 = _mm512_fmadd_ps(d1, d1, sum1);
+            __m512 d2 = _mm512_sub_ps(x, _mm512_maskz_loadu_ps(mask, p2 + i));
+            sum2 = _mm512_fmadd_ps(d2, d2, sum2);
+            __m512 d3 = _mm512_sub_ps(x, _mm512_maskz_loadu_ps(mask, p3 + i));
+            sum3 = _mm512_fmadd_ps(d3, d3, sum3);
+        }
+        out[v] = _mm512_reduce_add_ps(sum0);
+        out[v + 1] = _mm512_reduce_add_ps(sum1);
+        out[v + 2] = _mm512_reduce_add_ps(sum2);
+        out[v + 3] = _mm512_reduce_add_ps(sum3);
+    }
+    for (; v < num; ++v) {
+        out[v] = L2Avx512<Dim>(q, vecs[v], qty);
+    }
+}
+
+template<size_t Dim>
+__attribute__((target("avx512f")))
+void DotBatchAvx512(const float* q, const float* const* vecs, size_t num, size_t qty, float* out) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    size_t v = 0;
+    for (; v + 4 <= num; v += 4) {
+        const float* p0 = vecs[v];
+        const float* p1 = vecs[v + 1];
+        const float* p2 = vecs[v + 2];
+        const float* p3 = vecs[v + 3];
+        __m512 sum0 = _mm512_setzero_ps(), sum1 = _mm512_setzero_ps();
+        __m512 sum2 = _mm512_setzero_ps(), sum3 = _mm512_setzero_ps();
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m512 x = _mm512_loadu_ps(q + i);
+            sum0 = _mm512_fmadd_ps(x, _mm512_loadu_ps(p0 + i), sum0);
+            sum1 = _mm512_fmadd_ps(x, _mm512_loadu_ps(p1 + i), sum1);
+            sum2 = _mm512_fmadd_ps(x, _mm512_loadu_ps(p2 + i), sum2);
+            sum3 = _mm512_fmadd_ps(x, _mm512_loadu_ps(p3 + i), sum3);
+        }
+        if (i < n) {
+            __mmask16 mask = (__mmask16)((1u << (n - i)) - 1);
+            __m512 x = _mm512_maskz_loadu_ps(mask, q + i);
+            sum0 = _mm512_fmadd_ps(x, _mm512_maskz_loadu_ps(mask, p0 + i), sum0);
+            sum1 = _mm512_fmadd_ps(x, _mm512_maskz_loadu_ps(mask, p1 + i), sum1);
+            sum2 = _mm512_fmadd_ps(x, _mm512_maskz_loadu_ps(mask, p2 + i), sum2);
+            sum3 = _mm512_fmadd_ps(x, _mm512_maskz_loadu_ps(mask, p3 + i), sum3);
+        }
+        out[v] = _mm512_reduce_add_ps(sum0);
+        out[v + 1] = _mm512_reduce_add_ps(sum1);
+        out[v + 2] = _mm512_reduce_add_ps(sum2);
+        out[v + 3] = _mm512_reduce_add_ps(sum3);
+    }
+    for (; v < num; ++v) {
+        out[v] = DotAvx512<Dim>(q, vecs[v], qty);
+    }
+}
+
+template<size_t Dim>
+__attribute__((target("sse4.1")))
+float SQ8L2Sse4(const float* q, const float* scales, const uint8_t* code, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m128 sum = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        int32_t packed;
+        memcpy(&packed, code + i, sizeof(packed));
+        __m128 c = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+        __m128 d = _mm_sub_ps(_mm_loadu_ps(q + i), _mm_mul_ps(_mm_loadu_ps(scales + i), c));
+        sum = _mm_add_ps(sum, _mm_mul_ps(d, d));
+    }
+    return HorizontalSum128(sum) + SQ8L2Scalar<0>(q + i, scales + i, code + i, n - i);
+}
+
+template<size_t Dim>
+__attribute__((target("sse4.1")))
+float SQ8DotSse4(const float* q, const uint8_t* code, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m128 sum = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        int32_t packed;
+        memcpy(&packed, code + i, sizeof(packed));
+        __m128 c = _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(packed)));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(q + i), c));
+    }
+    return HorizontalSum128(sum) + SQ8DotScalar<0>(q + i, code + i, n - i);
+}
+
+template<size_t Dim>
+__attribute__((target("avx2,fma")))
+float SQ8L2Avx2(const float* q, const float* scales, const uint8_t* code, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m256 sum = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i packed = _mm_loadl_epi64((const __m128i*)(code + i));
+        __m256 c = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(packed));
+        __m256 d = _mm256_fnmadd_ps(_mm256_loadu_ps(scales + i), c, _mm256_loadu_ps(q + i));
+        sum = _mm256_fmadd_ps(d, d, sum);
+    }
+    return HorizontalSum256(sum) + SQ8L2Scalar<0>(q + i, scales + i, code + i, n - i);
+}
+
+template<size_t Dim>
+__attribute__((target("avx2,fma")))
+float SQ8DotAvx2(const float* q, const uint8_t* code, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m256 sum = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m128i packed = _mm_loadl_epi64((const __m128i*)(code + i));
+        __m256 c = _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(packed));
+        sum = _mm256_fmadd_ps(_mm256_loadu_ps(q + i), c, sum);
+    }
+    return HorizontalSum256(sum) + SQ8DotScalar<0>(q + i, code + i, n - i);
+}
+
+template<size_t Dim>
+__attribute__((target("avx512f")))
+float SQ8L2Avx512(const float* q, const float* scales, const uint8_t* code, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m512 sum = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i packed = _mm_loadu_si128((const __m128i*)(code + i));
+        __m512 c = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(packed));
+        __m512 d = _mm512_fnmadd_ps(_mm512_loadu_ps(scales + i), c, _mm512_loadu_ps(q + i));
+        sum = _mm512_fmadd_ps(d, d, sum);
+    }
+    return _mm512_reduce_add_ps(sum) + SQ8L2Scalar<0>(q + i, scales + i, code + i, n - i);
+}
+
+template<size_t Dim>
+__attribute__((target("avx512f")))
+float SQ8DotAvx512(const float* q, const uint8_t* code, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m512 sum = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i packed = _mm_loadu_si128((const __m128i*)(code + i));
+        __m512 c = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(packed));
+        sum = _mm512_fmadd_ps(_mm512_loadu_ps(q + i), c, sum);
+    }
+    return _mm512_reduce_add_ps(sum) + SQ8DotScalar<0>(q + i, code + i, n - i);
+}
+
+// SSE4.1 has no FP16 conversion instructions, so only BF16 (a plain shift) is vectorized at this level.
+__attribute__((target("sse4.1")))
+inline __m128 LoadBFloat16x4(const uint16_t* v) {
+    __m128i packed = _mm_loadl_epi64((const __m128i*)v);
+    return _mm_castsi128_ps(_mm_slli_epi32(_mm_cvtepu16_epi32(packed), 16));
+}
+
+template<size_t Dim>
+__attribute__((target("sse4.1")))
+float BFloat16L2Sse4(const float* q, const uint16_t* v, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m128 sum = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128 d = _mm_sub_ps(_mm_loadu_ps(q + i), LoadBFloat16x4(v + i));
+        sum = _mm_add_ps(sum, _mm_mul_ps(d, d));
+    }
+    return HorizontalSum128(sum) + HalfL2Scalar<0, true>(q + i, v + i, n - i);
+}
+
+template<size_t Dim>
+__attribute__((target("sse4.1")))
+float BFloat16DotSse4(const float* q, const uint16_t* v, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m128 sum = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(q + i), LoadBFloat16x4(v + i)));
+    }
+    return HorizontalSum128(sum) + HalfDotScalar<0, true>(q + i, v + i, n - i);
+}
+
+template<bool BF16>
+__attribute__((target("avx2,fma,f16c")))
+inline __m256 LoadHalfx8(const uint16_t* v) {
+    __m128i packed = _mm_loadu_si128((const __m128i*)v);
+    if (BF16) {
+        return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(packed), 16));
+    }
+    return _mm256_cvtph_ps(packed);
+}
+
+template<size_t Dim, bool BF16>
+__attribute__((target("avx2,fma,f16c")))
+float HalfL2Avx2(const float* q, const uint16_t* v, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m256 sum = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256 d = _mm256_sub_ps(_mm256_loadu_ps(q + i), LoadHalfx8<BF16>(v + i));
+        sum = _mm256_fmadd_ps(d, d, sum);
+    }
+    return HorizontalSum256(sum) + HalfL2Scalar<0, BF16>(q + i, v + i, n - i);
+}
+
+template<size_t Dim, bool BF16>
+__attribute__((target("avx2,fma,f16c")))
+float HalfDotAvx2(const float* q, const uint16_t* v, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m256 sum = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        sum = _mm256_fmadd_ps(_mm256_loadu_ps(q + i), LoadHalfx8<BF16>(v + i), sum);
+    }
+    return HorizontalSum256(sum) + HalfDotScalar<0, BF16>(q + i, v + i, n - i);
+}
+
+template<bool BF16>
+__attribute__((target("avx512f")))
+inline __m512 LoadHalfx16(const uint16_t* v) {
+    __m256i packed = _mm256_loadu_si256((const __m256i*)v);
+    if (BF16) {
+        return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(packed), 16));
+    }
+    return _mm512_cvtph_ps(packed);
+}
+
+template<size_t Dim, bool BF16>
+__attribute__((target("avx512f")))
+float HalfL2Avx512(const float* q, const uint16_t* v, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m512 sum = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512 d = _mm512_sub_ps(_mm512_loadu_ps(q + i), LoadHalfx16<BF16>(v + i));
+        sum = _mm512_fmadd_ps(d, d, sum);
+    }
+    return _mm512_reduce_add_ps(sum) + HalfL2Scalar<0, BF16>(q + i, v + i, n - i);
+}
+
+template<size_t Dim, bool BF16>
+__attribute__((target("avx512f")))
+float HalfDotAvx512(const float* q, const uint16_t* v, size_t qty) {
+    const size_t n = Dim > 0 ? Dim : qty;
+    __m512 sum = _mm512_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        sum = _mm512_fmadd_ps(_mm512_loadu_ps(q + i), LoadHalfx16<BF16>(v + i), sum);
+    }
+    return _mm512_reduce_add_ps(sum) + HalfDotScalar<0, BF16>(q + i, v + i, n - i);
+}
+
+__attribute__((target("popcnt")))
+float HammingPopcnt(const uint64_t* v1, const uint64_t* v2, size_t num_words) {
+    uint64_t count = 0;
+    for (size_t i = 0; i < num_words; ++i) {
+        count += _mm_popcnt_u64(LoadWord(v1 + i) ^ LoadWord(v2 + i));
+    }
+    return (float)count;
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt")))
+float HammingVpopcntdq(const uint64_t* v1, const uint64_t* v2, size_t num_words) {
+    __m512i count = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= num_words; i += 8) {
+        __m512i x = _mm512_xor_si512(_mm512_loadu_si512(v1 + i), _mm512_loadu_si512(v2 + i));
+        count = _mm512_add_epi64(count, _mm512_popcnt_epi64(x));
+    }
+    return (float)_mm512_reduce_add_epi64(count) + HammingPopcnt(v1 + i, v2 + i, num_words - i);
+}
+
+// VPOPCNTDQ is not part of AVX-512F, so the AVX512 level picks it at runtime.
+float HammingAvx512(const uint64_t* v1, const uint64_t* v2, size_t num_words) {
+    static const bool has_vpopcntdq = __builtin_cpu_supports("avx512vpopcntdq");
+    if (has_vpopcntdq && num_words >= 8) {
+        return HammingVpopcntdq(v1, v2, num_words);
+    }
+    return HammingPopcnt(v1, v2, num_words);
+}
+
+__attribute__((target("avx2,fma")))
+float PQAdcAvx2(const float* lut, const uint8_t* code, size_t num_subspaces) {
+    const __m256i step = _mm256_set1_epi32(8 * 256);
+    __m256i offsets = _mm256_setr_epi32(0, 256, 512, 768, 1024, 1280, 1536, 1792);
+    __m256 sum = _mm256_setzero_ps();
+    size_t m = 0;
+    for (; m + 8 <= num_subspaces; m += 8) {
+        __m256i idx = _mm256_add_epi32(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(code + m))), offsets);
+        sum = _mm256_add_ps(sum, _mm256_i32gather_ps(lut, idx, 4));
+        offsets = _mm256_add_epi32(offsets, step);
+    }
+    return HorizontalSum256(sum) + PQAdcScalar(lut + m * 256, code + m, num_subspaces - m);
+}
+
+__attribute__((target("avx512f")))
+float PQAdcAvx512(const float* lut, const uint8_t* code, size_t num_subspaces) {
+    const __m512i step = _mm512_set1_epi32(16 * 256);
+    __m512i offsets = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                         _mm512_set1_epi32(256));
+    __m512 sum = _mm512_setzero_ps();
+    size_t m = 0;
+    for (; m + 16 <= num_subspaces; m += 16) {
+        __m512i idx = _mm512_add_epi32(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(code + m))), offsets);
+        sum = _mm512_add_ps(sum, _mm512_i32gather_ps(idx, lut, 4));
+        offsets = _mm512_add_epi32(offsets, step);
+    }
+    return _mm512_reduce_add_ps(sum) + PQAdcScalar(lut + m * 256, code + m, num_subspaces - m);
+}
+
+#endif  // N2_X86_KERNELS
+
+template<size_t Dim>
+struct KernelTable {
+    static const DistanceKernels kKernels[];
+};
+
+template<size_t Dim>
+const DistanceKernels KernelTable<Dim>::kKernels[] = {
+    {SimdLevel::SCALAR, L2Scalar<Dim>, DotScalar<Dim>, L2BatchScalar<Dim>, DotBatchScalar<Dim>,
+     L2BoundedScalar<Dim>, SQ8L2Scalar<Dim>, SQ8DotScalar<Dim>, PQAdcScalar,
+     HalfL2Scalar<Dim, false>, HalfDotScalar<Dim, false>, HalfL2Scalar<Dim, true>, HalfDotScalar<Dim, true>,
+     HammingScalar},
+#ifdef N2_X86_KERNELS
+    {SimdLevel::SSE4, L2Sse4<Dim>, DotSse4<Dim>, L2BatchSse4<Dim>, DotBatchSse4<Dim>,
+     L2BoundedSse4<Dim>, SQ8L2Sse4<Dim>, SQ8DotSse4<Dim>, PQAdcScalar,
+     HalfL2Scalar<Dim, false>, HalfDotScalar<Dim, false>, BFloat16L2Sse4<Dim>, BFloat16DotSse4<Dim>,
+     HammingScalar},
+    {SimdLevel::AVX2, L2Avx2<Dim>, DotAvx2<Dim>, L2BatchAvx2<Dim>, DotBatchAvx2<Dim>,
+     L2BoundedAvx2<Dim>, SQ8L2Avx2<Dim>, SQ8DotAvx2<Dim>, PQAdcAvx2,
+     HalfL2Avx2<Dim, false>, HalfDotAvx2<Dim, false>, HalfL2Avx2<Dim, true>, HalfDotAvx2<Dim, true>,
+     HammingPopcnt},
+    {SimdLevel::AVX512, L2Avx512<Dim>, DotAvx512<Dim>, L2BatchAvx512<Dim>, DotBatchAvx512<Dim>,
+     L2BoundedAvx512<Dim>, SQ8L2Avx512<Dim>, SQ8DotAvx512<Dim>, PQAdcAvx512,
+     HalfL2Avx512<Dim, false>, HalfDotAvx512<Dim, false>, HalfL2Avx512<Dim, true>, HalfDotAvx512<Dim, true>,
+     HammingAvx512},
+#endif
+};
+
+const DistanceKernels* FindKernelTable(size_t dim) {
+    switch (dim) {
+#define N2_KERNEL_TABLE_CASE(dim) case dim: return KernelTable<dim>::kKernels;
+        N2_FOR_EACH_SPECIALIZED_DIM(N2_KERNEL_TABLE_CASE)
+#undef N2_KERNEL_TABLE_CASE
+        default: return KernelTable<0>::kKernels;
+    }
+}
+
+SimdLevel GetSupportedSimdLevel() {
+    static const SimdLevel supported = DetectSimdLevel();
+    return supported;
+}
+
+} // namespace
+
+SimdLevel DetectSimdLevel() {
+#ifdef N2_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("popcnt")) {
+        return SimdLevel::AVX512;
+    }
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c")
+        && __builtin_cpu_supports("popcnt")) {
+        return SimdLevel::AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return SimdLevel::SSE4;
+    }
+#endif
+    return SimdLevel::SCALAR;
+}
+
+const DistanceKernels& GetDistanceKernels() {
+    return GetDistanceKernelsForDim(0, GetSupportedSimdLevel());
+}
+
+const DistanceKernels& GetDistanceKernels(SimdLevel level) {
+    return GetDistanceKernelsForDim(0, level);
+}
+
+const DistanceKernels& GetDistanceKernelsForDim(size_t dim) {
+    return GetDistanceKernelsForDim(dim, GetSupportedSimdLevel());
+}
+
+const DistanceKernels& GetDistanceKernelsForDim(size_t dim, SimdLevel level) {
+    if (static_cast<int>(level) > static_cast<int>(GetSupportedSimdLevel())) {
+        level = GetSupportedSimdLevel();
+    }
+    return FindKernelTable(dim)[static_cast<int>(level)];
+}
+
+const char* GetSimdLevelName(SimdLevel level) {
+    switch (level) {
+        case SimdLevel::SSE4: return "sse4";
+        case SimdLevel::AVX2: return "avx2";
+        case SimdLevel::AVX512: return "avx512";
+        default: return "scalar";
+    }
+}
+
+} // namespace n2
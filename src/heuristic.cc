@@ -16,6 +16,7 @@
 
 #include <xmmintrin.h>
 
+#include <algorithm>
 #include <vector>
 
 #include "n2/min_heap.h"
@@ -65,14 +66,24 @@ void HeuristicNeighborSelectingPolicies<DistFuncType>::Select(size_t m, size_t d
         }
 
         bool skip = false;
-        for (size_t j = 0; j < picked.size(); ++j) {
-            if (j < picked.size() - 1) {
-                _mm_prefetch(picked[j+1].GetNode()->GetData(), _MM_HINT_T0);
+        // compare against picked neighbors in blocks, so one batched call reduces a whole block
+        // while an early hit still skips the rest
+        for (size_t j = 0; j < picked.size() && !skip; j += kBatchSize) {
+            size_t num = std::min(kBatchSize, picked.size() - j);
+            const float* vecs[kBatchSize];
+            float dists[kBatchSize];
+            for (size_t b = 0; b < num; ++b) {
+                vecs[b] = picked[j + b].GetNode()->GetData();
             }
-            _mm_prefetch(cur_node->GetData(), _MM_HINT_T1);
-            if (dist_func_(cur_node, picked[j].GetNode(), dim) < cur_dist) {
-                skip = true;
-                break;
+            if (j + num < picked.size()) {
+                _mm_prefetch(picked[j + num].GetNode()->GetData(), _MM_HINT_T0);
+            }
+            dist_func_.Batch(cur_node->GetData(), vecs, num, dim, dists);
+            for (size_t b = 0; b < num; ++b) {
+                if (dists[b] < cur_dist) {
+                    skip = true;
+                    break;
+                }
             }
         }
 
@@ -107,4 +118,13 @@ template class HeuristicNeighborSelectingPolicies<AngularDistance>;
 template class HeuristicNeighborSelectingPolicies<L2Distance>;
 template class HeuristicNeighborSelectingPolicies<DotDistance>;
 
+#define N2_INSTANTIATE_POLICIES(dim) \
+    template class HeuristicNeighborSelectingPolicies<BasicAngularDistance<dim>>; \
+    template class HeuristicNeighborSelectingPolicies<BasicL2Distance<dim>>; \
+    template class HeuristicNeighborSelectingPolicies<BasicDotDistance<dim>>;
+N2_FOR_EACH_SPECIALIZED_DIM(N2_INSTANTIATE_POLICIES)
+#undef N2_INSTANTIATE_POLICIES
+
+template class HeuristicNeighborSelectingPolicies<HammingDistance>;
+
 } // namespace n2
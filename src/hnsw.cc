@@ -13,6 +13,10 @@
 
 #include "n2/hnsw.h"
 
+#include <sys/mman.h>
+
+#include <thread>
+
 namespace n2 {
 
 using std::move;
@@ -22,6 +26,15 @@ using std::string;
 using std::to_string;
 using std::vector;
 
+namespace {
+
+// slot of the idle searcher the calling thread took or returned last, tried first on its next search
+thread_local size_t searcher_slot_hint = 0;
+// shared by all indexes: GetLastSearchStats() reports the last search of the thread on any of them
+thread_local SearchStats last_search_stats;
+
+} // namespace
+
 Hnsw::Hnsw() : Hnsw(0) {}
 
 Hnsw::Hnsw(int dim, string metric) : data_dim_(dim) {
@@ -31,6 +44,8 @@ Hnsw::Hnsw(int dim, string metric) : data_dim_(dim) {
         metric_ = DistanceKind::ANGULAR;
     } else if (metric == "dot") {
         metric_ = DistanceKind::DOT;
+    } else if (metric == "hamming") {
+        metric_ = DistanceKind::HAMMING;
     } else {
         throw runtime_error("[Error] Invalid configuration value for DistanceMethod: " + metric);
     }
@@ -49,7 +64,9 @@ Hnsw& Hnsw::operator=(const Hnsw& other) {
         model_ = other.model_;
         data_dim_ = other.data_dim_;
         metric_ = other.metric_;
-        InitSearcherAndSearcherPool_();
+        visited_set_kind_ = other.visited_set_kind_.load();
+        interleaved_queries_ = other.interleaved_queries_.load();
+        InitSearchers_();
         ensure_k_ = other.ensure_k_;
     }
     return *this;
@@ -57,9 +74,14 @@ Hnsw& Hnsw::operator=(const Hnsw& other) {
 
 Hnsw& Hnsw::operator=(Hnsw&& other) noexcept {
     if (this != &other) {
+        ClearSearchers_();
         model_ = move(other.model_);
-        searcher_ = move(other.searcher_);
-        searcher_pool_ = move(other.searcher_pool_);
+        idle_searchers_ = move(other.idle_searchers_);
+        num_idle_searcher_slots_ = other.num_idle_searcher_slots_;
+        other.num_idle_searcher_slots_ = 0;
+        retired_stats_ = other.retired_stats_;
+        visited_set_kind_ = other.visited_set_kind_.load();
+        interleaved_queries_ = other.interleaved_queries_.load();
         data_dim_ = other.data_dim_;
         metric_ = other.metric_;
         ensure_k_ = other.ensure_k_;
@@ -68,6 +90,7 @@ Hnsw& Hnsw::operator=(Hnsw&& other) noexcept {
 }
 
 Hnsw::~Hnsw() {
+    ClearSearchers_();
 }
 
 void Hnsw::AddData(const vector<float>& data) {
@@ -82,6 +105,18 @@ void Hnsw::AddData(const vector<float>& data) {
     }
 }
 
+void Hnsw::AddBinaryData(const vector<uint8_t>& data) {
+    if (model_ != nullptr) {
+        throw runtime_error("[Error] This index already has a trained model. Adding an item is not allowed.");
+    }
+    if (builder_ == nullptr) {
+        builder_ = HnswBuild::GenerateBuilder(data_dim_, metric_);
+    }
+    if (builder_) {
+        builder_->AddBinaryData(data);
+    }
+}
+
 void Hnsw::SetConfigs(const vector<pair<string, string>>& configs) {
     if (builder_ == nullptr and model_ == nullptr) {
         builder_ = HnswBuild::GenerateBuilder(data_dim_, metric_);
@@ -96,6 +131,29 @@ void Hnsw::SetConfigs(const vector<pair<string, string>>& configs) {
             } else {
                 ensure_k_ = false;
             }
+        } else if (c.first == "VisitedSet") {
+            if (c.second == "epoch32") {
+                visited_set_kind_ = VisitedSetKind::EPOCH32;
+            } else if (c.second == "epoch16") {
+                visited_set_kind_ = VisitedSetKind::EPOCH16;
+            } else if (c.second == "epoch8") {
+                visited_set_kind_ = VisitedSetKind::EPOCH8;
+            } else if (c.second == "hash") {
+                visited_set_kind_ = VisitedSetKind::HASH;
+            } else {
+                throw runtime_error("[Error] Invalid configuration value for VisitedSet: " + c.second);
+            }
+            // searchers in use are switched by ReleaseSearcher_()
+            for (HnswSearch* searcher : TakeIdleSearchers_()) {
+                searcher->SetVisitedSetKind(visited_set_kind_);
+                ReturnSearcher_(searcher);
+            }
+        } else if (c.first == "InterleavedQueries") {
+            int num = std::stoi(c.second);
+            if (num < 1) {
+                throw runtime_error("[Error] Invalid configuration value for InterleavedQueries: " + c.second);
+            }
+            interleaved_queries_ = num;
         }
     }
 }
@@ -109,7 +167,7 @@ void Hnsw::Build(int m, int max_m0, int ef_construction, int n_threads, float mu
         builder_ = HnswBuild::GenerateBuilder(data_dim_, metric_);
     }
     model_ = builder_->Build(m, max_m0, ef_construction, n_threads, mult, neighbor_selecting, graph_merging);
-    InitSearcherAndSearcherPool_();
+    InitSearchers_();
     builder_.reset();
     
     ensure_k_ = ensure_k;
@@ -120,7 +178,7 @@ void Hnsw::Fit() {
         throw runtime_error("[Error] No data to fit. Load data first.");
     }
     model_ = builder_->Build();
-    InitSearcherAndSearcherPool_();
+    InitSearchers_();
     builder_.reset();
 }
 
@@ -129,7 +187,83 @@ bool Hnsw::SaveModel(const string& fname) const {
 }
 
 bool Hnsw::LoadModel(const string& fname, const bool use_mmap) {
-    model_ = HnswModel::LoadModelFromFile(fname, use_mmap);
+    ModelLoadOptions options;
+    options.use_mmap = use_mmap;
+    return LoadModel_(fname, options);
+}
+
+bool Hnsw::LoadModel(const string& fname, const vector<pair<string, string>>& options) {
+    ModelLoadOptions load_options;
+    for (const auto& o : options) {
+        if (o.first == "UseMmap") {
+            if (o.second == "true") {
+                load_options.use_mmap = true;
+            } else if (o.second == "false") {
+                load_options.use_mmap = false;
+            } else {
+                throw runtime_error("[Error] Invalid load option value for UseMmap: " + o.second);
+            }
+        } else if (o.first == "HugePages") {
+            if (o.second == "none") {
+                load_options.huge_pages = HugePages::NONE;
+            } else if (o.second == "thp") {
+                load_options.huge_pages = HugePages::TRANSPARENT;
+            } else if (o.second == "2mb") {
+                load_options.huge_pages = HugePages::HUGETLB_2MB;
+            } else if (o.second == "1gb") {
+                load_options.huge_pages = HugePages::HUGETLB_1GB;
+            } else {
+                throw runtime_error("[Error] Invalid load option value for HugePages: " + o.second);
+            }
+        } else if (o.first == "Populate" || o.first == "Lock" || o.first == "WarmUpperLayers") {
+            if (o.second != "true" && o.second != "false") {
+                throw runtime_error("[Error] Invalid load option value for " + o.first + ": " + o.second);
+            }
+            bool value = (o.second == "true");
+            if (o.first == "Populate") {
+                load_options.populate = value;
+            } else if (o.first == "Lock") {
+                load_options.lock = value;
+            } else {
+                load_options.warm_upper_layers = value;
+            }
+        } else if (o.first == "Advice") {
+            if (o.second == "normal") {
+                load_options.advice = MADV_NORMAL;
+            } else if (o.second == "random") {
+                load_options.advice = MADV_RANDOM;
+            } else if (o.second == "sequential") {
+                load_options.advice = MADV_SEQUENTIAL;
+            } else if (o.second == "willneed") {
+                load_options.advice = MADV_WILLNEED;
+            } else {
+                throw runtime_error("[Error] Invalid load option value for Advice: " + o.second);
+            }
+        } else if (o.first == "LoadThreads") {
+            int num = std::stoi(o.second);
+            if (num < 1) {
+                throw runtime_error("[Error] Invalid load option value for LoadThreads: " + o.second);
+            }
+            load_options.load_threads = num;
+        } else if (o.first == "PrefaultThreads") {
+            int num = std::stoi(o.second);
+            if (num < 0) {
+                throw runtime_error("[Error] Invalid load option value for PrefaultThreads: " + o.second);
+            }
+            load_options.prefault_threads = num;
+        } else {
+            throw runtime_error("[Error] Invalid load option: " + o.first);
+        }
+    }
+    return LoadModel_(fname, load_options);
+}
+
+size_t Hnsw::GetModelHugePageBytes() const {
+    return model_ == nullptr ? 0 : model_->GetHugePageBytes();
+}
+
+bool Hnsw::LoadModel_(const string& fname, const ModelLoadOptions& options) {
+    model_ = HnswModel::LoadModelFromFile(fname, options);
     size_t model_data_dim = model_->GetDataDim();
     if (data_dim_ > 0 && data_dim_ != model_data_dim) {
         throw runtime_error("[Error] index dimension(" + to_string(data_dim_)
@@ -137,7 +271,7 @@ bool Hnsw::LoadModel(const string& fname, const bool use_mmap) {
     }
     data_dim_ = model_data_dim;
     metric_ = model_->GetMetric();
-    InitSearcherAndSearcherPool_();
+    InitSearchers_();
     return true;
 }
 
@@ -145,10 +279,7 @@ void Hnsw::UnloadModel() {
     if (model_ != nullptr) {
         model_.reset();
     }
-    if (searcher_ != nullptr) {
-        searcher_.reset();
-    }
-    searcher_pool_.clear();
+    ClearSearchers_();
 }
 
 void Hnsw::PrintConfigs() const {
@@ -159,11 +290,115 @@ void Hnsw::PrintDegreeDist() const {
     builder_->PrintDegreeDist();
 }
 
-void Hnsw::InitSearcherAndSearcherPool_() {
-    searcher_ = HnswSearch::GenerateSearcher(model_, data_dim_, metric_);
-    searcher_pool_.clear();
-    // the searcher_ is used for both single-thread search and multi-thread(batch) search
-    searcher_pool_.push_back(searcher_);
+const SearchStats& Hnsw::GetLastSearchStats() const {
+    return last_search_stats;
+}
+
+SearchStats Hnsw::GetSearchStats() const {
+    vector<HnswSearch*> searchers = TakeIdleSearchers_();
+    SearchStats stats;
+    {
+        std::lock_guard<std::mutex> lock(retired_stats_mutex_);
+        stats.Add(retired_stats_);
+    }
+    for (HnswSearch* searcher : searchers) {
+        stats.Add(searcher->GetStats());
+        ReturnSearcher_(searcher);
+    }
+    return stats;
+}
+
+void Hnsw::ResetSearchStats() {
+    vector<HnswSearch*> searchers = TakeIdleSearchers_();
+    {
+        std::lock_guard<std::mutex> lock(retired_stats_mutex_);
+        retired_stats_ = SearchStats();
+    }
+    for (HnswSearch* searcher : searchers) {
+        searcher->ResetStats();
+        ReturnSearcher_(searcher);
+    }
+}
+
+void Hnsw::InitSearchers_() {
+    ClearSearchers_();
+    size_t num_slots = 4 * std::thread::hardware_concurrency();
+    num_idle_searcher_slots_ = num_slots > kMinIdleSearcherSlots ? num_slots : kMinIdleSearcherSlots;
+    idle_searchers_.reset(new IdleSearcherSlot[num_idle_searcher_slots_]);
+    idle_searchers_[0].searcher.store(NewSearcher_().release());
+}
+
+void Hnsw::ClearSearchers_() {
+    for (size_t i = 0; i < num_idle_searcher_slots_; ++i) {
+        delete idle_searchers_[i].searcher.exchange(nullptr);
+    }
+    idle_searchers_.reset();
+    num_idle_searcher_slots_ = 0;
+    retired_stats_ = SearchStats();
+}
+
+Hnsw::SearcherLease Hnsw::AcquireSearcher_() {
+    if (idle_searchers_ == nullptr) {
+        throw runtime_error("[Error] No model to search. Build or load a model first.");
+    }
+    // a thread usually gets back the searcher it returned last, whose buffers are still in its cache
+    for (size_t i = 0; i < num_idle_searcher_slots_; ++i) {
+        size_t slot = (searcher_slot_hint + i) % num_idle_searcher_slots_;
+        auto& idle = idle_searchers_[slot].searcher;
+        if (idle.load(std::memory_order_relaxed) != nullptr) {
+            HnswSearch* searcher = idle.exchange(nullptr, std::memory_order_acquire);
+            if (searcher != nullptr) {
+                searcher_slot_hint = slot;
+                return SearcherLease(searcher, SearcherReleaser{this});
+            }
+        }
+    }
+    return SearcherLease(NewSearcher_().release(), SearcherReleaser{this});
+}
+
+std::unique_ptr<HnswSearch> Hnsw::NewSearcher_() const {
+    auto searcher = HnswSearch::GenerateSearcher(model_, data_dim_, metric_);
+    searcher->SetVisitedSetKind(visited_set_kind_);
+    return searcher;
+}
+
+void Hnsw::ReleaseSearcher_(HnswSearch* searcher) {
+    last_search_stats = searcher->GetLastQueryStats();
+    VisitedSetKind visited_set_kind = visited_set_kind_;
+    if (searcher->GetVisitedSetKind() != visited_set_kind) {
+        searcher->SetVisitedSetKind(visited_set_kind);
+    }
+    ReturnSearcher_(searcher);
+}
+
+vector<HnswSearch*> Hnsw::TakeIdleSearchers_() const {
+    vector<HnswSearch*> searchers;
+    for (size_t i = 0; i < num_idle_searcher_slots_; ++i) {
+        HnswSearch* searcher = idle_searchers_[i].searcher.exchange(nullptr, std::memory_order_acquire);
+        if (searcher != nullptr) {
+            searchers.push_back(searcher);
+        }
+    }
+    return searchers;
+}
+
+void Hnsw::ReturnSearcher_(HnswSearch* searcher) const {
+    for (size_t i = 0; i < num_idle_searcher_slots_; ++i) {
+        size_t slot = (searcher_slot_hint + i) % num_idle_searcher_slots_;
+        auto& idle = idle_searchers_[slot].searcher;
+        HnswSearch* empty = nullptr;
+        if (idle.load(std::memory_order_relaxed) == nullptr
+            && idle.compare_exchange_strong(empty, searcher, std::memory_order_release, std::memory_order_relaxed)) {
+            searcher_slot_hint = slot;
+            return;
+        }
+    }
+    // more searches are running at once than there are slots
+    {
+        std::lock_guard<std::mutex> lock(retired_stats_mutex_);
+        retired_stats_.Add(searcher->GetStats());
+    }
+    delete searcher;
 }
 
 } // namespace n2
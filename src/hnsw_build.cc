@@ -14,6 +14,12 @@
 
 #include "n2/hnsw_build.h"
 
+#include <omp.h>
+#include <xmmintrin.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
 #include <iostream>
 #include <limits>
 #include <mutex>
@@ -54,18 +60,31 @@ using std::unique_ptr;
 using std::unordered_set;
 using std::vector;
 
-unique_ptr<HnswBuild> HnswBuild::GenerateBuilder(int dim, DistanceKind metric) {
+template<size_t Dim>
+unique_ptr<HnswBuild> GenerateBuilderWithDim(int dim, DistanceKind metric) {
     if (metric == DistanceKind::ANGULAR) {
-        return make_unique<HnswBuildAngular>(dim, metric);
+        return make_unique<HnswBuildImpl<BasicAngularDistance<Dim>>>(dim, metric);
     } else if (metric == DistanceKind::L2) {
-        return make_unique<HnswBuildL2>(dim, metric);
+        return make_unique<HnswBuildImpl<BasicL2Distance<Dim>>>(dim, metric);
     } else if (metric == DistanceKind::DOT) {
-        return make_unique<HnswBuildDot>(dim, metric);
+        return make_unique<HnswBuildImpl<BasicDotDistance<Dim>>>(dim, metric);
     } else {
         throw runtime_error("[Error] Invalid configuration value for DistanceMethod");
     }
 }
 
+unique_ptr<HnswBuild> HnswBuild::GenerateBuilder(int dim, DistanceKind metric) {
+    if (metric == DistanceKind::HAMMING) {
+        return make_unique<HnswBuildImpl<HammingDistance>>(dim, metric);
+    }
+    switch (dim) {
+#define N2_GENERATE_BUILDER_CASE(dim) case dim: return GenerateBuilderWithDim<dim>(dim, metric);
+        N2_FOR_EACH_SPECIALIZED_DIM(N2_GENERATE_BUILDER_CASE)
+#undef N2_GENERATE_BUILDER_CASE
+        default: return GenerateBuilderWithDim<0>(dim, metric);
+    }
+}
+
 HnswBuild::HnswBuild(int dim, DistanceKind metric) : data_dim_(dim), metric_(metric) {
 }
 
@@ -77,11 +96,26 @@ void HnswBuild::AddData(const vector<float>& data) {
         vector<float> normalized(data_dim_);
         Utils::NormalizeVector(data, normalized);
         data_list_.emplace_back(normalized);
+    } else if (metric_ == DistanceKind::HAMMING) {
+        vector<float> packed;
+        Utils::PackBinaryVector(data, packed);
+        data_list_.emplace_back(packed);
     } else {
         data_list_.emplace_back(data);
     }
 }
 
+void HnswBuild::AddBinaryData(const vector<uint8_t>& data) {
+    if (metric_ != DistanceKind::HAMMING)
+        throw runtime_error("[Error] Binary data can only be added to a hamming index");
+    if (data.size() != (data_dim_ + 7) / 8)
+        throw runtime_error("[Error] Invalid dimension data inserted: " + to_string(data.size() * 8) + 
+                                 " bits, Predefined dimension: " + to_string(data_dim_));
+    vector<float> packed(Utils::GetPackedBinarySize(data_dim_), 0);
+    memcpy(&packed[0], &data[0], data.size());
+    data_list_.emplace_back(packed);
+}
+
 void HnswBuild::SetConfigs(const vector<pair<string, string>>& configs) {
     int m = -1, max_m0 = -1, ef_construction = -1, n_threads = -1;
     float mult = -1;
@@ -117,7 +151,48 @@ void HnswBuild::SetConfigs(const vector<pair<string, string>>& configs) {
             } else {
                 throw runtime_error("[Error] Invalid configuration value for GraphMerging: " + c.second);
             }
-        } else if (c.first == "EnsureK") {
+        } else if (c.first == "VectorStorage") {
+            VectorStorage vector_storage;
+            if (c.second == "float32") {
+                vector_storage = VectorStorage::FLOAT32;
+            } else if (c.second == "sq8") {
+                vector_storage = VectorStorage::SQ8;
+            } else if (c.second == "pq") {
+                vector_storage = VectorStorage::PQ;
+            } else if (c.second == "fp16") {
+                vector_storage = VectorStorage::FP16;
+            } else if (c.second == "bf16") {
+                vector_storage = VectorStorage::BF16;
+            } else {
+                throw runtime_error("[Error] Invalid configuration value for VectorStorage: " + c.second);
+            }
+            if (metric_ == DistanceKind::HAMMING && vector_storage != VectorStorage::FLOAT32)
+                throw runtime_error("[Error] VectorStorage is not configurable for hamming indexes");
+            vector_storage_ = vector_storage;
+        } else if (c.first == "PQSubspaces") {
+            pq_subspaces_ = stoi(c.second);
+            if (pq_subspaces_ == 0 || data_dim_ % pq_subspaces_ != 0)
+                throw runtime_error("[Error] Invalid configuration value for PQSubspaces: " + c.second
+                                    + " (must divide dimension " + to_string(data_dim_) + ")");
+        } else if (c.first == "Reorder") {
+            if (c.second == "none") {
+                reordering_ = GraphReordering::NONE;
+            } else if (c.second == "bfs") {
+                reordering_ = GraphReordering::BFS;
+            } else if (c.second == "rcm") {
+                reordering_ = GraphReordering::RCM;
+            } else {
+                throw runtime_error("[Error] Invalid configuration value for Reorder: " + c.second);
+            }
+        } else if (c.first == "ModelLayout") {
+            if (c.second == "interleaved") {
+                layout_ = ModelLayout::INTERLEAVED;
+            } else if (c.second == "split") {
+                layout_ = ModelLayout::SPLIT;
+            } else {
+                throw runtime_error("[Error] Invalid configuration value for ModelLayout: " + c.second);
+            }
+        } else if (c.first == "EnsureK" || c.first == "VisitedSet" || c.first == "InterleavedQueries") {
         } else {
             throw runtime_error("[Error] Invalid configuration key: " + c.first);
         }
@@ -136,6 +211,21 @@ shared_ptr<const HnswModel> HnswBuild::Build(int m, int max_m0, int ef_construct
 shared_ptr<const HnswModel> HnswBuild::Build() {
     if (data_list_.size() == 0) 
         throw runtime_error("[Error] No data to fit. Load data first.");
+    BuildGraphs();
+
+    auto&& model = HnswModel::GenerateModel(nodes_, enterpoint_->GetId(), max_m_, max_m0_, metric_, 
+                                            max_level_, data_dim_, vector_storage_, pq_subspaces_,
+                                            reordering_, layout_);
+    for (size_t i = 0; i < nodes_.size(); ++i) {
+        delete nodes_[i];
+    }
+    nodes_.clear();
+    data_list_.clear();
+
+    return move(model);
+}
+
+void HnswBuild::BuildGraphs() {
     InitPolicies();
     BuildGraph(false);
     if (post_graph_process_ == GraphPostProcessing::MERGE_LEVEL0) {
@@ -151,16 +241,6 @@ shared_ptr<const HnswModel> HnswBuild::Build() {
         }
         nodes_backup.clear();
     }
-
-    auto&& model = HnswModel::GenerateModel(nodes_, enterpoint_->GetId(), max_m_, max_m0_, metric_, 
-                                            max_level_, data_dim_);
-    for (size_t i = 0; i < nodes_.size(); ++i) {
-        delete nodes_[i];
-    }
-    nodes_.clear();
-    data_list_.clear();
-
-    return move(model);
 }
 
 void HnswBuild::BuildGraph(bool reverse) {
@@ -365,7 +445,9 @@ void HnswBuildImpl<DistFuncType>::SearchAtLayer(HnswNode* qnode, const vector<Hn
             if (visited_list->NotVisited(id)) {
                 _mm_prefetch(neighbor->GetData(), _MM_HINT_T0);
                 visited_list->MarkAsVisited(id);
-                float d = dist_func_(qnode, neighbor, data_dim_);
+                float bound = result.size() < ef_construction_ ? numeric_limits<float>::max()
+                                                               : result.top().GetDistance();
+                float d = BoundedDistance(dist_func_, qnode->GetData(), neighbor->GetData(), data_dim_, bound);
                 if (result.size() < ef_construction_ || result.top().GetDistance() > d) {
                     result.emplace(neighbor, d);
                     candidates.emplace(neighbor, d);
@@ -398,12 +480,15 @@ void HnswBuildImpl<DistFuncType>::Link(HnswNode* source, HnswNode* target, int l
         neighbors.erase(neighbors.begin() + maxi);
     } else {
         priority_queue<FurtherFirst> tempres;
-        for (const auto& neighbor : neighbors) {
-            _mm_prefetch(neighbor->GetData(), _MM_HINT_T0);
+        vector<const float*> vecs(neighbors.size());
+        vector<float> dists(neighbors.size());
+        for (size_t i = 0; i < neighbors.size(); ++i) {
+            vecs[i] = neighbors[i]->GetData();
+            _mm_prefetch(vecs[i], _MM_HINT_T0);
         }
-
-        for (const auto& neighbor : neighbors) {
-            tempres.emplace(neighbor, dist_func_(source, neighbor, data_dim_));
+        dist_func_.Batch(source->GetData(), &vecs[0], vecs.size(), data_dim_, &dists[0]);
+        for (size_t i = 0; i < neighbors.size(); ++i) {
+            tempres.emplace(neighbors[i], dists[i]);
         }
         selecting_policy_->Select(tempres.size() - 1, data_dim_, level == 0, tempres);
         neighbors.clear();
@@ -448,4 +533,13 @@ template class HnswBuildImpl<AngularDistance>;
 template class HnswBuildImpl<L2Distance>;
 template class HnswBuildImpl<DotDistance>;
 
+#define N2_INSTANTIATE_BUILDER(dim) \
+    template class HnswBuildImpl<BasicAngularDistance<dim>>; \
+    template class HnswBuildImpl<BasicL2Distance<dim>>; \
+    template class HnswBuildImpl<BasicDotDistance<dim>>;
+N2_FOR_EACH_SPECIALIZED_DIM(N2_INSTANTIATE_BUILDER)
+#undef N2_INSTANTIATE_BUILDER
+
+template class HnswBuildImpl<HammingDistance>;
+
 } // namespace n2
@@ -14,17 +14,31 @@
 
 #include "n2/hnsw_model.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+
+#include <algorithm>
 #include <cstdint>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 
+#include "n2/distance_kernels.h"
 #include "n2/mmap.h"
+#include "n2/quantization.h"
+#include "n2/thread_pool.h"
 
 namespace n2 {
 
 using std::fstream;
 using std::ifstream;
 using std::make_shared;
+using std::memcpy;
 using std::memset;
 using std::ofstream;
 using std::runtime_error;
@@ -33,90 +47,403 @@ using std::string;
 using std::to_string;
 using std::vector;
 
+const uint64_t HnswModel::kExtendedConfigMagic;
+const size_t HnswModel::kExtendedConfigSize;
+const uint64_t HnswModel::kExtendedConfigVersion;
+const size_t HnswModel::kSectionAlignment;
+
+namespace {
+
+uint64_t AlignUp(uint64_t size, uint64_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+const uint64_t kTransparentHugePageSize = 1ULL << 21;
+// models read into memory are read in chunks of this size, which the load threads take in turn
+const uint64_t kLoadChunkSize = 1ULL << 23;
+
+// returns nullptr on failure, like the nothrow new it replaces; release with free()
+char* AllocateModel(uint64_t size, uint64_t alignment=HnswModel::kSectionAlignment) {
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, alignment, size) != 0) {
+        return nullptr;
+    }
+    return (char*)ptr;
+}
+
+// reads a byte at p, which faults its page in
+inline void Touch(const char* p) {
+    volatile char c = *(const volatile char*)p;
+    (void)c;
+}
+
+void RemapLinks(int* friends_with_size, const vector<int>& new_ids) {
+    for (int j = 1; j <= friends_with_size[0]; ++j) {
+        friends_with_size[j] = new_ids[friends_with_size[j]];
+    }
+}
+
+} // namespace
+
 shared_ptr<const HnswModel> HnswModel::GenerateModel(const vector<HnswNode*> nodes, int enterpoint_id, 
                                                      int max_m, int max_m0, DistanceKind metric, int max_level,
-                                                     size_t data_dim) {
+                                                     size_t data_dim, VectorStorage vector_storage,
+                                                     size_t pq_subspaces, GraphReordering reordering,
+                                                     ModelLayout layout) {
     return shared_ptr<const HnswModel>(
-            new HnswModel(nodes, enterpoint_id, max_m, max_m0, metric, max_level, data_dim));
+            new HnswModel(nodes, enterpoint_id, max_m, max_m0, metric, max_level, data_dim, vector_storage,
+                          pq_subspaces, reordering, layout));
+}
+
+vector<int> HnswModel::GetReorderedNodes(const vector<HnswNode*>& nodes, int enterpoint_id,
+                                         GraphReordering reordering) {
+    vector<int> order;
+    order.reserve(nodes.size());
+    vector<bool> placed(nodes.size(), false);
+    vector<int> next;
+    // nodes unreachable from the enterpoint at level 0 start new searches, lowest id first
+    for (int root = enterpoint_id, unplaced = 0; root >= 0;) {
+        placed[root] = true;
+        order.push_back(root);
+        for (size_t head = order.size() - 1; head < order.size(); ++head) {
+            next.clear();
+            for (HnswNode* f : nodes[order[head]]->GetFriends(0)) {
+                if (!placed[f->GetId()]) {
+                    placed[f->GetId()] = true;
+                    next.push_back(f->GetId());
+                }
+            }
+            if (reordering == GraphReordering::RCM) {
+                std::stable_sort(next.begin(), next.end(), [&nodes](int a, int b) {
+                    return nodes[a]->GetFriends(0).size() < nodes[b]->GetFriends(0).size();
+                });
+            }
+            order.insert(order.end(), next.begin(), next.end());
+        }
+        while (unplaced < (int)nodes.size() && placed[unplaced]) {
+            ++unplaced;
+        }
+        root = unplaced < (int)nodes.size() ? unplaced : -1;
+    }
+    if (reordering == GraphReordering::RCM) {
+        std::reverse(order.begin(), order.end());
+    }
+    return order;
 }
 
 HnswModel::HnswModel(const vector<HnswNode*> nodes, int enterpoint_id, int max_m, int max_m0, DistanceKind metric,
-                     int max_level, size_t data_dim)
-        : enterpoint_id_(enterpoint_id), max_level_(max_level), data_dim_(data_dim), metric_(metric) {
+                     int max_level, size_t data_dim, VectorStorage vector_storage, size_t pq_subspaces,
+                     GraphReordering reordering, ModelLayout layout)
+        : enterpoint_id_(enterpoint_id), max_level_(max_level), data_dim_(data_dim), metric_(metric),
+          vector_storage_(vector_storage), layout_(layout) {
+    extended_config_ = (vector_storage_ != VectorStorage::FLOAT32 || reordering != GraphReordering::NONE
+                        || layout_ != ModelLayout::INTERLEAVED);
+    if (vector_storage_ == VectorStorage::PQ) {
+        pq_subspaces_ = pq_subspaces > 0 ? pq_subspaces : ProductQuantizer::GetDefaultNumSubspaces(data_dim_);
+        if (pq_subspaces_ == 0 || data_dim_ % pq_subspaces_ != 0) {
+            throw runtime_error("[Error] PQSubspaces(" + to_string(pq_subspaces_) + ") must divide dimension("
+                                + to_string(data_dim_) + ")");
+        }
+    }
 
     uint64_t total_level = 0;
     for (const auto& node : nodes) {
         total_level += node->GetLevel();
     }
 
+    vector<int> order;  // node of each record, in AddData() order unless reordered
+    vector<int> new_ids;
+    if (reordering != GraphReordering::NONE) {
+        order = GetReorderedNodes(nodes, enterpoint_id, reordering);
+        new_ids.resize(nodes.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            new_ids[order[i]] = i;
+        }
+        enterpoint_id_ = new_ids[enterpoint_id];
+    }
+
     num_nodes_ = nodes.size();
     uint64_t model_config_size = GetConfigSize();
     memory_per_node_higher_level_ = sizeof(int) * (1 + max_m);  // "1" for saving num_links
     uint64_t higher_level_size = memory_per_node_higher_level_ * total_level;
-    memory_per_data_ = sizeof(float) * data_dim_;
+    if (vector_storage_ == VectorStorage::SQ8) {
+        memory_per_data_ = sizeof(int) * ((data_dim_ + sizeof(int) - 1) / sizeof(int));  // keep records 4-byte aligned
+        codec_params_size_ = ScalarQuantizer::GetParamsSize(data_dim_);
+        memory_per_raw_data_ = sizeof(float) * data_dim_;
+    } else if (vector_storage_ == VectorStorage::PQ) {
+        memory_per_data_ = sizeof(int) * ((pq_subspaces_ + sizeof(int) - 1) / sizeof(int));
+        codec_params_size_ = ProductQuantizer::GetParamsSize(data_dim_);
+        memory_per_raw_data_ = sizeof(float) * data_dim_;
+    } else if (vector_storage_ == VectorStorage::FP16 || vector_storage_ == VectorStorage::BF16) {
+        memory_per_data_ = sizeof(int) * ((sizeof(uint16_t) * data_dim_ + sizeof(int) - 1) / sizeof(int));
+        codec_params_size_ = 0;
+        memory_per_raw_data_ = 0;
+    } else if (metric_ == DistanceKind::HAMMING) {
+        memory_per_data_ = sizeof(uint64_t) * ((data_dim_ + 63) / 64);
+        codec_params_size_ = 0;
+        memory_per_raw_data_ = 0;
+    } else {
+        memory_per_data_ = sizeof(float) * data_dim_;
+        codec_params_size_ = 0;
+        memory_per_raw_data_ = 0;
+    }
     memory_per_link_level0_ = sizeof(int) * (1 + 1 + max_m0);  // "1" for offset pos, "1" for saving num_links
-    memory_per_node_level0_ = memory_per_link_level0_ + memory_per_data_;
+    uint64_t vectors_size = 0;
+    if (layout_ == ModelLayout::SPLIT) {
+        memory_per_node_level0_ = memory_per_link_level0_;
+        memory_per_vector_ = AlignUp(memory_per_data_, kSectionAlignment);
+        vectors_size = memory_per_vector_ * num_nodes_;
+    } else {
+        memory_per_node_level0_ = memory_per_link_level0_ + memory_per_data_;
+        memory_per_vector_ = memory_per_node_level0_;
+    }
     uint64_t level0_size = memory_per_node_level0_ * num_nodes_;
+    uint64_t raw_data_size = memory_per_raw_data_ * num_nodes_;
+    uint64_t id_map_size = order.empty() ? 0 : sizeof(int) * num_nodes_;
+    codec_params_offset_ = model_config_size + level0_size + higher_level_size;
+    if (layout_ == ModelLayout::SPLIT) {
+        vectors_offset_ = AlignUp(codec_params_offset_, kSectionAlignment);
+        codec_params_offset_ = vectors_offset_ + vectors_size;
+    }
+    raw_data_offset_ = codec_params_offset_ + codec_params_size_;
+    id_map_offset_ = id_map_size > 0 ? raw_data_offset_ + raw_data_size : 0;
 
-    model_byte_size_ = model_config_size + level0_size + higher_level_size;
-    model_ = new char[model_byte_size_];
+    model_byte_size_ = raw_data_offset_ + raw_data_size + id_map_size;
+    model_ = AllocateModel(model_byte_size_);
     if (model_ == nullptr)
         throw runtime_error("[Error] Fail to allocate memory for optimised index (size: "
                             + to_string(model_byte_size_ / (1024 * 1024)) + " MBytes)");
 
     memset(model_, 0, model_byte_size_);
     model_level0_ = model_ + model_config_size;
-    model_level0_node_base_offset_ = model_level0_ + memory_per_link_level0_;
+    model_level0_node_base_offset_ = layout_ == ModelLayout::SPLIT ? model_ + vectors_offset_
+                                                                   : model_level0_ + memory_per_link_level0_;
     model_higher_level_ = model_level0_ + level0_size;
-
+    model_codec_params_ = model_ + codec_params_offset_;
+    SetRawDataPointer();
 
     SaveConfigToModel();
+    if (vector_storage_ == VectorStorage::SQ8 || vector_storage_ == VectorStorage::PQ) {
+        vector<const float*> vecs(nodes.size());
+        for (size_t i = 0; i < nodes.size(); ++i) {
+            vecs[i] = nodes[i]->GetData();
+        }
+        if (vector_storage_ == VectorStorage::SQ8) {
+            ScalarQuantizer::Train(vecs, data_dim_, (float*)model_codec_params_);
+        } else {
+            ProductQuantizer::Train(vecs, data_dim_, pq_subspaces_, (float*)model_codec_params_);
+        }
+    }
+
     int higher_offset = 0;
     for (size_t i = 0; i < nodes.size(); ++i) {
-        int level = nodes[i]->GetLevel();
-        if (level > 0) {
-            nodes[i]->CopyDataAndLevel0LinksToOptIndex(model_level0_ + i * memory_per_node_level0_, higher_offset);
-            nodes[i]->CopyHigherLevelLinksToOptIndex(model_higher_level_ + 
-                                                     memory_per_node_higher_level_ * higher_offset, 
-                                                     memory_per_node_higher_level_);
-            higher_offset += nodes[i]->GetLevel();
+        const HnswNode* node = nodes[order.empty() ? i : order[i]];
+        int level = node->GetLevel();
+        char* mem_level0 = model_level0_ + i * memory_per_node_level0_;
+        if (vector_storage_ == VectorStorage::FLOAT32 && layout_ == ModelLayout::INTERLEAVED) {
+            node->CopyDataAndLevel0LinksToOptIndex(mem_level0, level > 0 ? higher_offset : 0);
+        } else if (vector_storage_ == VectorStorage::FLOAT32) {
+            node->CopyLevel0LinksToOptIndex(mem_level0, level > 0 ? higher_offset : 0);
+            memcpy(model_level0_node_base_offset_ + i * memory_per_vector_, node->GetData(), memory_per_data_);
         } else {
-            nodes[i]->CopyDataAndLevel0LinksToOptIndex(model_level0_ + i * memory_per_node_level0_, 0);
+            node->CopyLevel0LinksToOptIndex(mem_level0, level > 0 ? higher_offset : 0);
+            EncodeData(node->GetData(), model_level0_node_base_offset_ + i * memory_per_vector_);
+            if (model_raw_data_ != nullptr) {
+                memcpy(model_raw_data_ + i * memory_per_raw_data_, node->GetData(), memory_per_raw_data_);
+            }
+        }
+        if (!order.empty()) {
+            RemapLinks((int*)(mem_level0 + sizeof(int)), new_ids);
+        }
+        if (level > 0) {
+            char* mem_higher_level = model_higher_level_ + memory_per_node_higher_level_ * higher_offset;
+            node->CopyHigherLevelLinksToOptIndex(mem_higher_level, memory_per_node_higher_level_);
+            for (int l = 0; !order.empty() && l < level; ++l) {
+                RemapLinks((int*)(mem_higher_level + l * memory_per_node_higher_level_), new_ids);
+            }
+            higher_offset += level;
         }
     }
-}
 
-shared_ptr<const HnswModel> HnswModel::LoadModelFromFile(const string& fname, const bool use_mmap) {
-    return shared_ptr<const HnswModel>(new HnswModel(fname, use_mmap));
+    if (id_map_size > 0) {
+        memcpy(model_ + id_map_offset_, &order[0], id_map_size);
+        SetIdMap();
+    }
 }
 
-HnswModel::HnswModel(const std::string& fname, const bool use_mmap) {
-    if(!use_mmap) {
-        ifstream in;
-        in.open(fname, fstream::in|fstream::binary|fstream::ate);
-        if(in.is_open()) {
-            model_byte_size_ = in.tellg();
-            in.seekg(0, fstream::beg);
-            model_ = new char[model_byte_size_];
-            if (model_ == nullptr)
-                throw runtime_error("[Error] Fail to allocate memory for optimised index (size: "
-                                    + to_string(model_byte_size_ / (1024 * 1024)) + " MBytes)");
+shared_ptr<const HnswModel> HnswModel::LoadModelFromFile(const string& fname, const ModelLoadOptions& options) {
+    return shared_ptr<const HnswModel>(new HnswModel(fname, options));
+}
 
-            in.read(model_, model_byte_size_);
-            in.close();
-        } else {
+HnswModel::HnswModel(const std::string& fname, const ModelLoadOptions& options) {
+    // hugetlb pages cannot back a file mapping, so those models are read into memory
+    bool hugetlb = (options.huge_pages == HugePages::HUGETLB_2MB || options.huge_pages == HugePages::HUGETLB_1GB);
+    if(!options.use_mmap || hugetlb) {
+        int fd = open(fname.c_str(), O_RDONLY);
+        if (fd == -1) {
             throw runtime_error("[Error] Failed to load model to file: " + fname+ " not found!");
         }
+        struct stat sbuf;
+        if (fstat(fd, &sbuf) == -1) {
+            close(fd);
+            throw runtime_error("[Error] Failed to read file: " + fname);
+        }
+        model_byte_size_ = sbuf.st_size;
+        AllocateLoadedModel(options.huge_pages);
+        if (model_ == nullptr) {
+            close(fd);
+            throw runtime_error("[Error] Fail to allocate memory for optimised index (size: "
+                                + to_string(model_byte_size_ / (1024 * 1024)) + " MBytes)");
+        }
+        try {
+            ReadModelFile(fd, std::max<size_t>(1, options.load_threads));
+        } catch (...) {
+            close(fd);
+            UnloadModel();
+            throw;
+        }
+        close(fd);
     } else {
-        model_mmap_ = new Mmap(fname.c_str());
+        model_mmap_ = new Mmap(fname.c_str(), options.populate ? MAP_POPULATE : 0);
         model_byte_size_ = model_mmap_->GetFileSize();
         model_ = model_mmap_->GetData();
     }
 
-    LoadConfigFromModel();
+    // the destructor does not run if the constructor throws
+    try {
+        if (model_mmap_ != nullptr) {
+            if (options.huge_pages == HugePages::TRANSPARENT) {
+                madvise(model_, model_byte_size_, MADV_HUGEPAGE);  // a hint: kernels without THP refuse it
+            }
+            if (options.advice != MADV_NORMAL && madvise(model_, model_byte_size_, options.advice) != 0) {
+                throw runtime_error("[Error] madvise failed on model: " + fname);
+            }
+        }
+
+        LoadConfigFromModel();
+
+        if (options.lock) {
+            if (mlock(model_, model_byte_size_) != 0) {
+                throw runtime_error("[Error] Failed to lock model in memory (size: "
+                                    + to_string(model_byte_size_ / (1024 * 1024))
+                                    + " MBytes); check RLIMIT_MEMLOCK");
+            }
+            locked_ = true;
+        }
+        // the upper layers come first, as every query goes through them
+        if (options.warm_upper_layers) {
+            WarmUpperLayers();
+        }
+        if (options.prefault_threads > 0) {
+            Prefault(options.prefault_threads);
+        }
+    } catch (...) {
+        UnloadModel();
+        throw;
+    }
+}
+
+void HnswModel::ReadModelFile(int fd, size_t num_threads) {
+    size_t num_chunks = (model_byte_size_ + kLoadChunkSize - 1) / kLoadChunkSize;
+    // each thread also faults in the pages it reads into, which places them on its NUMA node
+    ThreadPool::GetInstance().ParallelFor(num_chunks, num_threads, [this, fd](size_t begin, size_t end) {
+        uint64_t offset = begin * kLoadChunkSize;
+        uint64_t end_offset = std::min(end * kLoadChunkSize, model_byte_size_);
+        while (offset < end_offset) {
+            ssize_t ret = pread(fd, model_ + offset, end_offset - offset, offset);
+            if (ret > 0) {
+                offset += ret;
+            } else if (ret == 0) {
+                throw runtime_error("[Error] Model file is truncated");
+            } else if (errno != EINTR) {
+                throw runtime_error("[Error] Failed to read model: " + string(strerror(errno)));
+            }
+        }
+    });
+}
+
+void HnswModel::Prefault(size_t num_threads) const {
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    size_t num_pages = (model_byte_size_ + page_size - 1) / page_size;
+    ThreadPool::GetInstance().ParallelFor(num_pages, num_threads, [this, page_size](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Touch(model_ + i * page_size);
+        }
+    });
+}
+
+void HnswModel::WarmUpperLayers() const {
+    uint64_t higher_level_end = layout_ == ModelLayout::SPLIT ? vectors_offset_
+                                : extended_config_ ? codec_params_offset_ : model_byte_size_;
+    uint64_t num_records = (model_ + higher_level_end - model_higher_level_) / memory_per_node_higher_level_;
+    // nodes of the upper layers are the enterpoint and the friends listed there
+    Touch(model_level0_ + enterpoint_id_ * memory_per_node_level0_);
+    Touch(GetLevel0Data(enterpoint_id_));
+    for (uint64_t r = 0; r < num_records; ++r) {
+        const int* friends_with_size = (const int*)(model_higher_level_ + r * memory_per_node_higher_level_);
+        for (int j = 1; j <= friends_with_size[0]; ++j) {
+            Touch(model_level0_ + friends_with_size[j] * memory_per_node_level0_);
+            Touch(GetLevel0Data(friends_with_size[j]));
+        }
+    }
+}
+
+void HnswModel::AllocateLoadedModel(HugePages huge_pages) {
+    if (huge_pages == HugePages::HUGETLB_2MB || huge_pages == HugePages::HUGETLB_1GB) {
+        int page_shift = huge_pages == HugePages::HUGETLB_1GB ? 30 : 21;
+        uint64_t map_size = AlignUp(model_byte_size_, 1ULL << page_shift);
+        // without MAP_NORESERVE the pages are reserved here, so a short pool fails now rather than on access
+        void* ptr = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (page_shift << MAP_HUGE_SHIFT), -1, 0);
+        if (ptr != MAP_FAILED) {
+            model_ = (char*)ptr;
+            model_anonymous_map_size_ = map_size;
+            return;
+        }
+    }
+    if (huge_pages == HugePages::TRANSPARENT) {
+        model_ = AllocateModel(model_byte_size_, kTransparentHugePageSize);
+        if (model_ != nullptr) {
+            madvise(model_, AlignUp(model_byte_size_, kTransparentHugePageSize), MADV_HUGEPAGE);
+        }
+        return;
+    }
+    model_ = AllocateModel(model_byte_size_);
+}
+
+size_t HnswModel::GetHugePageBytes() const {
+    static const char* const kHugePageFields[] = {"AnonHugePages:", "FilePmdMapped:", "ShmemPmdMapped:",
+                                                  "Shared_Hugetlb:", "Private_Hugetlb:"};
+    uintptr_t begin = (uintptr_t)model_, end = begin + model_byte_size_;
+    ifstream smaps("/proc/self/smaps");
+    size_t bytes = 0;
+    bool holds_model = false;
+    string line;
+    while (getline(smaps, line)) {
+        unsigned long vma_begin, vma_end;
+        if (sscanf(line.c_str(), "%lx-%lx ", &vma_begin, &vma_end) == 2) {
+            holds_model = (vma_begin < end && vma_end > begin);
+        } else if (holds_model) {
+            for (const char* field : kHugePageFields) {
+                size_t len = strlen(field);
+                if (line.compare(0, len, field) == 0) {
+                    bytes += std::stoull(line.substr(len)) * 1024;  // in kB
+                }
+            }
+        }
+    }
+    return bytes;
 }
 
 HnswModel::~HnswModel() {
+    UnloadModel();
+}
+
+void HnswModel::UnloadModel() {
+    if (locked_) {
+        locked_ = false;
+        munlock(model_, model_byte_size_);
+    }
     // unload model
     if (model_mmap_ != nullptr) {
         model_mmap_->UnMap();
@@ -126,12 +453,20 @@ HnswModel::~HnswModel() {
         model_higher_level_ = nullptr;
         model_level0_ = nullptr;
         model_level0_node_base_offset_ = nullptr;
+        model_codec_params_ = nullptr;
+        model_raw_data_ = nullptr;
     } else {
-        delete[] model_;
+        if (model_anonymous_map_size_ > 0) {
+            munmap(model_, model_anonymous_map_size_);
+        } else {
+            free(model_);
+        }
         model_ = nullptr;
         model_higher_level_ = nullptr;
         model_level0_ = nullptr;
         model_level0_node_base_offset_ = nullptr;
+        model_codec_params_ = nullptr;
+        model_raw_data_ = nullptr;
     }
 }
 
@@ -154,11 +489,17 @@ size_t HnswModel::GetConfigSize() {
     ret += sizeof(uint64_t);                        // dummy for higher_level_offset_
     ret += sizeof(uint64_t) ;                       // dummy for level0_offset_
     ret -= sizeof(metric_);                         // for old version bug 
+    if (extended_config_) {
+        ret += kExtendedConfigSize;
+    }
     return ret;
 }
 
 void HnswModel::SaveConfigToModel() {
     char* ptr = model_;
+    if (extended_config_) {
+        SetValueAndIncPtr<uint64_t>(ptr, kExtendedConfigMagic);
+    }
     ptr += sizeof(size_t);                                  // dummy for m_
     ptr += sizeof(size_t);                                  // dummy for max_m_
     ptr += sizeof(size_t);                                  // dummy for max_m0_
@@ -173,10 +514,92 @@ void HnswModel::SaveConfigToModel() {
     ptr = SetValueAndIncPtr<uint64_t>(ptr, memory_per_link_level0_);
     ptr = SetValueAndIncPtr<uint64_t>(ptr, memory_per_node_level0_);
     ptr = SetValueAndIncPtr<uint64_t>(ptr, memory_per_node_higher_level_);
+    if (extended_config_) {
+        SaveExtendedConfigToModel(model_ + GetConfigSize() - kExtendedConfigSize);
+    }
+}
+
+void HnswModel::SaveExtendedConfigToModel(char* ptr) {
+    ptr = SetValueAndIncPtr<uint64_t>(ptr, layout_ != ModelLayout::INTERLEAVED ? 3 : id_map_offset_ > 0 ? 2 : 1);
+    ptr = SetValueAndIncPtr<uint64_t>(ptr, (uint64_t)vector_storage_);
+    ptr = SetValueAndIncPtr<uint64_t>(ptr, codec_params_offset_);
+    ptr = SetValueAndIncPtr<uint64_t>(ptr, codec_params_size_);
+    ptr = SetValueAndIncPtr<uint64_t>(ptr, raw_data_offset_);
+    ptr = SetValueAndIncPtr<uint64_t>(ptr, memory_per_raw_data_);
+    ptr = SetValueAndIncPtr<uint64_t>(ptr, pq_subspaces_);
+    ptr = SetValueAndIncPtr<uint64_t>(ptr, 0);  // reserved
+    ptr = SetValueAndIncPtr<uint64_t>(ptr, id_map_offset_);
+    ptr = SetValueAndIncPtr<uint64_t>(ptr, (uint64_t)layout_);
+    ptr = SetValueAndIncPtr<uint64_t>(ptr, vectors_offset_);
+    ptr = SetValueAndIncPtr<uint64_t>(ptr, memory_per_vector_);
+}
+
+void HnswModel::LoadExtendedConfigFromModel(char* ptr) {
+    uint64_t version, vector_storage;
+    ptr = GetValueAndIncPtr<uint64_t>(ptr, version);
+    if (version > kExtendedConfigVersion) {
+        throw runtime_error("[Error] Unsupported model format version: " + to_string(version));
+    }
+    ptr = GetValueAndIncPtr<uint64_t>(ptr, vector_storage);
+    vector_storage_ = (VectorStorage)vector_storage;
+    if (vector_storage_ != VectorStorage::FLOAT32 and vector_storage_ != VectorStorage::SQ8
+        and vector_storage_ != VectorStorage::PQ and vector_storage_ != VectorStorage::FP16
+        and vector_storage_ != VectorStorage::BF16) {
+        throw runtime_error("[Error] Unknown vector storage: " + to_string(vector_storage));
+    }
+    ptr = GetValueAndIncPtr<uint64_t>(ptr, codec_params_offset_);
+    ptr = GetValueAndIncPtr<uint64_t>(ptr, codec_params_size_);
+    ptr = GetValueAndIncPtr<uint64_t>(ptr, raw_data_offset_);
+    ptr = GetValueAndIncPtr<uint64_t>(ptr, memory_per_raw_data_);
+    uint64_t pq_subspaces;
+    ptr = GetValueAndIncPtr<uint64_t>(ptr, pq_subspaces);
+    pq_subspaces_ = pq_subspaces;
+    if (vector_storage_ == VectorStorage::PQ and (pq_subspaces_ == 0 or data_dim_ % pq_subspaces_ != 0)) {
+        throw runtime_error("[Error] Invalid PQSubspaces in model: " + to_string(pq_subspaces_));
+    }
+    uint64_t reserved;
+    ptr = GetValueAndIncPtr<uint64_t>(ptr, reserved);
+    if (reserved != 0) {
+        throw runtime_error("[Error] Unsupported model format");
+    }
+    if (raw_data_offset_ + memory_per_raw_data_ * num_nodes_ > model_byte_size_) {
+        throw runtime_error("[Error] Model file is truncated");
+    }
+    if (version >= 2) {
+        ptr = GetValueAndIncPtr<uint64_t>(ptr, id_map_offset_);
+        if (id_map_offset_ > 0 && id_map_offset_ + sizeof(int) * num_nodes_ > model_byte_size_) {
+            throw runtime_error("[Error] Model file is truncated");
+        }
+    }
+    if (version >= 3) {
+        uint64_t layout;
+        ptr = GetValueAndIncPtr<uint64_t>(ptr, layout);
+        layout_ = (ModelLayout)layout;
+        if (layout_ != ModelLayout::INTERLEAVED and layout_ != ModelLayout::SPLIT) {
+            throw runtime_error("[Error] Unknown model layout: " + to_string(layout));
+        }
+        ptr = GetValueAndIncPtr<uint64_t>(ptr, vectors_offset_);
+        ptr = GetValueAndIncPtr<uint64_t>(ptr, memory_per_vector_);
+    }
+    if (layout_ == ModelLayout::SPLIT) {
+        if (memory_per_node_level0_ != memory_per_link_level0_ or memory_per_vector_ < memory_per_data_
+            or vectors_offset_ % kSectionAlignment != 0 or memory_per_vector_ % kSectionAlignment != 0) {
+            throw runtime_error("[Error] Invalid split layout in model");
+        }
+        if (vectors_offset_ + memory_per_vector_ * num_nodes_ > model_byte_size_) {
+            throw runtime_error("[Error] Model file is truncated");
+        }
+    }
 }
 
 void HnswModel::LoadConfigFromModel() {
+    if (model_byte_size_ < GetConfigSize()) {
+        throw runtime_error("[Error] Model file is truncated");
+    }
     char* ptr = model_;
+    uint64_t magic;
+    GetValueAndIncPtr<uint64_t>(ptr, magic);
+    extended_config_ = (magic == kExtendedConfigMagic);
     ptr += sizeof(size_t);                                  // dummy for m_
     ptr += sizeof(size_t);                                  // dummy for max_m_
     ptr += sizeof(size_t);                                  // dummy for max_m0_
@@ -186,7 +609,8 @@ void HnswModel::LoadConfigFromModel() {
     ptr = GetValueAndIncPtr<int>(ptr, enterpoint_id_);
     ptr = GetValueAndIncPtr<int>(ptr, num_nodes_);
     ptr = GetValueAndIncPtr<DistanceKind>(ptr, metric_);
-    if (metric_ != DistanceKind::ANGULAR and metric_ != DistanceKind::L2 and metric_ != DistanceKind::DOT) {
+    if (metric_ != DistanceKind::ANGULAR and metric_ != DistanceKind::L2 and metric_ != DistanceKind::DOT
+        and metric_ != DistanceKind::HAMMING) {
         throw runtime_error("[Error] Unknown distance metric. metric");
     }
     auto data_dim_bak = data_dim_;
@@ -200,12 +624,87 @@ void HnswModel::LoadConfigFromModel() {
     ptr = GetValueAndIncPtr<uint64_t>(ptr, memory_per_link_level0_);
     ptr = GetValueAndIncPtr<uint64_t>(ptr, memory_per_node_level0_);
     ptr = GetValueAndIncPtr<uint64_t>(ptr, memory_per_node_higher_level_);
+    memory_per_vector_ = memory_per_node_level0_;
 
     uint64_t level0_size = memory_per_node_level0_ * num_nodes_;
     uint64_t model_config_size = GetConfigSize();
+    if (model_config_size + level0_size > model_byte_size_) {
+        throw runtime_error("[Error] Model file is truncated");
+    }
+    if (extended_config_) {
+        LoadExtendedConfigFromModel(model_ + model_config_size - kExtendedConfigSize);
+    }
     model_level0_ = model_ + model_config_size;
-    model_level0_node_base_offset_ = model_level0_ + memory_per_link_level0_;
+    model_level0_node_base_offset_ = layout_ == ModelLayout::SPLIT ? model_ + vectors_offset_
+                                                                   : model_level0_ + memory_per_link_level0_;
     model_higher_level_ = model_level0_ + level0_size;
+    model_codec_params_ = model_ + codec_params_offset_;
+    SetRawDataPointer();
+    if (id_map_offset_ > 0) {
+        SetIdMap();
+    }
+}
+
+void HnswModel::SetIdMap() {
+    external_ids_ = (const int*)(model_ + id_map_offset_);
+    node_ids_.assign(num_nodes_, -1);
+    for (int i = 0; i < num_nodes_; ++i) {
+        int item_id = external_ids_[i];
+        if (item_id < 0 || item_id >= num_nodes_ || node_ids_[item_id] != -1) {
+            throw runtime_error("[Error] Invalid id map in model");
+        }
+        node_ids_[item_id] = i;
+    }
+}
+
+void HnswModel::SetRawDataPointer() {
+    if (vector_storage_ == VectorStorage::FLOAT32) {
+        // float32 models read raw data from the level-0 vectors and keep no raw data section
+        model_raw_data_ = model_level0_node_base_offset_;
+        raw_data_stride_ = memory_per_vector_;
+    } else if (memory_per_raw_data_ > 0) {
+        model_raw_data_ = model_ + raw_data_offset_;
+        raw_data_stride_ = memory_per_raw_data_;
+    } else {
+        model_raw_data_ = nullptr;
+    }
+}
+
+void HnswModel::EncodeData(const float* vec, char* mem_data) const {
+    if (vector_storage_ == VectorStorage::SQ8) {
+        ScalarQuantizer::Encode(vec, (const float*)model_codec_params_, data_dim_, (uint8_t*)mem_data);
+    } else if (vector_storage_ == VectorStorage::PQ) {
+        ProductQuantizer::Encode(vec, (const float*)model_codec_params_, data_dim_, pq_subspaces_,
+                                 (uint8_t*)mem_data);
+    } else if (vector_storage_ == VectorStorage::FP16) {
+        for (size_t i = 0; i < data_dim_; ++i) {
+            ((uint16_t*)mem_data)[i] = FloatToHalf(vec[i]);
+        }
+    } else if (vector_storage_ == VectorStorage::BF16) {
+        for (size_t i = 0; i < data_dim_; ++i) {
+            ((uint16_t*)mem_data)[i] = FloatToBFloat16(vec[i]);
+        }
+    }
+}
+
+void HnswModel::DecodeData(int node_id, float* out) const {
+    const uint16_t* v = (const uint16_t*)GetLevel0Data(node_id);
+    if (vector_storage_ == VectorStorage::FP16) {
+        for (size_t i = 0; i < data_dim_; ++i) {
+            out[i] = HalfToFloat(v[i]);
+        }
+    } else if (vector_storage_ == VectorStorage::BF16) {
+        for (size_t i = 0; i < data_dim_; ++i) {
+            out[i] = BFloat16ToFloat(v[i]);
+        }
+    } else if (metric_ == DistanceKind::HAMMING) {
+        const uint64_t* words = (const uint64_t*)GetData(node_id);
+        for (size_t i = 0; i < data_dim_; ++i) {
+            out[i] = (float)((words[i / 64] >> (i % 64)) & 1);
+        }
+    } else {
+        memcpy(out, GetData(node_id), sizeof(float) * data_dim_);
+    }
 }
 
 
@@ -14,6 +14,8 @@
 
 #include "n2/hnsw_node.h"
 
+#include <cstring>
+
 namespace n2 {
 
 HnswNode::HnswNode(int id, const Data* data, int level, size_t max_m, size_t max_m0)
@@ -33,16 +35,19 @@ void HnswNode::CopyHigherLevelLinksToOptIndex(char* mem_offset, uint64_t memory_
 }
 
 void HnswNode::CopyDataAndLevel0LinksToOptIndex(char* mem_offset, int higher_level_offset) const {
+    char* mem_data = mem_offset;
+    CopyLevel0LinksToOptIndex(mem_data, higher_level_offset);
+    mem_data += (sizeof(int) + sizeof(int) + sizeof(int)*max_m0_);
+    auto& data = data_->GetData();
+    // copied bitwise: binary (hamming) data is bit-packed words carried in the float array
+    memcpy(mem_data, &data[0], sizeof(float) * data.size());
+}
+
+void HnswNode::CopyLevel0LinksToOptIndex(char* mem_offset, int higher_level_offset) const {
     char* mem_data = mem_offset;
     *((int*)(mem_data)) = higher_level_offset;
     mem_data += sizeof(int);
     CopyLinksToOptIndex(mem_data, 0);
-    mem_data += (sizeof(int) + sizeof(int)*max_m0_);
-    auto& data = data_->GetData();
-    for (size_t i = 0; i < data.size(); ++i) {
-        *((float*)(mem_data)) = (float)data[i];
-        mem_data += sizeof(float);
-    }
 }
 
 void HnswNode::CopyLinksToOptIndex(char* mem_offset, int level) const {
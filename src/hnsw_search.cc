@@ -16,10 +16,25 @@
 
 #include <xmmintrin.h>
 
+#include <algorithm>
+#include <type_traits>
+
 #include "n2/max_heap.h"
 #include "n2/min_heap.h"
+#include "n2/quantization.h"
 #include "n2/utils.h"
 
+// N2_SEARCH_STATS=0 compiles the search counters (SearchStats) out
+#ifndef N2_SEARCH_STATS
+#define N2_SEARCH_STATS 1
+#endif
+
+#if N2_SEARCH_STATS
+#define N2_COUNT_STAT(expr) (expr)
+#else
+#define N2_COUNT_STAT(expr) ((void)0)
+#endif
+
 namespace n2 {
 
 using std::numeric_limits;
@@ -30,64 +45,508 @@ using std::shared_ptr;
 using std::unique_ptr;
 using std::vector;
 
-unique_ptr<HnswSearch> HnswSearch::GenerateSearcher(shared_ptr<const HnswModel> model, size_t data_dim,
-                                                    DistanceKind metric) {
+template<size_t Dim>
+unique_ptr<HnswSearch> GenerateSearcherWithDim(shared_ptr<const HnswModel> model, size_t data_dim,
+                                               DistanceKind metric) {
     if (metric == DistanceKind::ANGULAR) {
-        return make_unique<HnswSearchAngular>(model, data_dim, metric);
+        return make_unique<HnswSearchImpl<BasicAngularDistance<Dim>>>(model, data_dim, metric);
     } else if (metric == DistanceKind::L2) {
-        return make_unique<HnswSearchL2>(model, data_dim, metric);
+        return make_unique<HnswSearchImpl<BasicL2Distance<Dim>>>(model, data_dim, metric);
     } else if (metric == DistanceKind::DOT) {
-        return make_unique<HnswSearchDot>(model, data_dim, metric);
+        return make_unique<HnswSearchImpl<BasicDotDistance<Dim>>>(model, data_dim, metric);
     } else {
         throw runtime_error("[Error] Invalid configuration value for DistanceMethod");
     }
 }
 
+unique_ptr<HnswSearch> GenerateSQ8Searcher(shared_ptr<const HnswModel> model, size_t data_dim,
+                                           DistanceKind metric) {
+    if (metric == DistanceKind::ANGULAR) {
+        return make_unique<HnswSearchImpl<SQ8AngularDistance>>(model, data_dim, metric);
+    } else if (metric == DistanceKind::L2) {
+        return make_unique<HnswSearchImpl<SQ8L2Distance>>(model, data_dim, metric);
+    } else if (metric == DistanceKind::DOT) {
+        return make_unique<HnswSearchImpl<SQ8DotDistance>>(model, data_dim, metric);
+    } else {
+        throw runtime_error("[Error] Invalid configuration value for DistanceMethod");
+    }
+}
+
+unique_ptr<HnswSearch> GeneratePQSearcher(shared_ptr<const HnswModel> model, size_t data_dim,
+                                          DistanceKind metric) {
+    if (metric == DistanceKind::ANGULAR) {
+        return make_unique<HnswSearchImpl<PQAngularDistance>>(model, data_dim, metric);
+    } else if (metric == DistanceKind::L2) {
+        return make_unique<HnswSearchImpl<PQL2Distance>>(model, data_dim, metric);
+    } else if (metric == DistanceKind::DOT) {
+        return make_unique<HnswSearchImpl<PQDotDistance>>(model, data_dim, metric);
+    } else {
+        throw runtime_error("[Error] Invalid configuration value for DistanceMethod");
+    }
+}
+
+template<VectorStorage Storage>
+unique_ptr<HnswSearch> GenerateHalfSearcher(shared_ptr<const HnswModel> model, size_t data_dim,
+                                            DistanceKind metric) {
+    if (metric == DistanceKind::ANGULAR) {
+        return make_unique<HnswSearchImpl<HalfAngularDistance<Storage>>>(model, data_dim, metric);
+    } else if (metric == DistanceKind::L2) {
+        return make_unique<HnswSearchImpl<HalfL2Distance<Storage>>>(model, data_dim, metric);
+    } else if (metric == DistanceKind::DOT) {
+        return make_unique<HnswSearchImpl<HalfDotDistance<Storage>>>(model, data_dim, metric);
+    } else {
+        throw runtime_error("[Error] Invalid configuration value for DistanceMethod");
+    }
+}
+
+unique_ptr<HnswSearch> HnswSearch::GenerateSearcher(shared_ptr<const HnswModel> model, size_t data_dim,
+                                                    DistanceKind metric) {
+    if (metric == DistanceKind::HAMMING) {
+        return make_unique<HnswSearchImpl<HammingDistance>>(model, data_dim, metric);
+    }
+    if (model->GetVectorStorage() == VectorStorage::SQ8) {
+        return GenerateSQ8Searcher(model, data_dim, metric);
+    } else if (model->GetVectorStorage() == VectorStorage::PQ) {
+        return GeneratePQSearcher(model, data_dim, metric);
+    } else if (model->GetVectorStorage() == VectorStorage::FP16) {
+        return GenerateHalfSearcher<VectorStorage::FP16>(model, data_dim, metric);
+    } else if (model->GetVectorStorage() == VectorStorage::BF16) {
+        return GenerateHalfSearcher<VectorStorage::BF16>(model, data_dim, metric);
+    }
+    switch (data_dim) {
+#define N2_GENERATE_SEARCHER_CASE(dim) case dim: return GenerateSearcherWithDim<dim>(model, data_dim, metric);
+        N2_FOR_EACH_SPECIALIZED_DIM(N2_GENERATE_SEARCHER_CASE)
+#undef N2_GENERATE_SEARCHER_CASE
+        default: return GenerateSearcherWithDim<0>(model, data_dim, metric);
+    }
+}
+
 template<typename DistFuncType>
 HnswSearchImpl<DistFuncType>::HnswSearchImpl(shared_ptr<const HnswModel> model, size_t data_dim, DistanceKind metric)
-        : model_(model), data_dim_(data_dim), metric_(metric), normalized_vec_(data_dim) {
-    visited_list_ = make_unique<VisitedList>(model->GetNumNodes());
+        : model_(model), visited_set_(model->GetNumNodes()), data_dim_(data_dim), metric_(metric),
+          exact_kernels_(GetDistanceKernels()),
+          normalized_vec_(std::max(data_dim, Utils::GetPackedBinarySize(data_dim))) {
+    dist_func_.Bind(*model_);
+    needs_rerank_ = (model_->GetVectorStorage() == VectorStorage::SQ8
+                     || model_->GetVectorStorage() == VectorStorage::PQ);
 
     model_higher_level_ = model_->model_higher_level_;
     model_level0_ = model_->model_level0_;
     model_level0_node_base_offset_ = model_->model_level0_node_base_offset_;
     memory_per_node_level0_ = model_->memory_per_node_level0_;
+    memory_per_vector_ = model_->memory_per_vector_;
     memory_per_node_higher_level_ = model_->memory_per_node_higher_level_;
+
+    size_t max_degree = std::max(model_->memory_per_link_level0_ / sizeof(int) - 2,
+                                 memory_per_node_higher_level_ / sizeof(int) - 1);
+    batch_ids_.resize(max_degree);
+    batch_vecs_.resize(max_degree);
+    batch_dists_.resize(max_degree);
 }
 
 template<typename DistFuncType>
 void HnswSearchImpl<DistFuncType>::SearchByVector(const vector<float>& qvec, size_t k, int ef_search, 
                                                   bool ensure_k, vector<int>& result) {
-    SearchByVector_(qvec, k, ef_search, ensure_k, result);
+    SearchByVector_(qvec.data(), k, ef_search, ensure_k, result);
 }
 
 template<typename DistFuncType>
 void HnswSearchImpl<DistFuncType>::SearchByVector(const vector<float>& qvec, size_t k, int ef_search, 
                                                   bool ensure_k, vector<pair<int, float>>& result) {
-    SearchByVector_(qvec, k, ef_search, ensure_k, result);
+    SearchByVector_(qvec.data(), k, ef_search, ensure_k, result);
+}
+
+template<typename DistFuncType>
+size_t HnswSearchImpl<DistFuncType>::SearchByVector(const float* qvec, size_t k, int ef_search, bool ensure_k,
+                                                    int* ids, float* distances, size_t capacity) {
+    result_buf_.clear();
+    SearchByVector_(qvec, std::min(k, capacity), ef_search, ensure_k, result_buf_);
+    return CopyResultBuf_(ids, distances, capacity);
+}
+
+template<typename DistFuncType>
+size_t HnswSearchImpl<DistFuncType>::SearchById(int id, size_t k, int ef_search, int* ids, float* distances,
+                                                size_t capacity) {
+    k = std::min(k, capacity);
+    if (ef_search < 0) {
+        ef_search = 50 * k;
+    }
+    result_buf_.clear();
+    N2_COUNT_STAT(BeginQuery_());
+    id = model_->GetNodeId(id);
+    rerank_query_ = GetDataOf_(id);
+    SearchById_(id, 0.0, dist_func_.PrepareQuery(rerank_query_, data_dim_), k, ef_search, false, result_buf_);
+    N2_COUNT_STAT(EndQuery_());
+    return CopyResultBuf_(ids, distances, capacity);
+}
+
+template<typename DistFuncType>
+void HnswSearchImpl<DistFuncType>::SearchByVectors(const float* const* qvecs, size_t num_queries, size_t k,
+                                                   int ef_search, size_t num_in_flight, int* ids,
+                                                   float* distances) {
+    if (ef_search < 0)
+        ef_search = 50 * k;
+    if ((size_t)ef_search < k) {
+        // SearchByIdV1_() is not interleaved
+        for (size_t i = 0; i < num_queries; ++i) {
+            float* row_distances = distances != nullptr ? distances + i * k : nullptr;
+            size_t num = SearchByVector(qvecs[i], k, ef_search, false, ids + i * k, row_distances, k);
+            std::fill(ids + i * k + num, ids + (i + 1) * k, -1);
+            if (row_distances != nullptr) std::fill(row_distances + num, row_distances + k, -1.0f);
+        }
+        return;
+    }
+
+    size_t num_running = std::min(num_queries, std::max<size_t>(1, num_in_flight));
+    while (interleaved_queries_.size() < num_running) {
+        interleaved_queries_.emplace_back(new InterleavedQuery(dist_func_, model_->GetNumNodes(),
+                                                               visited_set_.GetKind(), batch_ids_.size(),
+                                                               normalized_vec_.size()));
+    }
+    // queries [0, num_running) of interleaved_queries_ are in flight
+    size_t next = 0;
+    auto start_next = [&](InterleavedQuery& q) {
+        while (next < num_queries) {
+            size_t i = next++;
+            if (StartInterleavedQuery_(q, i, qvecs[i], ef_search)) {
+                return true;
+            }
+            FinishInterleavedQuery_(q, k, ids, distances);
+        }
+        return false;
+    };
+    for (size_t j = 0; j < num_running;) {
+        if (start_next(*interleaved_queries_[j])) {
+            ++j;
+        } else {
+            --num_running;
+        }
+    }
+    while (num_running > 0) {
+        for (size_t j = 0; j < num_running;) {
+            InterleavedQuery& q = *interleaved_queries_[j];
+            if (StepInterleavedQuery_(q, ef_search)) {
+                ++j;
+                continue;
+            }
+            FinishInterleavedQuery_(q, k, ids, distances);
+            if (start_next(q)) {
+                ++j;
+            } else {
+                std::swap(interleaved_queries_[j], interleaved_queries_[--num_running]);
+            }
+        }
+    }
+}
+
+template<typename DistFuncType>
+bool HnswSearchImpl<DistFuncType>::StartInterleavedQuery_(InterleavedQuery& q, size_t index, const float* qvec,
+                                                          size_t ef_search) {
+    q.index = index;
+    N2_COUNT_STAT(q.stats = SearchStats());
+    q.qraw = PrepareQuery_(qvec, q.dist_func, &q.normalized_vec[0], q.rerank_query);
+    q.cur_node_id = model_->GetEnterpointId();
+    const DataType* vec = GetLevel0Data_(q.cur_node_id);
+    q.cur_dist = q.dist_func(q.qraw, vec, data_dim_);
+    N2_COUNT_STAT(++q.stats.num_distances);
+
+    q.level = model_->GetMaxLevel();
+    if (q.level > 0) {
+        q.visited_set.Reset();
+        q.visited_set.Insert(q.cur_node_id);
+        q.changed = false;
+        _mm_prefetch(model_level0_ + q.cur_node_id * memory_per_node_level0_, _MM_HINT_T0);
+        q.step = InterleavedQuery::Step::NODE;
+        return true;
+    }
+    StartInterleavedLevel0_(q, ef_search);
+    return ExpandNextCandidate_(q, ef_search);
+}
+
+template<typename DistFuncType>
+inline bool HnswSearchImpl<DistFuncType>::StepInterleavedQuery_(InterleavedQuery& q, size_t ef_search) {
+    using Step = typename InterleavedQuery::Step;
+    switch (q.step) {
+    case Step::NODE: {
+        N2_COUNT_STAT(++q.stats.hops[std::min((size_t)q.level, SearchStats::kMaxLevels - 1)]);
+        int offset = *((int*)(model_level0_ + q.cur_node_id * memory_per_node_level0_));
+        q.friends_with_size = (const int*)(model_higher_level_
+                                           + (offset + q.level - 1) * memory_per_node_higher_level_);
+        _mm_prefetch(q.friends_with_size, _MM_HINT_T0);
+        q.step = Step::FRIENDS;
+        return true;
+    }
+    case Step::FRIENDS: {
+        int size = q.friends_with_size[0];
+        for (auto j = 1; j <= size; ++j) {
+            q.visited_set.Prefetch(q.friends_with_size[j]);
+        }
+        q.step = Step::GATHER;
+        return true;
+    }
+    case Step::GATHER: {
+        int size = q.friends_with_size[0];
+        size_t num = 0;
+        for (auto j = 1; j <= size; ++j) {
+            int node_id = q.friends_with_size[j];
+            if (q.visited_set.Insert(node_id)) {
+                const DataType* vec = GetLevel0Data_(node_id);
+                _mm_prefetch(vec, _MM_HINT_NTA);
+                q.batch_ids[num] = node_id;
+                q.batch_vecs[num] = vec;
+                ++num;
+            }
+        }
+        q.num_gathered = num;
+        N2_COUNT_STAT(q.stats.num_distances += num);
+        N2_COUNT_STAT(q.stats.num_visited += num);
+        q.step = Step::DISTANCES;
+        return true;
+    }
+    case Step::DISTANCES:
+        break;
+    }
+
+    if (q.level > 0) {
+        BoundedBatchDistance(q.dist_func, q.qraw, &q.batch_vecs[0], q.num_gathered, data_dim_, q.cur_dist,
+                             &q.batch_dists[0]);
+        for (size_t j = 0; j < q.num_gathered; ++j) {
+            if (q.batch_dists[j] < q.cur_dist) {
+                q.cur_dist = q.batch_dists[j];
+                q.cur_node_id = q.batch_ids[j];
+                q.changed = true;
+            }
+        }
+        if (!q.changed && --q.level > 0) {
+            q.visited_set.Reset();
+            q.visited_set.Insert(q.cur_node_id);
+        }
+        if (q.level > 0) {
+            q.changed = false;
+            _mm_prefetch(model_level0_ + q.cur_node_id * memory_per_node_level0_, _MM_HINT_T0);
+            q.step = Step::NODE;
+            return true;
+        }
+        StartInterleavedLevel0_(q, ef_search);
+        return ExpandNextCandidate_(q, ef_search);
+    }
+
+    // same admission as SearchByIdV2_()
+    float bound = q.found_distances.size() < ef_search ? numeric_limits<float>::max() : q.found_distances.top();
+    BoundedBatchDistance(q.dist_func, q.qraw, &q.batch_vecs[0], q.num_gathered, data_dim_, bound,
+                         &q.batch_dists[0]);
+    for (size_t j = 0; j < q.num_gathered; ++j) {
+        float d = q.batch_dists[j];
+        if (q.found_distances.size() < ef_search || d < q.found_distances.top()) {
+            q.candidates.emplace(q.batch_ids[j], d);
+            N2_COUNT_STAT(++q.stats.num_heap_pushes);
+            q.found_distances.emplace(d);
+            if (q.found_distances.size() > ef_search) {
+                q.found_distances.pop();
+            }
+        }
+    }
+    return ExpandNextCandidate_(q, ef_search);
+}
+
+template<typename DistFuncType>
+void HnswSearchImpl<DistFuncType>::StartInterleavedLevel0_(InterleavedQuery& q, size_t ef_search) {
+    q.candidates.clear();
+    q.visited_nodes.clear();
+    q.found_distances.clear();
+    q.found_distances.reserve(ef_search + 1);
+    q.candidates.emplace(q.cur_node_id, q.cur_dist);
+    N2_COUNT_STAT(++q.stats.num_heap_pushes);
+    q.found_distances.emplace(q.cur_dist);
+    q.visited_set.Reset();
+    q.visited_set.Insert(q.cur_node_id);
+}
+
+template<typename DistFuncType>
+inline bool HnswSearchImpl<DistFuncType>::ExpandNextCandidate_(InterleavedQuery& q, size_t ef_search) {
+    if (q.candidates.empty()) {
+        return false;
+    }
+    const IdDistancePair& c = q.candidates.top();
+    if (q.found_distances.size() >= ef_search && c.second > q.found_distances.top()) {
+        return false;
+    }
+    int cur_node_id = c.first;
+    q.visited_nodes.emplace(std::move(const_cast<IdDistancePair&>(c)));
+    q.candidates.pop();
+    N2_COUNT_STAT(++q.stats.hops[0]);
+
+    q.friends_with_size = (const int*)(model_level0_ + cur_node_id * memory_per_node_level0_ + sizeof(int));
+    _mm_prefetch(q.friends_with_size, _MM_HINT_T0);
+    q.step = InterleavedQuery::Step::FRIENDS;
+    return true;
+}
+
+template<typename DistFuncType>
+void HnswSearchImpl<DistFuncType>::FinishInterleavedQuery_(InterleavedQuery& q, size_t k, int* ids,
+                                                           float* distances) {
+    N2_COUNT_STAT(query_stats_ = q.stats);
+    N2_COUNT_STAT(query_stats_.ef_used += q.found_distances.size());
+    rerank_query_ = q.rerank_query;
+    result_buf_.clear();
+    MakeSearchResult(k, q.candidates, q.visited_nodes, result_buf_);
+    N2_COUNT_STAT(EndQuery_());
+
+    int* row_ids = ids + q.index * k;
+    float* row_distances = distances != nullptr ? distances + q.index * k : nullptr;
+    size_t num = CopyResultBuf_(row_ids, row_distances, k);
+    std::fill(row_ids + num, row_ids + k, -1);
+    if (row_distances != nullptr) std::fill(row_distances + num, row_distances + k, -1.0f);
+}
+
+template<typename DistFuncType>
+void HnswSearchImpl<DistFuncType>::SearchByVector(const vector<float>& qvec, size_t k, int ef_search,
+                                                  const SearchFilter& filter, vector<int>& result) {
+    SearchByVector_(qvec.data(), k, ef_search, filter, result);
+}
+
+template<typename DistFuncType>
+void HnswSearchImpl<DistFuncType>::SearchByVector(const vector<float>& qvec, size_t k, int ef_search,
+                                                  const SearchFilter& filter, vector<pair<int, float>>& result) {
+    SearchByVector_(qvec.data(), k, ef_search, filter, result);
+}
+
+template<typename DistFuncType>
+void HnswSearchImpl<DistFuncType>::SearchById(int id, size_t k, int ef_search, const SearchFilter& filter,
+                                              vector<int>& result) {
+    if (ef_search < 0) {
+        ef_search = 50 * k;
+    }
+    N2_COUNT_STAT(BeginQuery_());
+    id = model_->GetNodeId(id);
+    rerank_query_ = GetDataOf_(id);
+    SearchById_(id, 0.0, dist_func_.PrepareQuery(rerank_query_, data_dim_), k, ef_search, filter, result);
+    N2_COUNT_STAT(EndQuery_());
+}
+
+template<typename DistFuncType>
+void HnswSearchImpl<DistFuncType>::SearchById(int id, size_t k, int ef_search, const SearchFilter& filter,
+                                              vector<pair<int, float>>& result) {
+    if (ef_search < 0) {
+        ef_search = 50 * k;
+    }
+    N2_COUNT_STAT(BeginQuery_());
+    id = model_->GetNodeId(id);
+    rerank_query_ = GetDataOf_(id);
+    SearchById_(id, 0.0, dist_func_.PrepareQuery(rerank_query_, data_dim_), k, ef_search, filter, result);
+    N2_COUNT_STAT(EndQuery_());
+}
+
+template<typename DistFuncType>
+size_t HnswSearchImpl<DistFuncType>::CopyResultBuf_(int* ids, float* distances, size_t capacity) const {
+    size_t num = std::min(result_buf_.size(), capacity);
+    for (size_t i = 0; i < num; ++i) {
+        if (ids != nullptr) ids[i] = result_buf_[i].first;
+        if (distances != nullptr) distances[i] = result_buf_[i].second;
+    }
+    return num;
+}
+
+template<typename DistFuncType>
+template<typename ResultType>
+void HnswSearchImpl<DistFuncType>::SearchByVector_(const float* qvec, size_t k, int ef_search, bool ensure_k,
+                                                   ResultType& result) {
+    if (ef_search < 0)
+        ef_search = 50 * k;
+
+    N2_COUNT_STAT(BeginQuery_());
+    const float* qraw = PrepareQuery_(qvec);
+    float cur_dist = 0;
+    int cur_node_id = SearchUpperLayers_(qraw, ensure_k, cur_dist);
+    CallSearchById_(cur_node_id, cur_dist, qraw, k, ef_search, ensure_k, result);
+    N2_COUNT_STAT(EndQuery_());
 }
 
 template<typename DistFuncType>
 template<typename ResultType>
-void HnswSearchImpl<DistFuncType>::SearchByVector_(const vector<float>& qvec, size_t k, int ef_search, 
-                                                   bool ensure_k, ResultType& result) {
+void HnswSearchImpl<DistFuncType>::SearchByVector_(const float* qvec, size_t k, int ef_search,
+                                                   const SearchFilter& filter, ResultType& result) {
     if (ef_search < 0)
         ef_search = 50 * k;
 
+    N2_COUNT_STAT(BeginQuery_());
+    const float* qraw = PrepareQuery_(qvec);
+    if (filter.GetAllowlist() != nullptr && filter.GetNumAllowed() <= (size_t)ef_search) {
+        SearchAllowlist_(qraw, k, filter, result);
+    } else {
+        float cur_dist = 0;
+        int cur_node_id = SearchUpperLayers_(qraw, false, cur_dist);
+        SearchByIdV2_(cur_node_id, cur_dist, qraw, k, std::max(k, (size_t)ef_search), false, result,
+                      NodeIdSearchFilter{filter, *model_});
+    }
+    N2_COUNT_STAT(EndQuery_());
+}
+
+template<typename DistFuncType>
+template<typename ResultType>
+void HnswSearchImpl<DistFuncType>::SearchById_(int cur_node_id, float cur_dist, const float* qraw, size_t k,
+                                               size_t ef_search, const SearchFilter& filter, ResultType& result) {
+    if (filter.GetAllowlist() != nullptr && filter.GetNumAllowed() <= ef_search) {
+        SearchAllowlist_(qraw, k, filter, result);
+    } else {
+        SearchByIdV2_(cur_node_id, cur_dist, qraw, k, std::max(k, ef_search), false, result,
+                      NodeIdSearchFilter{filter, *model_});
+    }
+}
+
+template<typename DistFuncType>
+template<typename ResultType>
+void HnswSearchImpl<DistFuncType>::SearchAllowlist_(const float* qraw, size_t k, const SearchFilter& filter,
+                                                    ResultType& result) {
+    IdDistancePairMinHeap& candidates = candidates_;
+    IdDistancePairMinHeap& visited_nodes = visited_nodes_;
+    candidates.clear();
+    visited_nodes.clear();
+
+    const uint64_t* allowlist = filter.GetAllowlist();
+    size_t num_ids = std::min(filter.GetNumBits(), (size_t)model_->GetNumNodes());
+    for (size_t w = 0; w < (num_ids + 63) / 64; ++w) {
+        for (uint64_t word = allowlist[w]; word != 0; word &= word - 1) {
+            size_t id = w * 64 + __builtin_ctzll(word);
+            if (id >= num_ids) {
+                break;
+            }
+            int node_id = model_->GetNodeId(id);
+            const DataType* vec = GetLevel0Data_(node_id);
+            visited_nodes.emplace(node_id, dist_func_(qraw, vec, data_dim_));
+        }
+    }
+    N2_COUNT_STAT(query_stats_.num_distances += visited_nodes.size());
+
+    MakeSearchResult(k, candidates, visited_nodes, result);
+}
+
+template<typename DistFuncType>
+const float* HnswSearchImpl<DistFuncType>::PrepareQuery_(const float* qvec, DistFuncType& dist_func,
+                                                         float* normalized_vec, const float*& rerank_query) const {
     const float* qraw = nullptr;
     if (metric_ == DistanceKind::ANGULAR) {
-        Utils::NormalizeVector(qvec, normalized_vec_);
-        qraw = &normalized_vec_[0];
+        Utils::NormalizeVector(qvec, data_dim_, normalized_vec);
+        qraw = normalized_vec;
+    } else if (metric_ == DistanceKind::HAMMING) {
+        Utils::PackBinaryVector(qvec, data_dim_, normalized_vec);
+        qraw = normalized_vec;
     } else {
-        qraw = &qvec[0];
+        qraw = qvec;
     }
+    rerank_query = qraw;
+    return dist_func.PrepareQuery(qraw, data_dim_);
+}
 
+template<typename DistFuncType>
+int HnswSearchImpl<DistFuncType>::SearchUpperLayers_(const float* qraw, bool ensure_k, float& cur_dist) {
     _mm_prefetch(qraw, _MM_HINT_T0);
     int cur_node_id = model_->GetEnterpointId();
-    const float* vec = (const float*)(model_level0_node_base_offset_ + cur_node_id * memory_per_node_level0_);
+    const DataType* vec = GetLevel0Data_(cur_node_id);
     _mm_prefetch(vec, _MM_HINT_NTA);
-    float cur_dist = dist_func_(qraw, vec, data_dim_);
-            
+    cur_dist = dist_func_(qraw, vec, data_dim_);
+    N2_COUNT_STAT(++query_stats_.num_distances);
+
     if (ensure_k) {
         ensure_k_path_.clear();
         ensure_k_path_.emplace_back(cur_node_id, cur_dist);
@@ -95,14 +554,13 @@ void HnswSearchImpl<DistFuncType>::SearchByVector_(const vector<float>& qvec, si
 
     bool changed;
     for (auto i = model_->GetMaxLevel(); i > 0; --i) {
-        visited_list_->Reset();
-        unsigned int visited_mark = visited_list_->GetVisitMark();
-        unsigned int* visited = visited_list_->GetVisited();
-        visited[cur_node_id] = visited_mark;
+        visited_set_.Reset();
+        visited_set_.Insert(cur_node_id);
         
         changed = true;
         while (changed) {
             changed = false;
+            N2_COUNT_STAT(++query_stats_.hops[std::min((size_t)i, SearchStats::kMaxLevels - 1)]);
             int offset = *((int*)(model_level0_ + cur_node_id * memory_per_node_level0_));
             const int* friends_with_size = (const int*)(model_higher_level_ 
                                            + (offset+i-1) * memory_per_node_higher_level_);
@@ -110,29 +568,22 @@ void HnswSearchImpl<DistFuncType>::SearchByVector_(const vector<float>& qvec, si
             int size = friends_with_size[0];
            
             for (auto j = 1; j <= size; ++j) {
-                _mm_prefetch(visited + friends_with_size[j], _MM_HINT_T0);
+                visited_set_.Prefetch(friends_with_size[j]);
             }
-            for (auto j = 1; j <= size; ++j) {
-                int fid = friends_with_size[j];
-                if (visited[fid] != visited_mark) {
-                    _mm_prefetch(qraw, _MM_HINT_T0);
-                    const float* vec = (const float*)(model_level0_node_base_offset_ 
-                                       + fid * memory_per_node_level0_);
-                    _mm_prefetch(vec, _MM_HINT_NTA);
-                    visited[fid] = visited_mark;
-                    float d = dist_func_(qraw, vec, data_dim_);
-                    if (d < cur_dist) {
-                        cur_dist = d;
-                        cur_node_id = fid;
-                        changed = true;
-                        if (ensure_k) ensure_k_path_.emplace_back(cur_node_id, cur_dist);
-                     }
+            size_t num = ComputeUnvisitedFriendDistances_(friends_with_size, qraw, cur_dist);
+            for (size_t j = 0; j < num; ++j) {
+                float d = batch_dists_[j];
+                if (d < cur_dist) {
+                    cur_dist = d;
+                    cur_node_id = batch_ids_[j];
+                    changed = true;
+                    if (ensure_k) ensure_k_path_.emplace_back(cur_node_id, cur_dist);
                 }
             }
         }
     }
 
-    CallSearchById_(cur_node_id, cur_dist, qraw, k, ef_search, ensure_k, result);
+    return cur_node_id;
 }
 
 template<typename DistFuncType>
@@ -142,8 +593,11 @@ void HnswSearchImpl<DistFuncType>::SearchById(int id, size_t k, int ef_search, b
         ef_search = 50 * k;
     }
     // ensure_k is not yet support in SearchById function
-    SearchById_(id, 0.0, (const float*)(model_level0_node_base_offset_ + id * memory_per_node_level0_), 
-                k, ef_search, false, result);
+    N2_COUNT_STAT(BeginQuery_());
+    id = model_->GetNodeId(id);
+    rerank_query_ = GetDataOf_(id);
+    SearchById_(id, 0.0, dist_func_.PrepareQuery(rerank_query_, data_dim_), k, ef_search, false, result);
+    N2_COUNT_STAT(EndQuery_());
 }
 
 template<typename DistFuncType>
@@ -153,23 +607,103 @@ void HnswSearchImpl<DistFuncType>::SearchById(int id, size_t k, int ef_search, b
         ef_search = 50 * k;
     }
     // ensure_k is not yet support in SearchById function
-    SearchById_(id, 0.0, (const float*)(model_level0_node_base_offset_ + id * memory_per_node_level0_), 
-                k, ef_search, false, result);
+    N2_COUNT_STAT(BeginQuery_());
+    id = model_->GetNodeId(id);
+    rerank_query_ = GetDataOf_(id);
+    SearchById_(id, 0.0, dist_func_.PrepareQuery(rerank_query_, data_dim_), k, ef_search, false, result);
+    N2_COUNT_STAT(EndQuery_());
+}
+
+template<typename DistFuncType>
+void HnswSearchImpl<DistFuncType>::SearchByVectorRange(const vector<float>& qvec, float radius, size_t max_results,
+                                                       int ef_search, vector<pair<int, float>>& result) {
+    if (ef_search < 0)
+        ef_search = 50;
+    if (max_results == 0)
+        max_results = model_->GetNumNodes();
+    if (metric_ == DistanceKind::DOT)
+        radius = -radius;
+
+    result.clear();
+    N2_COUNT_STAT(BeginQuery_());
+    const float* qraw = PrepareQuery_(qvec.data());
+    float cur_dist = 0;
+    int cur_node_id = SearchUpperLayers_(qraw, false, cur_dist);
+    SearchRange_(cur_node_id, cur_dist, qraw, radius, max_results, ef_search, result);
+
+    if (needs_rerank_) {
+        for (auto& id_distance : result) {
+            id_distance.second = ExactDistance_(id_distance.first);
+        }
+        N2_COUNT_STAT(query_stats_.num_distances += result.size());
+        result.erase(std::remove_if(result.begin(), result.end(),
+                                    [radius](const pair<int, float>& p) { return p.second > radius; }),
+                     result.end());
+    }
+    std::sort(result.begin(), result.end(),
+              [](const pair<int, float>& a, const pair<int, float>& b) { return a.second < b.second; });
+    if (metric_ == DistanceKind::DOT) {
+        for (auto& id_distance : result)
+            id_distance.second *= -1.;
+    }
+    ToItemIds_(result, 0);
+    N2_COUNT_STAT(EndQuery_());
+}
+
+template<typename DistFuncType>
+void HnswSearchImpl<DistFuncType>::SetVisitedSetKind(VisitedSetKind kind) {
+    visited_set_.SetKind(kind);
+    for (auto& q : interleaved_queries_) {
+        q->visited_set.SetKind(kind);
+    }
+}
+
+template<typename DistFuncType>
+pair<int, float> HnswSearchImpl<DistFuncType>::SearchEnterpoint(const vector<float>& qvec) {
+    N2_COUNT_STAT(BeginQuery_());
+    const float* qraw = PrepareQuery_(qvec.data());
+    float cur_dist = 0;
+    int cur_node_id = SearchUpperLayers_(qraw, false, cur_dist);
+    N2_COUNT_STAT(EndQuery_(0));
+    return {cur_node_id, cur_dist};
+}
+
+template<typename DistFuncType>
+void HnswSearchImpl<DistFuncType>::SearchByVectorFromEnterpoint(const vector<float>& qvec,
+                                                                const pair<int, float>& enterpoint, size_t k,
+                                                                int ef_search, vector<int>& result) {
+    if (ef_search < 0)
+        ef_search = 50 * k;
+    N2_COUNT_STAT(BeginQuery_());
+    SearchById_(enterpoint.first, enterpoint.second, PrepareQuery_(qvec.data()), k, ef_search, false, result);
+    N2_COUNT_STAT(EndQuery_());
+}
+
+template<typename DistFuncType>
+void HnswSearchImpl<DistFuncType>::SearchByVectorFromEnterpoint(const vector<float>& qvec,
+                                                                const pair<int, float>& enterpoint, size_t k,
+                                                                int ef_search, vector<pair<int, float>>& result) {
+    if (ef_search < 0)
+        ef_search = 50 * k;
+    N2_COUNT_STAT(BeginQuery_());
+    SearchById_(enterpoint.first, enterpoint.second, PrepareQuery_(qvec.data()), k, ef_search, false, result);
+    N2_COUNT_STAT(EndQuery_());
 }
 
 template<typename DistFuncType>
 template<typename ResultType>
 void HnswSearchImpl<DistFuncType>::SearchByIdV1_(int cur_node_id, float cur_dist, const float* qraw, size_t k, 
                                                  size_t ef_search, bool ensure_k, ResultType& result) {
-    IdDistancePairMinHeap candidates;
-    IdDistancePairMinHeap visited_nodes;
+    IdDistancePairMinHeap& candidates = candidates_;
+    IdDistancePairMinHeap& visited_nodes = visited_nodes_;
+    candidates.clear();
+    visited_nodes.clear();
 
     candidates.emplace(cur_node_id, cur_dist);
+    N2_COUNT_STAT(++query_stats_.num_heap_pushes);
 
-    visited_list_->Reset();
-    unsigned int visited_mark = visited_list_->GetVisitMark();
-    unsigned int* visited = visited_list_->GetVisited();
-    visited[cur_node_id] = visited_mark;
+    visited_set_.Reset();
+    visited_set_.Insert(cur_node_id);
 
     if (ensure_k and !result.empty()) {
         if (not PrepareEnsureKSearch(cur_node_id, result, visited_nodes)) {
@@ -187,6 +721,7 @@ void HnswSearchImpl<DistFuncType>::SearchByIdV1_(int cur_node_id, float cur_dist
         visited_nodes.emplace(std::move(const_cast<IdDistancePair&>(c)));
         ++visited_cnt;
         candidates.pop();
+        N2_COUNT_STAT(++query_stats_.hops[0]);
 
         float minimum_distance = farthest_distance;
         const int* friends_with_size = (const int*)(model_level0_ 
@@ -195,46 +730,50 @@ void HnswSearchImpl<DistFuncType>::SearchByIdV1_(int cur_node_id, float cur_dist
         int size = friends_with_size[0];
 
         for (auto j = 1; j <= size; ++j) {
-            _mm_prefetch(visited + friends_with_size[j], _MM_HINT_T0);
+            visited_set_.Prefetch(friends_with_size[j]);
         }
-        for (auto j = 1; j <= size; ++j) {
-            int node_id = friends_with_size[j];
-            if (visited[node_id] != visited_mark) {
-                _mm_prefetch(qraw, _MM_HINT_T0);
-                const float* vec = (const float*)(model_level0_node_base_offset_ 
-                                   + node_id * memory_per_node_level0_);
-                _mm_prefetch(vec, _MM_HINT_NTA);
-                visited[node_id] = visited_mark;
-                float d = dist_func_(qraw, vec, data_dim_);
-                if (d < minimum_distance || candidate_found_cnt < ef_search) {
-                    candidates.emplace(node_id, d);
-                    if (d > farthest_distance) {
-                        farthest_distance = d;
-                    }
-                    ++candidate_found_cnt;
+        size_t num = ComputeUnvisitedFriendDistances_(friends_with_size, qraw, numeric_limits<float>::max());
+        for (size_t j = 0; j < num; ++j) {
+            float d = batch_dists_[j];
+            if (d < minimum_distance || candidate_found_cnt < ef_search) {
+                candidates.emplace(batch_ids_[j], d);
+                N2_COUNT_STAT(++query_stats_.num_heap_pushes);
+                if (d > farthest_distance) {
+                    farthest_distance = d;
                 }
+                ++candidate_found_cnt;
             }
         }
     }
 
+    N2_COUNT_STAT(query_stats_.ef_used += std::min(candidate_found_cnt, ef_search));
     MakeSearchResult(k, candidates, visited_nodes, result);
 }
 
 template<typename DistFuncType>
-template<typename ResultType>
+template<typename ResultType, typename FilterType>
 void HnswSearchImpl<DistFuncType>::SearchByIdV2_(int cur_node_id, float cur_dist, const float* qraw, size_t k, 
-                                                 size_t ef_search, bool ensure_k, ResultType& result) {
-    IdDistancePairMinHeap candidates;
-    IdDistancePairMinHeap visited_nodes;
-    DistanceMaxHeap found_distances;
+                                                 size_t ef_search, bool ensure_k, ResultType& result,
+                                                 const FilterType& filter) {
+    // filtered searches collect allowed nodes in visited_nodes as they are found, expanded or not
+    const bool filtered = !std::is_same<FilterType, NoSearchFilter>::value;
+    IdDistancePairMinHeap& candidates = candidates_;
+    IdDistancePairMinHeap& visited_nodes = visited_nodes_;
+    DistanceMaxHeap& found_distances = found_distances_;
+    candidates.clear();
+    visited_nodes.clear();
+    found_distances.clear();
+    found_distances.reserve(ef_search + 1);
 
     candidates.emplace(cur_node_id, cur_dist);
-    found_distances.emplace(cur_dist);
+    N2_COUNT_STAT(++query_stats_.num_heap_pushes);
+    if (filter.IsAllowed(cur_node_id)) {
+        if (filtered) visited_nodes.emplace(cur_node_id, cur_dist);
+        found_distances.emplace(cur_dist);
+    }
 
-    visited_list_->Reset();
-    unsigned int visited_mark = visited_list_->GetVisitMark();
-    unsigned int* visited = visited_list_->GetVisited();
-    visited[cur_node_id] = visited_mark;
+    visited_set_.Reset();
+    visited_set_.Insert(cur_node_id);
 
     if (ensure_k and !result.empty()) {
         if (not PrepareEnsureKSearch(cur_node_id, result, visited_nodes)) {
@@ -244,13 +783,14 @@ void HnswSearchImpl<DistFuncType>::SearchByIdV2_(int cur_node_id, float cur_dist
 
     while (!candidates.empty()) {
         const IdDistancePair& c = candidates.top();
-        if (c.second > found_distances.top()) {
+        if (found_distances.size() >= ef_search && c.second > found_distances.top()) {
             break;
         }
 
         cur_node_id = c.first;
-        visited_nodes.emplace(std::move(const_cast<IdDistancePair&>(c)));
+        if (!filtered) visited_nodes.emplace(std::move(const_cast<IdDistancePair&>(c)));
         candidates.pop();
+        N2_COUNT_STAT(++query_stats_.hops[0]);
 
         const int* friends_with_size = (const int*)(model_level0_ 
                                         + cur_node_id * memory_per_node_level0_ + sizeof(int));
@@ -258,20 +798,19 @@ void HnswSearchImpl<DistFuncType>::SearchByIdV2_(int cur_node_id, float cur_dist
         int size = friends_with_size[0];
 
         for (auto j = 1; j <= size; ++j) {
-            _mm_prefetch(visited + friends_with_size[j], _MM_HINT_T0);
+            visited_set_.Prefetch(friends_with_size[j]);
         }
-        for (auto j = 1; j <= size; ++j) {
-            int node_id = friends_with_size[j];
-            if (visited[node_id] != visited_mark) {
-                _mm_prefetch(qraw, _MM_HINT_T0);
-                const float* vec = (const float*)(model_level0_node_base_offset_ 
-                                   + node_id * memory_per_node_level0_);
-                _mm_prefetch(vec, _MM_HINT_NTA);
-                visited[node_id] = visited_mark;
-                float d = dist_func_(qraw, vec, data_dim_);
-                if (d < found_distances.top() || found_distances.size() < ef_search) {
-                    candidates.emplace(node_id, d);
-					found_distances.emplace(d);
+        // once ef_search distances are found, a neighbor farther than all of them is never admitted
+        float bound = found_distances.size() < ef_search ? numeric_limits<float>::max() : found_distances.top();
+        size_t num = ComputeUnvisitedFriendDistances_(friends_with_size, qraw, bound);
+        for (size_t j = 0; j < num; ++j) {
+            float d = batch_dists_[j];
+            if (found_distances.size() < ef_search || d < found_distances.top()) {
+                candidates.emplace(batch_ids_[j], d);
+                N2_COUNT_STAT(++query_stats_.num_heap_pushes);
+                if (filter.IsAllowed(batch_ids_[j])) {
+                    if (filtered) visited_nodes.emplace(batch_ids_[j], d);
+                    found_distances.emplace(d);
                     if (found_distances.size() > ef_search) {
                         found_distances.pop();
                     }
@@ -280,9 +819,111 @@ void HnswSearchImpl<DistFuncType>::SearchByIdV2_(int cur_node_id, float cur_dist
         }
     }
 
+    N2_COUNT_STAT(query_stats_.ef_used += found_distances.size());
+    if (filtered) candidates.clear();
     MakeSearchResult(k, candidates, visited_nodes, result);
 }
 
+template<typename DistFuncType>
+void HnswSearchImpl<DistFuncType>::SearchRange_(int cur_node_id, float cur_dist, const float* qraw, float radius,
+                                                size_t max_results, size_t ef_search,
+                                                vector<pair<int, float>>& result) {
+    auto nearer = [](const pair<int, float>& a, const pair<int, float>& b) { return a.second < b.second; };
+    // admits a node within the radius, which shrinks to the farthest result once max_results are found
+    auto admit = [&](int id, float d) {
+        if (d > radius) return;
+        result.emplace_back(id, d);
+        std::push_heap(result.begin(), result.end(), nearer);
+        if (result.size() > max_results) {
+            std::pop_heap(result.begin(), result.end(), nearer);
+            result.pop_back();
+        }
+        if (result.size() == max_results) {
+            radius = result.front().second;
+        }
+    };
+
+    IdDistancePairMinHeap& candidates = candidates_;
+    DistanceMaxHeap& found_distances = found_distances_;
+    candidates.clear();
+    found_distances.clear();
+    found_distances.reserve(ef_search + 1);
+
+    candidates.emplace(cur_node_id, cur_dist);
+    N2_COUNT_STAT(++query_stats_.num_heap_pushes);
+    if (cur_dist <= radius) {
+        admit(cur_node_id, cur_dist);
+    } else {
+        found_distances.emplace(cur_dist);
+    }
+
+    visited_set_.Reset();
+    visited_set_.Insert(cur_node_id);
+
+    // items within the radius are all kept, and found_distances holds the ef_search nearest ones beyond it, so
+    // the search keeps as wide a frontier around the radius as SearchByIdV2_() keeps around its results
+    while (!candidates.empty()) {
+        float ef_bound = found_distances.size() < ef_search ? numeric_limits<float>::max() : found_distances.top();
+        float bound = std::max(radius, ef_bound);
+        const IdDistancePair& c = candidates.top();
+        if (c.second > bound) {
+            break;
+        }
+        cur_node_id = c.first;
+        candidates.pop();
+        N2_COUNT_STAT(++query_stats_.hops[0]);
+
+        const int* friends_with_size = (const int*)(model_level0_
+                                        + cur_node_id * memory_per_node_level0_ + sizeof(int));
+        _mm_prefetch(friends_with_size, _MM_HINT_T0);
+        int size = friends_with_size[0];
+
+        for (auto j = 1; j <= size; ++j) {
+            visited_set_.Prefetch(friends_with_size[j]);
+        }
+        size_t num = ComputeUnvisitedFriendDistances_(friends_with_size, qraw, bound);
+        for (size_t j = 0; j < num; ++j) {
+            float d = batch_dists_[j];
+            if (d <= radius) {
+                candidates.emplace(batch_ids_[j], d);
+                N2_COUNT_STAT(++query_stats_.num_heap_pushes);
+                admit(batch_ids_[j], d);
+            } else if (found_distances.size() < ef_search || d < found_distances.top()) {
+                candidates.emplace(batch_ids_[j], d);
+                N2_COUNT_STAT(++query_stats_.num_heap_pushes);
+                found_distances.emplace(d);
+                if (found_distances.size() > ef_search) {
+                    found_distances.pop();
+                }
+            }
+        }
+    }
+    N2_COUNT_STAT(query_stats_.ef_used += found_distances.size());
+}
+
+template<typename DistFuncType>
+inline size_t HnswSearchImpl<DistFuncType>::ComputeUnvisitedFriendDistances_(const int* friends_with_size,
+                                                                             const float* qraw,
+                                                                             float bound) {
+    int size = friends_with_size[0];
+    size_t num = 0;
+    for (auto j = 1; j <= size; ++j) {
+        int node_id = friends_with_size[j];
+        if (visited_set_.Insert(node_id)) {
+            const DataType* vec = GetLevel0Data_(node_id);
+            _mm_prefetch(vec, _MM_HINT_NTA);
+            batch_ids_[num] = node_id;
+            batch_vecs_[num] = vec;
+            ++num;
+        }
+    }
+    _mm_prefetch(qraw, _MM_HINT_T0);
+    BoundedBatchDistance(dist_func_, qraw, &batch_vecs_[0], num, data_dim_, bound, &batch_dists_[0]);
+    N2_COUNT_STAT(query_stats_.num_distances += num);
+    N2_COUNT_STAT(query_stats_.num_visited += num);
+    return num;
+}
+
 template<typename DistFuncType>
 bool HnswSearchImpl<DistFuncType>::PrepareEnsureKSearch(int cur_node_id, vector<int>& result, 
                                                         IdDistancePairMinHeap& visited_nodes) {
@@ -294,15 +935,13 @@ bool HnswSearchImpl<DistFuncType>::PrepareEnsureKSearch(int cur_node_id, vector<
 template<typename DistFuncType>
 bool HnswSearchImpl<DistFuncType>::PrepareEnsureKSearch(int cur_node_id, vector<pair<int, float>>& result, 
                                                         IdDistancePairMinHeap& visited_nodes) {
-    unsigned int visited_mark = visited_list_->GetVisitMark();
-    unsigned int* visited = visited_list_->GetVisited();
-
     for (size_t i = 0; i < result.size(); ++i) {
-        if (result[i].first == cur_node_id) {
+        int node_id = model_->GetNodeId(result[i].first);
+        if (node_id == cur_node_id) {
             return false;
         }
-        visited[result[i].first] = visited_mark;
-        visited_nodes.emplace(std::move(result[i]));
+        visited_set_.Insert(node_id);
+        visited_nodes.emplace(node_id, result[i].second);
     }
     result.clear();
     
@@ -312,6 +951,14 @@ bool HnswSearchImpl<DistFuncType>::PrepareEnsureKSearch(int cur_node_id, vector<
 template<typename DistFuncType>
 void HnswSearchImpl<DistFuncType>::MakeSearchResult(size_t k, IdDistancePairMinHeap& candidates, 
                                                     IdDistancePairMinHeap& visited_nodes, vector<int>& result) {
+    size_t begin = result.size();
+    if (needs_rerank_) {
+        RerankSearchResult_(k - std::min(k, result.size()), candidates, visited_nodes);
+        for (const auto& id_distance : rerank_buf_)
+            result.emplace_back(id_distance.first);
+        ToItemIds_(result, begin);
+        return;
+    }
 
     while (result.size() < k) {
         if (!candidates.empty() and !visited_nodes.empty()) {
@@ -336,12 +983,19 @@ void HnswSearchImpl<DistFuncType>::MakeSearchResult(size_t k, IdDistancePairMinH
             break;
         }
     }
+    ToItemIds_(result, begin);
 }
 
 template<typename DistFuncType>
 void HnswSearchImpl<DistFuncType>::MakeSearchResult(size_t k, IdDistancePairMinHeap& candidates, 
                                                     IdDistancePairMinHeap& visited_nodes, 
                                                     vector<pair<int, float>>& result) {
+    size_t begin = result.size();
+    if (needs_rerank_) {
+        RerankSearchResult_(k - std::min(k, result.size()), candidates, visited_nodes);
+        result.insert(result.end(), rerank_buf_.begin(), rerank_buf_.end());
+    }
+
     while (result.size() < k) {
         if (!candidates.empty() && !visited_nodes.empty()) {
             const IdDistancePair& c = candidates.top();
@@ -370,11 +1024,70 @@ void HnswSearchImpl<DistFuncType>::MakeSearchResult(size_t k, IdDistancePairMinH
         for (auto& id_distance : result)
             id_distance.second *= -1.;
     }
+    ToItemIds_(result, begin);
+}
 
+template<typename DistFuncType>
+void HnswSearchImpl<DistFuncType>::RerankSearchResult_(size_t k, IdDistancePairMinHeap& candidates,
+                                                       IdDistancePairMinHeap& visited_nodes) {
+    rerank_buf_.clear();
+    size_t num_rerank = k * kRerankMultiplier;
+    while (rerank_buf_.size() < num_rerank) {
+        if (!candidates.empty() && !visited_nodes.empty()) {
+            if (candidates.top().second < visited_nodes.top().second) {
+                rerank_buf_.push_back(candidates.top());
+                candidates.pop();
+            } else {
+                rerank_buf_.push_back(visited_nodes.top());
+                visited_nodes.pop();
+            }
+        } else if (!candidates.empty()) {
+            rerank_buf_.push_back(candidates.top());
+            candidates.pop();
+        } else if (!visited_nodes.empty()) {
+            rerank_buf_.push_back(visited_nodes.top());
+            visited_nodes.pop();
+        } else {
+            break;
+        }
+    }
+
+    for (auto& id_distance : rerank_buf_) {
+        id_distance.second = ExactDistance_(id_distance.first);
+    }
+    N2_COUNT_STAT(query_stats_.num_distances += rerank_buf_.size());
+    size_t num_result = std::min(k, rerank_buf_.size());
+    std::partial_sort(rerank_buf_.begin(), rerank_buf_.begin() + num_result, rerank_buf_.end(),
+                      [](const pair<int, float>& a, const pair<int, float>& b) { return a.second < b.second; });
+    rerank_buf_.resize(num_result);
 }
 
 template class HnswSearchImpl<AngularDistance>;
 template class HnswSearchImpl<L2Distance>;
 template class HnswSearchImpl<DotDistance>;
 
+#define N2_INSTANTIATE_SEARCHER(dim) \
+    template class HnswSearchImpl<BasicAngularDistance<dim>>; \
+    template class HnswSearchImpl<BasicL2Distance<dim>>; \
+    template class HnswSearchImpl<BasicDotDistance<dim>>;
+N2_FOR_EACH_SPECIALIZED_DIM(N2_INSTANTIATE_SEARCHER)
+#undef N2_INSTANTIATE_SEARCHER
+
+template class HnswSearchImpl<HammingDistance>;
+
+template class HnswSearchImpl<SQ8AngularDistance>;
+template class HnswSearchImpl<SQ8L2Distance>;
+template class HnswSearchImpl<SQ8DotDistance>;
+template class HnswSearchImpl<PQAngularDistance>;
+template class HnswSearchImpl<PQL2Distance>;
+template class HnswSearchImpl<PQDotDistance>;
+
+#define N2_INSTANTIATE_HALF_SEARCHER(storage) \
+    template class HnswSearchImpl<HalfAngularDistance<storage>>; \
+    template class HnswSearchImpl<HalfL2Distance<storage>>; \
+    template class HnswSearchImpl<HalfDotDistance<storage>>;
+N2_INSTANTIATE_HALF_SEARCHER(VectorStorage::FP16)
+N2_INSTANTIATE_HALF_SEARCHER(VectorStorage::BF16)
+#undef N2_INSTANTIATE_HALF_SEARCHER
+
 } // namespace n2
\ No newline at end of file
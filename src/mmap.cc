@@ -24,8 +24,8 @@
 
 namespace n2 {
 
-Mmap::Mmap(char const* fname) {
-    Map(fname);
+Mmap::Mmap(char const* fname, int extra_flags) {
+    Map(fname, extra_flags);
 }
    
 Mmap::~Mmap() {
@@ -36,14 +36,14 @@ Mmap::~Mmap() {
     }
 }
 
-void Mmap::Map(char const* fname) {
+void Mmap::Map(char const* fname, int extra_flags) {
     UnMap();
     if (fname == nullptr) throw std::runtime_error("[Error] Invalid file name received. (nullptr)");
     file_handle_ = open(fname, O_RDONLY);
     if (file_handle_ == -1) throw std::runtime_error("[Error] Failed to read file: " + std::string(fname));
     file_size_ = QueryFileSize();
     if (file_size_ <= 0) throw std::runtime_error("[Error] Memory mapping failed! (file_size==zero)");
-    data_ = static_cast<char*>(mmap(0, file_size_, PROT_READ, MAP_SHARED, file_handle_, 0));
+    data_ = static_cast<char*>(mmap(0, file_size_, PROT_READ, MAP_SHARED | extra_flags, file_handle_, 0));
     if (data_ == MAP_FAILED) throw std::runtime_error("[Error] Memory mapping failed!");
 }
 
@@ -0,0 +1,158 @@
+// Copyright 2017 Kakao Corp. <http://www.kakaocorp.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "n2/quantization.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace n2 {
+
+using std::max;
+using std::min;
+using std::mt19937;
+using std::numeric_limits;
+using std::vector;
+
+const size_t ProductQuantizer::kNumCentroids;
+
+namespace {
+
+const size_t kPQMaxTrainSamples = ProductQuantizer::kNumCentroids * 256;
+const int kPQTrainIterations = 16;
+
+size_t FindNearestCentroid(const float* vec, const float* codebook, size_t num_centroids, size_t sub_dim,
+                           float (*l2)(const float* v1, const float* v2, size_t qty)) {
+    size_t nearest = 0;
+    float nearest_dist = numeric_limits<float>::max();
+    for (size_t c = 0; c < num_centroids; ++c) {
+        float d = l2(vec, codebook + c * sub_dim, sub_dim);
+        if (d < nearest_dist) {
+            nearest_dist = d;
+            nearest = c;
+        }
+    }
+    return nearest;
+}
+
+// Lloyd's k-means over one subspace. Centroids are seeded from distinct random samples and
+// emptied clusters are reseeded the same way.
+void TrainSubspace(const vector<const float*>& samples, size_t offset, size_t sub_dim, float* codebook,
+                   mt19937& rng) {
+    const size_t num_centroids = ProductQuantizer::kNumCentroids;
+    const size_t num_samples = samples.size();
+    const auto l2 = GetDistanceKernels().l2;
+
+    vector<size_t> perm(num_samples);
+    for (size_t i = 0; i < num_samples; ++i) perm[i] = i;
+    std::shuffle(perm.begin(), perm.end(), rng);
+    for (size_t c = 0; c < num_centroids; ++c) {
+        const float* src = samples[perm[c % num_samples]] + offset;
+        std::copy(src, src + sub_dim, codebook + c * sub_dim);
+    }
+    if (num_samples <= num_centroids) return;
+
+    vector<size_t> assign(num_samples);
+    vector<size_t> counts(num_centroids);
+    std::uniform_int_distribution<size_t> pick(0, num_samples - 1);
+    for (int iter = 0; iter < kPQTrainIterations; ++iter) {
+        for (size_t i = 0; i < num_samples; ++i) {
+            assign[i] = FindNearestCentroid(samples[i] + offset, codebook, num_centroids, sub_dim, l2);
+        }
+        std::fill(codebook, codebook + num_centroids * sub_dim, 0.0f);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (size_t i = 0; i < num_samples; ++i) {
+            float* centroid = codebook + assign[i] * sub_dim;
+            const float* vec = samples[i] + offset;
+            for (size_t j = 0; j < sub_dim; ++j) centroid[j] += vec[j];
+            ++counts[assign[i]];
+        }
+        for (size_t c = 0; c < num_centroids; ++c) {
+            float* centroid = codebook + c * sub_dim;
+            if (counts[c] == 0) {
+                const float* src = samples[pick(rng)] + offset;
+                std::copy(src, src + sub_dim, centroid);
+            } else {
+                for (size_t j = 0; j < sub_dim; ++j) centroid[j] /= counts[c];
+            }
+        }
+    }
+}
+
+} // namespace
+
+void ScalarQuantizer::Train(const vector<const float*>& vecs, size_t dim, float* params) {
+    float* mins = params;
+    float* scales = params + dim;
+    vector<float> maxs(dim, -numeric_limits<float>::max());
+    std::fill(mins, mins + dim, numeric_limits<float>::max());
+    for (const float* vec : vecs) {
+        for (size_t i = 0; i < dim; ++i) {
+            mins[i] = min(mins[i], vec[i]);
+            maxs[i] = max(maxs[i], vec[i]);
+        }
+    }
+    for (size_t i = 0; i < dim; ++i) {
+        if (vecs.empty()) {
+            mins[i] = 0;
+            maxs[i] = 0;
+        }
+        // a constant dimension gets scale 0, so every code decodes to mins[i] exactly.
+        scales[i] = (maxs[i] - mins[i]) / 255.0f;
+    }
+}
+
+void ScalarQuantizer::Encode(const float* vec, const float* params, size_t dim, uint8_t* code) {
+    const float* mins = params;
+    const float* scales = params + dim;
+    for (size_t i = 0; i < dim; ++i) {
+        float v = scales[i] > 0 ? std::round((vec[i] - mins[i]) / scales[i]) : 0.0f;
+        code[i] = (uint8_t)min(max(v, 0.0f), 255.0f);
+    }
+}
+
+void ProductQuantizer::Train(const vector<const float*>& vecs, size_t dim, size_t num_subspaces, float* params) {
+    const size_t sub_dim = dim / num_subspaces;
+    if (vecs.empty()) {
+        std::fill(params, params + GetParamsSize(dim) / sizeof(float), 0.0f);
+        return;
+    }
+
+    vector<const float*> samples(vecs);
+    mt19937 rng(0);
+    if (samples.size() > kPQMaxTrainSamples) {
+        std::shuffle(samples.begin(), samples.end(), rng);
+        samples.resize(kPQMaxTrainSamples);
+    }
+
+    #pragma omp parallel for schedule(dynamic)
+    for (size_t m = 0; m < num_subspaces; ++m) {
+        mt19937 subspace_rng(m);
+        TrainSubspace(samples, m * sub_dim, sub_dim, params + m * kNumCentroids * sub_dim, subspace_rng);
+    }
+}
+
+void ProductQuantizer::Encode(const float* vec, const float* params, size_t dim, size_t num_subspaces,
+                              uint8_t* code) {
+    const size_t sub_dim = dim / num_subspaces;
+    const auto l2 = GetDistanceKernels().l2;
+    for (size_t m = 0; m < num_subspaces; ++m) {
+        code[m] = (uint8_t)FindNearestCentroid(vec + m * sub_dim, params + m * kNumCentroids * sub_dim,
+                                               kNumCentroids, sub_dim, l2);
+    }
+}
+
+} // namespace n2
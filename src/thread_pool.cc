@@ -0,0 +1,157 @@
+// Copyright 2017 Kakao Corp. <http://www.kakaocorp.com>
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "n2/thread_pool.h"
+
+#include <xmmintrin.h>
+
+#include <algorithm>
+
+namespace n2 {
+
+using std::function;
+using std::lock_guard;
+using std::mutex;
+using std::unique_lock;
+
+const size_t ThreadPool::kChunksPerThread;
+const size_t ThreadPool::kMaxGrain;
+const int ThreadPool::kSpinIterations;
+
+ThreadPool& ThreadPool::GetInstance() {
+    static ThreadPool pool;
+    return pool;
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<mutex> lock(mutex_);
+        stop_ = true;
+    }
+    job_cv_.notify_all();
+    for (auto& worker : workers_) {
+        worker.join();
+    }
+}
+
+void ThreadPool::ParallelFor(size_t num_tasks, size_t num_threads, const function<void(size_t, size_t)>& func) {
+    num_threads = std::max<size_t>(1, std::min(num_threads, num_tasks));
+    if (num_tasks == 0) {
+        return;
+    } else if (num_threads == 1) {
+        func(0, num_tasks);
+        return;
+    }
+    Grow_(num_threads - 1);
+
+    Job job(num_threads);
+    job.func = &func;
+    job.grain = std::max<size_t>(1, std::min<size_t>(kMaxGrain, num_tasks / (num_threads * kChunksPerThread)));
+    job.max_workers = num_threads - 1;
+    for (size_t i = 0; i < num_threads; ++i) {
+        job.ranges[i].next.store(num_tasks * i / num_threads, std::memory_order_relaxed);
+        job.ranges[i].end = num_tasks * (i + 1) / num_threads;
+    }
+    {
+        lock_guard<mutex> lock(mutex_);
+        jobs_.push_back(&job);
+        ++num_submitted_;
+    }
+    job_cv_.notify_all();
+
+    Run_(job, 0);
+
+    {
+        // once off the list no worker joins, so the job may go out of scope after the running ones leave
+        unique_lock<mutex> lock(mutex_);
+        jobs_.remove(&job);
+        done_cv_.wait(lock, [&job]() { return job.num_running == 0; });
+    }
+    if (job.error) {
+        std::rethrow_exception(job.error);
+    }
+}
+
+size_t ThreadPool::GetNumWorkers() const {
+    lock_guard<mutex> lock(mutex_);
+    return workers_.size();
+}
+
+void ThreadPool::Run_(Job& job, size_t participant) {
+    size_t num_ranges = job.ranges.size();
+    for (size_t i = 0; i < num_ranges; ++i) {
+        Range& range = job.ranges[(participant + i) % num_ranges];
+        while (range.next.load(std::memory_order_relaxed) < range.end) {
+            size_t begin = range.next.fetch_add(job.grain, std::memory_order_relaxed);
+            if (begin >= range.end) {
+                break;
+            }
+            try {
+                (*job.func)(begin, std::min(begin + job.grain, range.end));
+            } catch (...) {
+                lock_guard<mutex> lock(job.error_mutex);
+                if (!job.error) {
+                    job.error = std::current_exception();
+                }
+            }
+        }
+    }
+    job.exhausted.store(true, std::memory_order_relaxed);
+}
+
+void ThreadPool::Grow_(size_t num_workers) {
+    lock_guard<mutex> lock(mutex_);
+    while (workers_.size() < num_workers) {
+        workers_.emplace_back(&ThreadPool::WorkerLoop_, this);
+    }
+}
+
+void ThreadPool::WorkerLoop_() {
+    unique_lock<mutex> lock(mutex_);
+    while (!stop_) {
+        Job* job = FindJob_();
+        if (job == nullptr) {
+            uint64_t num_submitted = num_submitted_.load(std::memory_order_relaxed);
+            lock.unlock();
+            for (int i = 0; i < kSpinIterations; ++i) {
+                if (num_submitted_.load(std::memory_order_relaxed) != num_submitted) {
+                    break;
+                }
+                _mm_pause();
+            }
+            lock.lock();
+            job_cv_.wait(lock, [this]() { return stop_ || FindJob_() != nullptr; });
+            continue;
+        }
+        size_t participant = ++job->num_joined;
+        ++job->num_running;
+        lock.unlock();
+        Run_(*job, participant);
+        lock.lock();
+        if (--job->num_running == 0) {
+            done_cv_.notify_all();
+        }
+    }
+}
+
+ThreadPool::Job* ThreadPool::FindJob_() {
+    for (Job* job : jobs_) {
+        if (job->num_joined < job->max_workers && !job->exhausted.load(std::memory_order_relaxed)) {
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+} // namespace n2
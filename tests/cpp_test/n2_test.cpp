@@ -12,12 +12,38 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <new>
+#include <random>
+#include <thread>
 #include <vector>
 #include "gtest/gtest.h"
 
 #include "n2/hnsw.h"
 #include "n2/distance.h"
+#include "n2/distance_kernels.h"
 #include "n2/min_heap.h"
+#include "n2/thread_pool.h"
+
+// counts heap allocations of each thread, to check the allocation-free search paths on the test thread
+static thread_local size_t num_allocations = 0;
+
+void* operator new(size_t size) {
+    ++num_allocations;
+    void* p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
 
 class CppApiTest : public::testing::Test {
     protected:
@@ -214,6 +240,103 @@ TEST_F(CppApiTest, UnloadModelTest) {
     delete origin;
 }
 
+TEST_F(CppApiTest, HugePagesLoadTest) {
+    n2::Hnsw plain;
+    plain.LoadModel("../model/test.n2", false);
+    std::vector<std::pair<int, float> > expected;
+    plain.SearchByVector(std::vector<float>{3, 2, 1}, 3, 30, expected);
+    ASSERT_EQ(3, expected.size());
+
+    // the pages obtained depend on the machine; without them the model lands on regular pages
+    for (std::string use_mmap : {"true", "false"}) {
+        for (std::string huge_pages : {"none", "thp", "2mb", "1gb"}) {
+            n2::Hnsw index;
+            index.LoadModel("../model/test.n2", {{"UseMmap", use_mmap}, {"HugePages", huge_pages}});
+            std::vector<std::pair<int, float> > result;
+            index.SearchByVector(std::vector<float>{3, 2, 1}, 3, 30, result);
+            EXPECT_EQ(expected, result) << use_mmap << " " << huge_pages;
+            index.GetModelHugePageBytes();
+            index.UnloadModel();
+        }
+    }
+    n2::Hnsw index;
+    EXPECT_EQ(0, index.GetModelHugePageBytes());
+    EXPECT_THROW(index.LoadModel("../model/test.n2", {{"HugePages", "4kb"}}), std::runtime_error);
+    EXPECT_THROW(index.LoadModel("../model/test.n2", {{"Preload", "true"}}), std::runtime_error);
+}
+
+TEST_F(CppApiTest, ResidencyLoadTest) {
+    const size_t dim = 20;
+    std::vector<std::vector<float>> data(300, std::vector<float>(dim));
+    for (size_t i = 0; i < data.size(); ++i) {
+        for (size_t j = 0; j < dim; ++j) data[i][j] = (float)((i * 7919 + j * 104729 + i * j) % 1009) / 1009;
+    }
+    const std::string fname = "residency_test.n2";
+    for (std::string layout : {"interleaved", "split"}) {
+        n2::Hnsw index(dim, "L2");
+        index.SetConfigs({{"M", "8"}, {"MaxM0", "16"}, {"ModelLayout", layout}});
+        for (const auto& v : data) index.AddData(v);
+        index.Fit();
+        index.SaveModel(fname);
+        std::vector<std::pair<int, float> > expected;
+        index.SearchById(42, 5, 50, expected);
+
+        for (std::string use_mmap : {"true", "false"}) {
+            n2::Hnsw loaded;
+            loaded.LoadModel(fname, {{"UseMmap", use_mmap}, {"LoadThreads", "4"}, {"Populate", "true"},
+                                     {"Advice", "random"}, {"Lock", "true"}, {"PrefaultThreads", "3"},
+                                     {"WarmUpperLayers", "true"}});
+            std::vector<std::pair<int, float> > result;
+            loaded.SearchById(42, 5, 50, result);
+            EXPECT_EQ(expected, result) << layout << " " << use_mmap;
+        }
+    }
+    std::remove(fname.c_str());
+
+    n2::Hnsw legacy;
+    legacy.LoadModel("../model/test.n2", {{"Advice", "willneed"}, {"WarmUpperLayers", "true"}});
+    std::vector<std::pair<int, float> > result;
+    legacy.SearchByVector(std::vector<float>{3, 2, 1}, 3, 30, result);
+    EXPECT_EQ(3, result.size());
+
+    n2::Hnsw index;
+    EXPECT_THROW(index.LoadModel("../model/test.n2", {{"Advice", "dontneed"}}), std::runtime_error);
+    EXPECT_THROW(index.LoadModel("../model/test.n2", {{"Lock", "yes"}}), std::runtime_error);
+    EXPECT_THROW(index.LoadModel("../model/test.n2", {{"PrefaultThreads", "-1"}}), std::runtime_error);
+    EXPECT_THROW(index.LoadModel("../model/test.n2", {{"LoadThreads", "0"}}), std::runtime_error);
+    EXPECT_THROW(index.LoadModel("no_such_model.n2", {{"UseMmap", "false"}}), std::runtime_error);
+}
+
+TEST_F(CppApiTest, TruncatedModelLoadTest) {
+    const size_t dim = 20;
+    n2::Hnsw index(dim, "L2");
+    index.SetConfigs({{"ModelLayout", "split"}});
+    for (int i = 0; i < 200; ++i) {
+        std::vector<float> v(dim);
+        for (size_t j = 0; j < dim; ++j) v[j] = (float)((i * 7919 + j * 104729) % 1009) / 1009;
+        index.AddData(v);
+    }
+    index.Fit();
+    const std::string fname = "truncated_test.n2";
+    index.SaveModel(fname);
+    std::ifstream in(fname, std::ios::binary);
+    std::string bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    in.close();
+
+    // cut inside the vectors, inside the level-0 records and inside the header
+    for (size_t size : {bytes.size() - 4, bytes.size() / 2, (size_t)16}) {
+        std::ofstream out(fname, std::ios::binary | std::ios::trunc);
+        out.write(bytes.data(), size);
+        out.close();
+        for (std::string use_mmap : {"true", "false"}) {
+            n2::Hnsw loaded;
+            EXPECT_THROW(loaded.LoadModel(fname, {{"UseMmap", use_mmap}, {"LoadThreads", "4"}}), std::runtime_error)
+                << size << " " << use_mmap;
+        }
+    }
+    std::remove(fname.c_str());
+}
+
 TEST_F(CppApiTest, L2DistanceTest) {
     n2::L2Distance dist_func;
     float vec1[] = {0.0, 0.0, 0.0};
@@ -245,6 +368,897 @@ TEST_F(CppApiTest, DotDistanceTest) {
     EXPECT_FLOAT_EQ(-3, res2);
 }
 
+TEST_F(CppApiTest, DistanceKernelsTest) {
+    const auto& scalar = n2::GetDistanceKernels(n2::SimdLevel::SCALAR);
+    std::vector<float> vec1(300), vec2(300);
+    for (size_t i = 0; i < vec1.size(); ++i) {
+        vec1[i] = (i % 7) * 0.125 - 0.3;
+        vec2[i] = (i % 5) * 0.25 - 0.5;
+    }
+    for (auto level : {n2::SimdLevel::SSE4, n2::SimdLevel::AVX2, n2::SimdLevel::AVX512}) {
+        const auto& kernels = n2::GetDistanceKernels(level);
+        for (size_t qty : {1, 3, 4, 7, 8, 15, 16, 17, 31, 32, 33, 100, 128, 300}) {
+            EXPECT_NEAR(scalar.l2(&vec1[0], &vec2[0], qty), kernels.l2(&vec1[0], &vec2[0], qty), 1e-3);
+            EXPECT_NEAR(scalar.dot(&vec1[0], &vec2[0], qty), kernels.dot(&vec1[0], &vec2[0], qty), 1e-3);
+        }
+    }
+}
+
+TEST_F(CppApiTest, QuantizedDistanceKernelsTest) {
+    const auto& scalar = n2::GetDistanceKernels(n2::SimdLevel::SCALAR);
+    std::vector<float> query(300), scales(300), lut(300 * 256);
+    std::vector<uint8_t> code(300);
+    std::vector<uint16_t> fp16(300), bf16(300);
+    for (size_t i = 0; i < query.size(); ++i) {
+        query[i] = (i % 7) * 0.125 - 0.3;
+        scales[i] = (i % 3 + 1) * 0.01;
+        code[i] = (uint8_t)(i * 37 % 256);
+        fp16[i] = n2::FloatToHalf((i % 5) * 0.25 - 0.51);
+        bf16[i] = n2::FloatToBFloat16((i % 5) * 0.25 - 0.51);
+        EXPECT_NEAR((i % 5) * 0.25 - 0.51, n2::HalfToFloat(fp16[i]), 1e-3);
+        EXPECT_NEAR((i % 5) * 0.25 - 0.51, n2::BFloat16ToFloat(bf16[i]), 1e-2);
+    }
+    for (size_t i = 0; i < lut.size(); ++i) {
+        lut[i] = (i % 11) * 0.1;
+    }
+    for (auto level : {n2::SimdLevel::SSE4, n2::SimdLevel::AVX2, n2::SimdLevel::AVX512}) {
+        const auto& kernels = n2::GetDistanceKernels(level);
+        for (size_t qty : {1, 3, 7, 8, 15, 16, 17, 33, 100, 300}) {
+            EXPECT_NEAR(scalar.sq8_l2(&query[0], &scales[0], &code[0], qty),
+                        kernels.sq8_l2(&query[0], &scales[0], &code[0], qty), 1e-2);
+            EXPECT_NEAR(scalar.sq8_dot(&query[0], &code[0], qty),
+                        kernels.sq8_dot(&query[0], &code[0], qty), 1e-2);
+            EXPECT_NEAR(scalar.pq_adc(&lut[0], &code[0], qty), kernels.pq_adc(&lut[0], &code[0], qty), 1e-3);
+            EXPECT_NEAR(scalar.fp16_l2(&query[0], &fp16[0], qty), kernels.fp16_l2(&query[0], &fp16[0], qty), 1e-3);
+            EXPECT_NEAR(scalar.fp16_dot(&query[0], &fp16[0], qty), kernels.fp16_dot(&query[0], &fp16[0], qty), 1e-3);
+            EXPECT_NEAR(scalar.bf16_l2(&query[0], &bf16[0], qty), kernels.bf16_l2(&query[0], &bf16[0], qty), 1e-3);
+            EXPECT_NEAR(scalar.bf16_dot(&query[0], &bf16[0], qty), kernels.bf16_dot(&query[0], &bf16[0], qty), 1e-3);
+        }
+    }
+}
+
+TEST_F(CppApiTest, HammingDistanceKernelsTest) {
+    const auto& scalar = n2::GetDistanceKernels(n2::SimdLevel::SCALAR);
+    std::vector<uint64_t> vec1(20), vec2(20);
+    for (size_t i = 0; i < vec1.size(); ++i) {
+        vec1[i] = 0x9e3779b97f4a7c15ULL * (i + 1);
+        vec2[i] = 0xc2b2ae3d27d4eb4fULL * (i + 3);
+    }
+    uint64_t inverted = ~vec1[0];
+    EXPECT_EQ(64, scalar.hamming(&vec1[0], &inverted, 1));
+    EXPECT_EQ(0, scalar.hamming(&vec1[0], &vec1[0], 20));
+    for (auto level : {n2::SimdLevel::SSE4, n2::SimdLevel::AVX2, n2::SimdLevel::AVX512}) {
+        const auto& kernels = n2::GetDistanceKernels(level);
+        for (size_t num_words : {1, 4, 7, 8, 9, 16, 20}) {
+            EXPECT_EQ(scalar.hamming(&vec1[0], &vec2[0], num_words), kernels.hamming(&vec1[0], &vec2[0], num_words));
+        }
+    }
+}
+
+TEST_F(CppApiTest, DimSpecializedDistanceKernelsTest) {
+    const auto& scalar = n2::GetDistanceKernels(n2::SimdLevel::SCALAR);
+    std::vector<float> vec1(1024), vec2(1024);
+    for (size_t i = 0; i < vec1.size(); ++i) {
+        vec1[i] = (i % 7) * 0.125 - 0.3;
+        vec2[i] = (i % 5) * 0.25 - 0.5;
+    }
+    for (auto level : {n2::SimdLevel::SCALAR, n2::SimdLevel::SSE4, n2::SimdLevel::AVX2, n2::SimdLevel::AVX512}) {
+        for (size_t dim : {64, 96, 100, 128, 256, 384, 512, 768, 1024}) {
+            const auto& kernels = n2::GetDistanceKernelsForDim(dim, level);
+            EXPECT_NEAR(scalar.l2(&vec1[0], &vec2[0], dim), kernels.l2(&vec1[0], &vec2[0], 0), 1e-2);
+            EXPECT_NEAR(scalar.dot(&vec1[0], &vec2[0], dim), kernels.dot(&vec1[0], &vec2[0], 0), 1e-2);
+        }
+    }
+}
+
+TEST_F(CppApiTest, BatchDistanceKernelsTest) {
+    const size_t num = 9;
+    std::vector<std::vector<float>> vecs(num, std::vector<float>(128));
+    std::vector<float> query(128);
+    for (size_t i = 0; i < query.size(); ++i) {
+        query[i] = (i % 7) * 0.125 - 0.3;
+        for (size_t v = 0; v < num; ++v) vecs[v][i] = ((i + v) % 5) * 0.25 - 0.5;
+    }
+    std::vector<const float*> ptrs;
+    for (const auto& v : vecs) ptrs.push_back(&v[0]);
+
+    for (auto level : {n2::SimdLevel::SCALAR, n2::SimdLevel::SSE4, n2::SimdLevel::AVX2, n2::SimdLevel::AVX512}) {
+        for (size_t dim : {5, 100, 128}) {
+            for (const auto* kernels : {&n2::GetDistanceKernels(level), &n2::GetDistanceKernelsForDim(dim, level)}) {
+                std::vector<float> l2(num), dot(num);
+                kernels->l2_batch(&query[0], &ptrs[0], num, dim, &l2[0]);
+                kernels->dot_batch(&query[0], &ptrs[0], num, dim, &dot[0]);
+                for (size_t v = 0; v < num; ++v) {
+                    EXPECT_NEAR(kernels->l2(&query[0], ptrs[v], dim), l2[v], 1e-3);
+                    EXPECT_NEAR(kernels->dot(&query[0], ptrs[v], dim), dot[v], 1e-3);
+                }
+            }
+        }
+    }
+}
+
+TEST_F(CppApiTest, BoundedDistanceKernelsTest) {
+    std::vector<float> vec1(300), vec2(300);
+    for (size_t i = 0; i < vec1.size(); ++i) {
+        vec1[i] = (i % 7) * 0.125 - 0.3;
+        vec2[i] = (i % 5) * 0.25 - 0.5;
+    }
+    for (auto level : {n2::SimdLevel::SCALAR, n2::SimdLevel::SSE4, n2::SimdLevel::AVX2, n2::SimdLevel::AVX512}) {
+        for (size_t dim : {5, 64, 100, 128, 300}) {
+            for (const auto* kernels : {&n2::GetDistanceKernels(level), &n2::GetDistanceKernelsForDim(dim, level)}) {
+                float exact = kernels->l2(&vec1[0], &vec2[0], dim);
+                EXPECT_NEAR(exact, kernels->l2_bounded(&vec1[0], &vec2[0], dim, exact + 1e-2), 1e-3);
+                EXPECT_NEAR(exact, kernels->l2_bounded(&vec1[0], &vec2[0], dim, std::numeric_limits<float>::max()),
+                            1e-3);
+                float abandoned = kernels->l2_bounded(&vec1[0], &vec2[0], dim, exact * 0.1);
+                EXPECT_GT(abandoned, exact * 0.1);
+                EXPECT_LE(abandoned, exact + 1e-3);
+            }
+        }
+    }
+}
+
+TEST_F(CppApiTest, DimSpecializedSearchTest) {
+    const size_t dim = 128;
+    n2::Hnsw index(dim, "L2");
+    for (size_t i = 0; i < 100; ++i) {
+        std::vector<float> v(dim);
+        for (size_t j = 0; j < dim; ++j) v[j] = (float)((i * 31 + j * 17) % 101) / 101;
+        index.AddData(v);
+    }
+    index.Build(8, 16);
+    for (int id : {0, 42, 99}) {
+        std::vector<std::pair<int, float> > result;
+        index.SearchById(id, 5, 50, result);
+        ASSERT_EQ(5, result.size());
+        EXPECT_EQ(id, result[0].first);
+        EXPECT_FLOAT_EQ(0, result[0].second);
+    }
+}
+
+TEST_F(CppApiTest, GroupedBatchSearchTest) {
+    const size_t dim = 32, num = 200, k = 10;
+    std::vector<std::vector<float>> qvecs(37, std::vector<float>(dim));
+    for (size_t i = 0; i < qvecs.size(); ++i) {
+        for (size_t j = 0; j < dim; ++j) qvecs[i][j] = (float)((i * 131 + j * 7 + i * j) % 97) / 97 - 0.4;
+    }
+    for (std::string metric : {"angular", "L2", "dot", "hamming"}) {
+        for (std::string storage : {"float32", "sq8"}) {
+            if (metric == "hamming" && storage != "float32") continue;
+            n2::Hnsw index(dim, metric);
+            for (size_t i = 0; i < num; ++i) {
+                std::vector<float> v(dim);
+                for (size_t j = 0; j < dim; ++j) v[j] = (float)((i * 7919 + j * 104729 + i * j) % 1009) / 1009 - 0.3;
+                index.AddData(v);
+            }
+            index.SetConfigs({{"VectorStorage", storage}});
+            index.Build(8, 16);
+
+            std::vector<std::vector<std::pair<int, float>>> results;
+            index.GroupedBatchSearchByVectors(qvecs, k, num, 3, results);
+            std::vector<std::vector<int>> ids;
+            index.GroupedBatchSearchByVectors(qvecs, k, num, 2, ids);
+            ASSERT_EQ(qvecs.size(), results.size());
+            ASSERT_EQ(qvecs.size(), ids.size());
+            for (size_t i = 0; i < qvecs.size(); ++i) {
+                std::vector<std::pair<int, float>> expected;
+                index.SearchByVector(qvecs[i], k, num, expected);
+                ASSERT_EQ(expected.size(), results[i].size());
+                ASSERT_EQ(expected.size(), ids[i].size());
+                for (size_t j = 0; j < expected.size(); ++j) {
+                    EXPECT_NEAR(expected[j].second, results[i][j].second, 1e-4);
+                }
+            }
+        }
+    }
+}
+
+TEST_F(CppApiTest, QuantizedVectorStorageTest) {
+    const size_t dim = 48;
+    for (std::string storage : {"sq8", "pq", "fp16", "bf16"}) {
+        for (std::string metric : {"L2", "angular", "dot"}) {
+            n2::Hnsw index(dim, metric);
+            index.SetConfigs({{"M", "8"}, {"MaxM0", "16"}, {"VectorStorage", storage}});
+            for (size_t i = 0; i < 300; ++i) {
+                std::vector<float> v(dim);
+                for (size_t j = 0; j < dim; ++j) v[j] = (float)((i * 7919 + j * 104729 + i * j) % 1009) / 1009 - 0.3;
+                index.AddData(v);
+            }
+            index.Fit();
+            std::vector<std::pair<int, float> > result;
+            index.SearchById(42, 5, 50, result);
+            ASSERT_EQ(5, result.size());
+            if (metric != "dot") {
+                EXPECT_EQ(42, result[0].first);
+                EXPECT_NEAR(0, result[0].second, 1e-5);
+                for (size_t i = 1; i < result.size(); ++i) {
+                    EXPECT_LE(result[i - 1].second, result[i].second);
+                }
+            }
+
+            const std::string fname = "quantized_test.n2";
+            index.SaveModel(fname);
+            n2::Hnsw loaded;
+            loaded.LoadModel(fname, false);
+            std::vector<std::pair<int, float> > loaded_result;
+            loaded.SearchById(42, 5, 50, loaded_result);
+            EXPECT_EQ(result, loaded_result);
+            std::remove(fname.c_str());
+        }
+    }
+    n2::Hnsw index(dim);
+    EXPECT_THROW(index.SetConfigs({{"VectorStorage", "int4"}}), std::runtime_error);
+    EXPECT_THROW(index.SetConfigs({{"PQSubspaces", "7"}}), std::runtime_error);
+}
+
+TEST_F(CppApiTest, SplitModelLayoutTest) {
+    const size_t dim = 20;  // vectors are padded to a multiple of 64 bytes
+    std::vector<std::vector<float>> data(300, std::vector<float>(dim));
+    for (size_t i = 0; i < data.size(); ++i) {
+        for (size_t j = 0; j < dim; ++j) data[i][j] = (float)((i * 7919 + j * 104729 + i * j) % 1009) / 1009 - 0.3;
+    }
+    for (std::string storage : {"float32", "sq8", "fp16"}) {
+        for (std::string metric : {"L2", "angular", "dot"}) {
+            n2::Hnsw index(dim, metric);
+            index.SetConfigs({{"M", "8"}, {"MaxM0", "16"}, {"VectorStorage", storage}, {"ModelLayout", "split"}});
+            for (const auto& v : data) index.AddData(v);
+            index.Fit();
+            std::vector<std::pair<int, float> > result;
+            index.SearchById(42, 5, 50, result);
+            ASSERT_EQ(5, result.size());
+            if (metric != "dot") {
+                EXPECT_EQ(42, result[0].first);
+                EXPECT_NEAR(0, result[0].second, 1e-3);
+            }
+            for (size_t i = 1; i < result.size(); ++i) {
+                if (metric == "dot") EXPECT_GE(result[i - 1].second, result[i].second);
+                else EXPECT_LE(result[i - 1].second, result[i].second);
+            }
+            if (storage == "float32" && metric == "L2") {
+                for (size_t i = 0; i < data.size(); i += 7) {
+                    std::vector<int> nearest;
+                    index.SearchByVector(data[i], 1, 50, nearest);
+                    EXPECT_EQ(std::vector<int>{(int)i}, nearest);
+                }
+            }
+
+            const std::string fname = "split_layout_test.n2";
+            index.SaveModel(fname);
+            for (bool use_mmap : {false, true}) {
+                n2::Hnsw loaded;
+                loaded.LoadModel(fname, use_mmap);
+                std::vector<std::pair<int, float> > loaded_result;
+                loaded.SearchById(42, 5, 50, loaded_result);
+                EXPECT_EQ(result, loaded_result) << storage << " " << metric;
+            }
+            std::remove(fname.c_str());
+        }
+    }
+
+    n2::Hnsw index(dim, "dot");
+    index.SetConfigs({{"ModelLayout", "split"}, {"Reorder", "bfs"}});
+    for (const auto& v : data) index.AddData(v);
+    index.Build(8, 16);
+    std::vector<std::pair<int, float> > result;
+    index.SearchByVector(data[42], 5, 50, result);
+    ASSERT_EQ(5, result.size());
+    for (const auto& p : result) {
+        float ip = 0;
+        for (size_t j = 0; j < dim; ++j) ip += data[42][j] * data[p.first][j];
+        EXPECT_NEAR(ip, p.second, 1e-4);
+    }
+
+    n2::Hnsw hamming_index(64, "hamming");
+    hamming_index.SetConfigs({{"ModelLayout", "split"}});
+    for (size_t i = 0; i < 100; ++i) hamming_index.AddBinaryData(std::vector<uint8_t>(8, (uint8_t)(i * 37)));
+    hamming_index.Build(8, 16);
+    std::vector<std::pair<int, float> > hamming_result;
+    hamming_index.SearchById(10, 1, 50, hamming_result);
+    EXPECT_EQ(0, hamming_result[0].second);
+
+    n2::Hnsw invalid(dim);
+    EXPECT_THROW(invalid.SetConfigs({{"ModelLayout", "soa"}}), std::runtime_error);
+}
+
+TEST_F(CppApiTest, HammingSearchTest) {
+    const size_t dim = 256;
+    std::vector<std::vector<uint8_t>> hashes(200, std::vector<uint8_t>(dim / 8));
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        for (size_t j = 0; j < hashes[i].size(); ++j) hashes[i][j] = (uint8_t)((i * 7919 + j * 104729 + i * j) % 251);
+    }
+    auto unpack = [&](size_t id) {
+        std::vector<float> v(dim);
+        for (size_t b = 0; b < dim; ++b) v[b] = (hashes[id][b / 8] >> (b % 8)) & 1;
+        return v;
+    };
+    auto hamming = [&](size_t a, size_t b) {
+        int count = 0;
+        for (size_t j = 0; j < dim / 8; ++j) count += __builtin_popcount(hashes[a][j] ^ hashes[b][j]);
+        return (float)count;
+    };
+
+    n2::Hnsw index(dim, "hamming");
+    for (size_t i = 0; i < hashes.size(); ++i) {
+        if (i % 2 == 0) index.AddBinaryData(hashes[i]);
+        else index.AddData(unpack(i));
+    }
+    index.Build(8, 16);
+    for (int id : {0, 7, 199}) {
+        std::vector<std::pair<int, float> > result;
+        index.SearchByVector(unpack(id), 5, 50, result);
+        ASSERT_EQ(5, result.size());
+        EXPECT_EQ(id, result[0].first);
+        for (const auto& p : result) EXPECT_EQ(hamming(id, p.first), p.second);
+        std::vector<std::pair<int, float> > by_id;
+        index.SearchById(id, 5, 50, by_id);
+        ASSERT_EQ(5, by_id.size());
+        for (size_t i = 0; i < by_id.size(); ++i) EXPECT_EQ(result[i].second, by_id[i].second);
+    }
+    EXPECT_THROW(index.AddBinaryData(std::vector<uint8_t>(3)), std::runtime_error);
+    n2::Hnsw sq8_index(dim, "hamming");
+    EXPECT_THROW(sq8_index.SetConfigs({{"VectorStorage", "sq8"}}), std::runtime_error);
+    n2::Hnsw l2_index(dim, "L2");
+    EXPECT_THROW(l2_index.AddBinaryData(hashes[0]), std::runtime_error);
+}
+
+TEST_F(CppApiTest, ExtendedConfigReloadTest) {
+    const size_t dim = 16;
+    std::vector<std::vector<float>> data(300, std::vector<float>(dim));
+    for (size_t i = 0; i < data.size(); ++i) {
+        for (size_t j = 0; j < dim; ++j) data[i][j] = (float)((i * 7919 + j * 104729 + i * j) % 1009) / 1009 - 0.5;
+    }
+    const std::string fname = "extended_config_test.n2";
+    std::vector<std::vector<std::pair<std::string, std::string>>> configs = {
+        {{"VectorStorage", "sq8"}}, {{"VectorStorage", "pq"}, {"PQSubspaces", "4"}}, {{"VectorStorage", "fp16"}},
+        {{"VectorStorage", "bf16"}}, {{"Reorder", "bfs"}}, {{"ModelLayout", "split"}}};
+    for (const auto& config : configs) {
+        n2::Hnsw index(dim, "L2");
+        index.SetConfigs(config);
+        for (const auto& v : data) index.AddData(v);
+        index.Fit();
+        index.SaveModel(fname);
+        std::vector<std::pair<int, float> > expected;
+        index.SearchByVector(data[7], 10, 50, expected);
+        for (bool use_mmap : {true, false}) {
+            n2::Hnsw loaded;
+            loaded.LoadModel(fname, use_mmap);
+            std::vector<std::pair<int, float> > result;
+            loaded.SearchByVector(data[7], 10, 50, result);
+            EXPECT_EQ(expected, result) << config[0].second << " " << use_mmap;
+        }
+    }
+    std::remove(fname.c_str());
+}
+
+TEST_F(CppApiTest, PointerSearchTest) {
+    const size_t dim = 40;
+    for (std::string metric : {"angular", "L2", "dot", "hamming"}) {
+        n2::Hnsw index(dim, metric);
+        std::vector<std::vector<float>> data(300, std::vector<float>(dim));
+        for (size_t i = 0; i < data.size(); ++i) {
+            for (size_t j = 0; j < dim; ++j) data[i][j] = (float)((i * 7919 + j * 104729 + i * j) % 1009) / 1009 - 0.3;
+            if (metric == "hamming") {
+                for (auto& x : data[i]) x = x > 0.2;
+            }
+            index.AddData(data[i]);
+        }
+        index.Build(8, 16);
+
+        std::vector<int> ids(10);
+        std::vector<float> distances(10);
+        for (size_t qid : {0, 123}) {
+            std::vector<std::pair<int, float> > expected;
+            index.SearchByVector(data[qid], 10, 50, expected);
+            size_t num = index.SearchByVector(&data[qid][0], 10, 50, &ids[0], &distances[0], ids.size());
+            ASSERT_EQ(expected.size(), num);
+            for (size_t i = 0; i < num; ++i) {
+                EXPECT_EQ(expected[i].first, ids[i]);
+                EXPECT_EQ(expected[i].second, distances[i]);
+            }
+            EXPECT_EQ(3, index.SearchByVector(&data[qid][0], 10, 50, &ids[0], nullptr, 3));
+            EXPECT_EQ(expected[0].first, ids[0]);
+
+            expected.clear();
+            index.SearchById(qid, 10, 50, expected);
+            num = index.SearchById(qid, 10, 50, &ids[0], &distances[0], ids.size());
+            ASSERT_EQ(expected.size(), num);
+            for (size_t i = 0; i < num; ++i) {
+                EXPECT_EQ(expected[i].first, ids[i]);
+                EXPECT_EQ(expected[i].second, distances[i]);
+            }
+        }
+
+        size_t allocations_before = 0;
+        for (int pass = 0; pass < 2; ++pass) {
+            allocations_before = num_allocations;
+            for (size_t qid = 0; qid < data.size(); ++qid) {
+                index.SearchByVector(&data[qid][0], 10, 50, &ids[0], &distances[0], ids.size());
+            }
+        }
+        EXPECT_EQ(allocations_before, num_allocations);
+    }
+}
+
+TEST_F(CppApiTest, FilteredSearchTest) {
+    const size_t dim = 16, num = 2000, k = 10;
+    n2::Hnsw index(dim, "L2");
+    std::vector<std::vector<float>> data(num, std::vector<float>(dim));
+    for (size_t i = 0; i < num; ++i) {
+        for (size_t j = 0; j < dim; ++j) data[i][j] = (float)((i * 7919 + j * 104729 + i * j) % 1009) / 1009;
+        index.AddData(data[i]);
+    }
+    index.Build(8, 16);
+
+    std::vector<uint64_t> allowlist((num + 63) / 64);
+    for (size_t i = 0; i < num; i += 20) allowlist[i / 64] |= 1ULL << (i % 64);
+    n2::SearchFilter bitset_filter(&allowlist[0], num);
+    n2::SearchFilter predicate_filter([](int id) { return id % 20 == 0; });
+    EXPECT_EQ(num / 20, bitset_filter.GetNumAllowed());
+
+    size_t num_hits = 0;
+    std::vector<std::vector<float>> queries;
+    for (size_t qid = 1; qid < num; qid += 97) {
+        const std::vector<float>& q = data[qid];
+        queries.push_back(q);
+        std::vector<std::pair<int, float>> exact;
+        for (size_t i = 0; i < num; i += 20) {
+            float d = 0;
+            for (size_t j = 0; j < dim; ++j) d += (q[j] - data[i][j]) * (q[j] - data[i][j]);
+            exact.emplace_back(i, d);
+        }
+        std::sort(exact.begin(), exact.end(),
+                  [](const std::pair<int, float>& a, const std::pair<int, float>& b) { return a.second < b.second; });
+
+        std::vector<std::pair<int, float>> result, predicate_result;
+        index.SearchByVector(q, k, 50, bitset_filter, result);
+        index.SearchByVector(q, k, 50, predicate_filter, predicate_result);
+        ASSERT_EQ(k, result.size());
+        EXPECT_EQ(result, predicate_result);
+        for (size_t i = 0; i < k; ++i) {
+            EXPECT_EQ(0, result[i].first % 20);
+            for (size_t j = 0; j < k; ++j) {
+                if (exact[j].first == result[i].first) ++num_hits;
+            }
+        }
+
+        // an allowlist no larger than ef_search is searched exhaustively
+        std::vector<std::pair<int, float>> scanned;
+        index.SearchByVector(q, k, num / 20, bitset_filter, scanned);
+        ASSERT_EQ(k, scanned.size());
+        for (size_t i = 0; i < k; ++i) {
+            EXPECT_EQ(exact[i].first, scanned[i].first);
+        }
+    }
+    EXPECT_GE(num_hits, queries.size() * k * 9 / 10);
+
+    std::vector<std::vector<std::pair<int, float>>> batch_results;
+    index.BatchSearchByVectors(queries, k, 50, 2, predicate_filter, batch_results);
+    ASSERT_EQ(queries.size(), batch_results.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+        std::vector<std::pair<int, float>> result;
+        index.SearchByVector(queries[i], k, 50, predicate_filter, result);
+        EXPECT_EQ(result, batch_results[i]);
+    }
+
+    std::vector<int> by_id;
+    index.SearchById(40, k, 50, bitset_filter, by_id);
+    ASSERT_EQ(k, by_id.size());
+    EXPECT_EQ(40, by_id[0]);
+    std::vector<std::vector<int>> batch_by_id;
+    index.BatchSearchByIds({40, 41}, k, 50, 2, bitset_filter, batch_by_id);
+    EXPECT_EQ(by_id, batch_by_id[0]);
+    for (int id : batch_by_id[1]) EXPECT_EQ(0, id % 20);
+
+    n2::SearchFilter nothing_allowed([](int id) { return false; });
+    std::vector<int> empty;
+    index.SearchByVector(data[0], k, 50, nothing_allowed, empty);
+    EXPECT_TRUE(empty.empty());
+
+    // filtered searches append to result up to k items like the unfiltered ones, on both the graph and
+    // allowlist paths
+    std::vector<int> appended = {-1};
+    index.SearchById(40, k, 50, bitset_filter, appended);
+    ASSERT_EQ(k, appended.size());
+    EXPECT_EQ(-1, appended[0]);
+    EXPECT_EQ(std::vector<int>(by_id.begin(), by_id.end() - 1), std::vector<int>(appended.begin() + 1, appended.end()));
+    std::vector<int> scanned;
+    index.SearchById(40, k, num / 20, bitset_filter, scanned);
+    appended = {-1};
+    index.SearchById(40, k, num / 20, bitset_filter, appended);
+    ASSERT_EQ(k, appended.size());
+    EXPECT_EQ(-1, appended[0]);
+    EXPECT_EQ(std::vector<int>(scanned.begin(), scanned.end() - 1),
+              std::vector<int>(appended.begin() + 1, appended.end()));
+    appended = {-1};
+    index.SearchByVector(data[0], k, 50, nothing_allowed, appended);
+    EXPECT_EQ(std::vector<int>{-1}, appended);
+}
+
+TEST_F(CppApiTest, RangeSearchTest) {
+    const size_t dim = 16, num = 3000;
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> uniform(-0.5, 0.5);
+    std::vector<std::vector<float>> data(num, std::vector<float>(dim));
+    for (auto& v : data) {
+        for (auto& x : v) x = uniform(gen);
+    }
+    for (std::string metric : {"L2", "dot", "sq8"}) {
+        n2::Hnsw index(dim, metric == "sq8" ? "L2" : metric);
+        if (metric == "sq8") index.SetConfigs({{"VectorStorage", "sq8"}});
+        for (const auto& v : data) index.AddData(v);
+        index.Build(8, 16);
+
+        // distances as reported by search results, so that dot is larger for nearer items
+        auto distance = [&](const std::vector<float>& q, size_t id) {
+            float sum = 0;
+            for (size_t j = 0; j < dim; ++j) {
+                sum += metric == "dot" ? q[j] * data[id][j] : (q[j] - data[id][j]) * (q[j] - data[id][j]);
+            }
+            return sum;
+        };
+        auto within = [&](float d, float radius) { return metric == "dot" ? d >= radius : d <= radius; };
+        size_t num_expected = 0, num_found = 0;
+        for (size_t qid : {5, 1234, 2999}) {
+            const std::vector<float>& q = data[qid];
+            std::vector<float> dists;
+            for (size_t i = 0; i < num; ++i) dists.push_back(distance(q, i));
+            std::vector<float> sorted = dists;
+            std::sort(sorted.begin(), sorted.end());
+            if (metric == "dot") std::reverse(sorted.begin(), sorted.end());
+            float radius = sorted[100];
+
+            std::vector<std::pair<int, float>> result;
+            index.SearchByVectorRange(q, radius, 0, -1, result);
+            for (size_t i = 0; i < result.size(); ++i) {
+                EXPECT_TRUE(within(dists[result[i].first], radius));
+                EXPECT_NEAR(dists[result[i].first], result[i].second, 1e-4);
+                if (i > 0) EXPECT_TRUE(within(result[i - 1].second, result[i].second));
+            }
+            for (float d : dists) num_expected += within(d, radius);
+            num_found += result.size();
+
+            std::vector<std::pair<int, float>> capped;
+            index.SearchByVectorRange(q, radius, 5, -1, capped);
+            ASSERT_EQ(5, capped.size());
+            EXPECT_TRUE(std::equal(capped.begin(), capped.end(), result.begin()));
+        }
+        EXPECT_GE(num_found, num_expected * 95 / 100);
+    }
+}
+
+TEST_F(CppApiTest, SearchStatsTest) {
+    const size_t dim = 16, num = 2000;
+    n2::Hnsw index(dim, "L2");
+    std::vector<std::vector<float>> data(num, std::vector<float>(dim));
+    for (size_t i = 0; i < num; ++i) {
+        for (size_t j = 0; j < dim; ++j) data[i][j] = (float)((i * 7919 + j * 104729 + i * j) % 1009) / 1009;
+        index.AddData(data[i]);
+    }
+    index.Build(8, 16);
+
+    std::vector<std::pair<int, float>> result;
+    index.SearchByVector(data[3], 10, 20, result);
+    n2::SearchStats narrow = index.GetLastSearchStats();
+    EXPECT_EQ(1, narrow.num_queries);
+    EXPECT_EQ(20, narrow.ef_used);
+    EXPECT_GT(narrow.hops[0], 0);
+    EXPECT_GE(narrow.num_distances, narrow.num_visited);
+    EXPECT_GE(narrow.num_heap_pushes, narrow.hops[0]);
+
+    result.clear();
+    index.SearchByVector(data[3], 10, 200, result);
+    const n2::SearchStats& wide = index.GetLastSearchStats();
+    EXPECT_EQ(1, wide.num_queries);
+    EXPECT_EQ(200, wide.ef_used);
+    EXPECT_GT(wide.num_distances, narrow.num_distances);
+    EXPECT_GT(wide.hops[0], narrow.hops[0]);
+
+    n2::SearchStats total = index.GetSearchStats();
+    EXPECT_EQ(2, total.num_queries);
+    EXPECT_EQ(narrow.num_distances + wide.num_distances, total.num_distances);
+
+    std::vector<std::vector<int>> batch_results;
+    index.BatchSearchByVectors({data[0], data[1], data[2]}, 10, 20, 2, batch_results);
+    EXPECT_EQ(5, index.GetSearchStats().num_queries);
+    index.ResetSearchStats();
+    EXPECT_EQ(0, index.GetSearchStats().num_queries);
+    EXPECT_EQ(0, index.GetSearchStats().num_distances);
+}
+
+TEST_F(CppApiTest, ConcurrentSearchTest) {
+    const size_t dim = 16, num = 2000, num_threads = 8;
+    n2::Hnsw index(dim, "L2");
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> uniform(0, 1);
+    std::vector<std::vector<float>> data(num, std::vector<float>(dim));
+    for (auto& v : data) {
+        for (auto& x : v) x = uniform(rng);
+        index.AddData(v);
+    }
+    index.Build(8, 16);
+
+    std::vector<std::vector<std::pair<int, float>>> expected_by_vector(num), expected_by_id(num);
+    for (size_t i = 0; i < num; ++i) {
+        index.SearchByVector(data[i], 10, 50, expected_by_vector[i]);
+        index.SearchById(i, 10, 50, expected_by_id[i]);
+    }
+    index.ResetSearchStats();
+
+    std::vector<std::vector<std::pair<int, float>>> by_vector(num), by_id(num);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < num_threads; ++t) {
+        threads.emplace_back([&, t]() {
+            for (size_t i = t; i < num; i += num_threads) {
+                index.SearchByVector(data[i], 10, 50, by_vector[i]);
+                index.SearchById(i, 10, 50, by_id[i]);
+                EXPECT_EQ(1, index.GetLastSearchStats().num_queries);
+            }
+        });
+    }
+    for (auto& t : threads) t.join();
+
+    for (size_t i = 0; i < num; ++i) {
+        EXPECT_EQ(expected_by_vector[i], by_vector[i]);
+        EXPECT_EQ(expected_by_id[i], by_id[i]);
+    }
+    EXPECT_EQ(2 * num, index.GetSearchStats().num_queries);
+}
+
+TEST_F(CppApiTest, VisitedSetTest) {
+    const size_t dim = 16, num = 3000;
+    n2::Hnsw index(dim, "L2");
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> uniform(0, 1);
+    std::vector<std::vector<float>> data(num, std::vector<float>(dim));
+    for (auto& v : data) {
+        for (auto& x : v) x = uniform(rng);
+        index.AddData(v);
+    }
+    index.Build(8, 16);
+
+    // more queries than EPOCH8 marks, so its amortized clearing is exercised too
+    std::vector<std::vector<std::pair<int, float>>> expected(600);
+    for (size_t i = 0; i < expected.size(); ++i) {
+        index.SearchByVector(data[i], 10, 300, expected[i]);
+    }
+    for (std::string kind : {"epoch16", "epoch8", "hash", "epoch32"}) {
+        index.SetConfigs({{"VisitedSet", kind}});
+        for (size_t i = 0; i < expected.size(); ++i) {
+            std::vector<std::pair<int, float>> result;
+            index.SearchByVector(data[i], 10, 300, result);
+            ASSERT_EQ(expected[i], result) << kind;
+        }
+    }
+    EXPECT_THROW(index.SetConfigs({{"VisitedSet", "bitmap"}}), std::runtime_error);
+}
+
+TEST_F(CppApiTest, FlatBatchSearchTest) {
+    const size_t dim = 16, num = 2000, num_queries = 100, k = 10;
+    n2::Hnsw index(dim, "L2");
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> uniform(0, 1);
+    std::vector<std::vector<float>> data(num, std::vector<float>(dim));
+    for (auto& v : data) {
+        for (auto& x : v) x = uniform(rng);
+        index.AddData(v);
+    }
+    index.Build(8, 16);
+
+    std::vector<float> qvecs;
+    std::vector<int> qids;
+    for (size_t i = 0; i < num_queries; ++i) {
+        qvecs.insert(qvecs.end(), data[i * 7].begin(), data[i * 7].end());
+        qids.push_back(i * 7);
+    }
+    std::vector<int> ids(num_queries * k);
+    std::vector<float> distances(num_queries * k);
+
+    index.BatchSearchByVectors(&qvecs[0], num_queries, k, 50, 4, &ids[0], &distances[0]);
+    for (size_t i = 0; i < num_queries; ++i) {
+        std::vector<std::pair<int, float>> result;
+        index.SearchByVector(data[i * 7], k, 50, result);
+        ASSERT_EQ(k, result.size());
+        for (size_t j = 0; j < k; ++j) {
+            EXPECT_EQ(result[j].first, ids[i * k + j]);
+            EXPECT_EQ(result[j].second, distances[i * k + j]);
+        }
+    }
+
+    index.BatchSearchByIds(&qids[0], num_queries, k, 50, 4, &ids[0], nullptr);
+    for (size_t i = 0; i < num_queries; ++i) {
+        std::vector<int> result;
+        index.SearchById(qids[i], k, 50, result);
+        EXPECT_EQ(result, std::vector<int>(ids.begin() + i * k, ids.begin() + (i + 1) * k));
+    }
+
+    // rows are padded when the index holds fewer than k items
+    n2::Hnsw small_index(dim, "L2");
+    for (size_t i = 0; i < 4; ++i) small_index.AddData(data[i]);
+    small_index.Build(8, 16);
+    small_index.BatchSearchByVectors(&qvecs[0], 2, k, 50, 2, &ids[0], &distances[0]);
+    for (size_t i = 0; i < 2; ++i) {
+        for (size_t j = 4; j < k; ++j) {
+            EXPECT_EQ(-1, ids[i * k + j]);
+            EXPECT_EQ(-1, distances[i * k + j]);
+        }
+        EXPECT_NE(-1, ids[i * k + 3]);
+    }
+}
+
+TEST_F(CppApiTest, InterleavedBatchSearchTest) {
+    const size_t dim = 48, num = 1500, num_queries = 37, k = 10;
+    for (std::string storage : {"float32", "sq8"}) {
+        for (std::string metric : {"L2", "angular", "dot"}) {
+            n2::Hnsw index(dim, metric);
+            index.SetConfigs({{"M", "8"}, {"MaxM0", "16"}, {"VectorStorage", storage}});
+            std::vector<std::vector<float>> data(num, std::vector<float>(dim));
+            for (size_t i = 0; i < num; ++i) {
+                for (size_t j = 0; j < dim; ++j) data[i][j] = (float)((i * 7919 + j * 104729 + i * j) % 1009) / 1009 - 0.3;
+                index.AddData(data[i]);
+            }
+            index.Fit();
+            index.SetConfigs({{"InterleavedQueries", "4"}});
+            std::vector<std::vector<float>> qvecs(data.begin(), data.begin() + num_queries);
+
+            // queries in flight at once must not see each other's state
+            std::vector<std::vector<std::pair<int, float>>> results;
+            index.BatchSearchByVectors(qvecs, k, 30, 1, results);
+            n2::SearchStats batch_stats = index.GetSearchStats();
+            index.ResetSearchStats();
+            for (size_t i = 0; i < num_queries; ++i) {
+                std::vector<std::pair<int, float>> expected;
+                index.SearchByVector(qvecs[i], k, 30, expected);
+                EXPECT_EQ(expected, results[i]) << storage << " " << metric << " query " << i;
+            }
+            n2::SearchStats stats = index.GetSearchStats();
+            EXPECT_EQ(stats.num_queries, batch_stats.num_queries);
+            EXPECT_EQ(stats.num_distances, batch_stats.num_distances);
+            EXPECT_EQ(stats.hops[0], batch_stats.hops[0]);
+
+            std::vector<float> flat_qvecs;
+            for (const auto& v : qvecs) flat_qvecs.insert(flat_qvecs.end(), v.begin(), v.end());
+            std::vector<int> ids(num_queries * k);
+            index.BatchSearchByVectors(&flat_qvecs[0], num_queries, k, 30, 2, &ids[0], nullptr);
+            for (size_t i = 0; i < num_queries; ++i) {
+                for (size_t j = 0; j < k; ++j) EXPECT_EQ(results[i][j].first, ids[i * k + j]);
+            }
+        }
+    }
+    n2::Hnsw index(dim);
+    EXPECT_THROW(index.SetConfigs({{"InterleavedQueries", "0"}}), std::runtime_error);
+    EXPECT_THROW(index.SetConfigs({{"InterleavedQueries", "many"}}), std::invalid_argument);
+}
+
+TEST_F(CppApiTest, ReorderTest) {
+    const size_t dim = 16, num = 1000, k = 10;
+    std::vector<std::vector<float>> data(num, std::vector<float>(dim));
+    for (size_t i = 0; i < num; ++i) {
+        for (size_t j = 0; j < dim; ++j) data[i][j] = (float)((i * 7919 + j * 104729 + i * j) % 1009) / 1009;
+    }
+    for (std::string storage : {"float32", "sq8"}) {
+        for (std::string reorder : {"bfs", "rcm"}) {
+            n2::Hnsw index(dim, "L2");
+            index.SetConfigs({{"M", "8"}, {"MaxM0", "16"}, {"VectorStorage", storage}, {"Reorder", reorder}});
+            for (const auto& v : data) index.AddData(v);
+            index.Fit();
+
+            // results are item ids, whatever the order nodes are stored in
+            size_t num_hits = 0, num_expected = 0;
+            for (size_t qid = 1; qid < num; qid += 53) {
+                std::vector<std::pair<int, float>> result;
+                index.SearchById(qid, k, 50, result);
+                ASSERT_EQ(k, result.size());
+                EXPECT_EQ((int)qid, result[0].first);
+                std::vector<int> ids(k);
+                ASSERT_EQ(k, index.SearchById(qid, k, 50, &ids[0], nullptr, k));
+                for (size_t i = 0; i < k; ++i) EXPECT_EQ(result[i].first, ids[i]);
+                std::vector<std::pair<int, float>> exact;
+                for (size_t i = 0; i < num; ++i) {
+                    float d = 0;
+                    for (size_t j = 0; j < dim; ++j) d += (data[qid][j] - data[i][j]) * (data[qid][j] - data[i][j]);
+                    exact.emplace_back(i, d);
+                }
+                std::sort(exact.begin(), exact.end(),
+                          [](const std::pair<int, float>& a, const std::pair<int, float>& b) { return a.second < b.second; });
+                for (size_t i = 0; i < k; ++i) {
+                    for (size_t j = 0; j < k; ++j) {
+                        if (exact[j].first == result[i].first) ++num_hits;
+                    }
+                }
+                num_expected += k;
+
+                std::vector<int> filtered;
+                index.SearchByVector(data[qid], k, 50, n2::SearchFilter([](int id) { return id % 20 == 0; }), filtered);
+                ASSERT_EQ(k, filtered.size());
+                for (int id : filtered) EXPECT_EQ(0, id % 20);
+                std::vector<uint64_t> allowlist((num + 63) / 64);
+                allowlist[qid / 64] |= 1ULL << (qid % 64);
+                std::vector<int> allowed;
+                index.SearchById(qid, k, 50, n2::SearchFilter(&allowlist[0], num), allowed);
+                EXPECT_EQ(std::vector<int>{(int)qid}, allowed);
+
+                std::vector<std::pair<int, float>> in_range;
+                index.SearchByVectorRange(data[qid], exact[3].second + 1e-4, 0, -1, in_range);
+                ASSERT_LE(1, in_range.size());
+                EXPECT_EQ((int)qid, in_range[0].first);
+            }
+            EXPECT_LE(0.9 * num_expected, num_hits) << storage << " " << reorder;
+
+            const std::string fname = "reorder_test.n2";
+            index.SaveModel(fname);
+            n2::Hnsw loaded;
+            loaded.LoadModel(fname, false);
+            for (size_t qid = 0; qid < num; qid += 131) {
+                std::vector<std::pair<int, float>> result, loaded_result;
+                index.SearchByVector(data[qid], k, 50, result);
+                loaded.SearchByVector(data[qid], k, 50, loaded_result);
+                EXPECT_EQ(result, loaded_result);
+            }
+            std::remove(fname.c_str());
+        }
+    }
+    n2::Hnsw index(dim);
+    EXPECT_THROW(index.SetConfigs({{"Reorder", "gorder"}}), std::runtime_error);
+}
+
+TEST_F(CppApiTest, ThreadPoolTest) {
+    n2::ThreadPool pool;
+    std::vector<std::atomic<int>> counts(1000);
+    for (auto& c : counts) c = 0;
+    // tasks of very uneven cost, submitted from several threads at once
+    std::vector<std::thread> callers;
+    for (int t = 0; t < 3; ++t) {
+        callers.emplace_back([&]() {
+            pool.ParallelFor(counts.size(), 4, [&](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) {
+                    if (i < 10) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                    ++counts[i];
+                }
+            });
+        });
+    }
+    for (auto& t : callers) t.join();
+    for (const auto& c : counts) EXPECT_EQ(3, c);
+    EXPECT_EQ(3, pool.GetNumWorkers());
+
+    EXPECT_THROW(pool.ParallelFor(100, 4, [](size_t begin, size_t end) {
+        if (begin <= 50 && 50 < end) throw std::runtime_error("task failed");
+    }), std::runtime_error);
+}
+
+TEST_F(CppApiTest, ConcurrentBatchSearchTest) {
+    const size_t dim = 16, num = 2000, batch_size = 32;
+    n2::Hnsw index(dim, "L2");
+    std::mt19937 rng(13);
+    std::uniform_real_distribution<float> uniform(0, 1);
+    std::vector<std::vector<float>> data(num, std::vector<float>(dim));
+    for (auto& v : data) {
+        for (auto& x : v) x = uniform(rng);
+        index.AddData(v);
+    }
+    index.Build(8, 16);
+
+    std::vector<std::vector<int>> expected;
+    index.BatchSearchByVectors(data, 10, 50, 1, expected);
+    std::vector<std::vector<std::vector<int>>> results(num / batch_size);
+    std::vector<std::thread> callers;
+    for (size_t t = 0; t < 4; ++t) {
+        callers.emplace_back([&, t]() {
+            for (size_t b = t; b < results.size(); b += 4) {
+                std::vector<std::vector<float>> batch(data.begin() + b * batch_size,
+                                                      data.begin() + (b + 1) * batch_size);
+                index.BatchSearchByVectors(batch, 10, 50, 4, results[b]);
+            }
+        });
+    }
+    for (auto& t : callers) t.join();
+    for (size_t b = 0; b < results.size(); ++b) {
+        for (size_t i = 0; i < batch_size; ++i) {
+            EXPECT_EQ(expected[b * batch_size + i], results[b][i]);
+        }
+    }
+}
+
 TEST_F(CppApiTest, MinHeapTest) {
     n2::MinHeap<int, float>* minheap = new n2::MinHeap<int, float>();
     minheap->push(3, 3.5);
@@ -87,6 +87,41 @@ func TestSearchByVectorL2(t *testing.T) {
 	os.Remove("test.n2")
 }
 
+func TestSearchIntoL2(t *testing.T) {
+	f := 3
+	index := n2.NewHnswIndex(f, "L2")
+	index.AddData([]float32{0, 0, 1})
+	index.AddData([]float32{0, 1, 0})
+	index.AddData([]float32{1, 0, 0})
+	index.Build(5, 10, 4, 10, 3.5, "heuristic", "skip")
+
+	ids := make([]int32, 3)
+	distances := make([]float32, 3)
+	if n := n2.SearchByVectorInto(index, []float32{1, 2, 3}, 3, -1, ids, distances); n != 3 {
+		t.Errorf("Result should be 3 not %d", n)
+	}
+	expected := []int32{0, 1, 2}
+	expected_distances := []float32{9.0, 11.0, 13.0}
+	for i := range expected {
+		if ids[i] != expected[i] {
+			t.Errorf("Expected %v but got %v", expected, ids)
+		}
+	}
+	if FloatArrayEquals(expected_distances, distances) != true {
+		t.Errorf("Expected %v but got %v", expected_distances, distances)
+	}
+
+	if n := n2.SearchByIdInto(index, 2, 3, -1, ids[:1], nil); n != 1 || ids[0] != 2 {
+		t.Errorf("Expected [2] but got %v", ids[:n])
+	}
+
+	if n := n2.SearchByVectorInto(index, []float32{1, 2}, 3, -1, ids, distances); n != -1 {
+		t.Errorf("Invalid dimension should return -1 not %d", n)
+	}
+
+	n2.DeleteHnswIndex(index)
+}
+
 func TestSearchByVectorAngular(t *testing.T) {
 	f := 3
 	index := n2.NewHnswIndex(f, "angular")
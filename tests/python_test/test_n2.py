@@ -18,6 +18,7 @@
 import unittest
 import random
 import os
+from array import array
 
 try:
     xrange
@@ -238,3 +239,76 @@ class BasicTest(TestCase):
         batch_res = index.batch_search_by_ids(T, 10, num_threads=12, include_distances=True)
         normal_res = [index.search_by_id(t, 10, include_distances=True) for t in T]
         self.assertEqual(batch_res, normal_res)
+
+    def test05_search_into_buffers(self):
+        index = HnswIndex(self.dim)
+        index.load(self.model_fname)
+        ids = array('i', [0] * 10)
+        distances = array('f', [0] * 10)
+        for _ in xrange(10):
+            v = array('f', [random.gauss(0, 1) for z in xrange(self.dim)])
+            n = index.search_by_vector_into(v, 10, ids, distances)
+            res = index.search_by_vector(v, 10, include_distances=True)
+            self.assertEqual(list(ids[:n]), [r[0] for r in res])
+            self.assertEqual(list(distances[:n]), [r[1] for r in res])
+
+            item_id = random.randrange(0, self.data_num)
+            n = index.search_by_id_into(item_id, 10, ids)
+            self.assertEqual(list(ids[:n]), index.search_by_id(item_id, 10))
+
+    def test06_filtered_search(self):
+        index = HnswIndex(self.dim)
+        index.load(self.model_fname)
+        allowed_ids = set(xrange(0, self.data_num, 10))
+        T = [[random.gauss(0, 1) for z in xrange(self.dim)] for y in xrange(10)]
+        for t in T:
+            res = index.search_by_vector(t, 10, allowed_ids=allowed_ids)
+            self.assertEqual(len(res), 10)
+            self.assertTrue(all(r in allowed_ids for r in res))
+        batch_res = index.batch_search_by_vectors(T, 10, num_threads=4, allowed_ids=allowed_ids)
+        self.assertEqual(batch_res, [index.search_by_vector(t, 10, allowed_ids=allowed_ids) for t in T])
+        self.assertEqual(index.search_by_id(20, 10, allowed_ids=allowed_ids)[0], 20)
+        self.assertEqual(index.batch_search_by_ids([20], 10, allowed_ids=allowed_ids),
+                         [index.search_by_id(20, 10, allowed_ids=allowed_ids)])
+        self.assertEqual(index.search_by_vector(T[0], 10, allowed_ids=[]), [])
+
+    def test07_search_by_vector_range(self):
+        index = HnswIndex(self.dim)
+        index.load(self.model_fname)
+        v = [random.gauss(0, 1) for z in xrange(self.dim)]
+        nearest = index.search_by_vector(v, 20, include_distances=True)
+        radius = nearest[9][1]
+        res = index.search_by_vector_range(v, radius)
+        self.assertTrue(all(d <= radius for _, d in res))
+        self.assertTrue(len(set(r[0] for r in res) & set(n[0] for n in nearest[:10])) >= 8)
+        self.assertEqual(index.search_by_vector_range(v, radius, max_results=3), res[:3])
+
+    def test08_search_stats(self):
+        index = HnswIndex(self.dim)
+        index.load(self.model_fname)
+        v = [random.gauss(0, 1) for z in xrange(self.dim)]
+        index.search_by_vector(v, 10, ef_search=100)
+        stats = index.get_search_stats(last=True)
+        self.assertEqual(stats['num_queries'], 1)
+        self.assertEqual(stats['ef_used'], 100)
+        self.assertTrue(stats['num_distances'] > 0 and stats['hops'][0] > 0)
+        index.batch_search_by_vectors([v, v], 10, num_threads=2)
+        self.assertEqual(index.get_search_stats()['num_queries'], 3)
+        index.reset_search_stats()
+        self.assertEqual(index.get_search_stats()['num_queries'], 0)
+
+    def test09_batch_search_into_buffers(self):
+        index = HnswIndex(self.dim)
+        index.load(self.model_fname)
+        T = [[random.gauss(0, 1) for z in xrange(self.dim)] for y in xrange(10)]
+        vs = memoryview(array('f', [x for t in T for x in t])).cast('B').cast('f', [10, self.dim])
+        ids = memoryview(array('i', [0] * 100)).cast('B').cast('i', [10, 10])
+        distances = memoryview(array('f', [0] * 100)).cast('B').cast('f', [10, 10])
+        index.batch_search_by_vectors_into(vs, ids, distances, num_threads=4)
+        res = index.batch_search_by_vectors(T, 10, num_threads=4, include_distances=True)
+        self.assertEqual(ids.tolist(), [[r[0] for r in row] for row in res])
+        self.assertEqual(distances.tolist(), [[r[1] for r in row] for row in res])
+
+        item_ids = array('i', [random.randrange(0, self.data_num) for _ in xrange(10)])
+        index.batch_search_by_ids_into(item_ids, ids)
+        self.assertEqual(ids.tolist(), index.batch_search_by_ids(list(item_ids), 10))